@@ -0,0 +1,143 @@
+/*! \file benchmark.h
+ *  This file contains helpers shared by the benchmark programs. Results are
+ *  printed as one line per measurement:
+ *
+ *  BENCH <name> <key>=<value> ...
+ *
+ *  All values are decimal. Times are in time stamp counter cycles. Lines
+ *  that do not start with "BENCH " are not results.
+ */
+
+#ifndef _BENCHMARK_H_
+#define _BENCHMARK_H_
+
+#include <scwrapper.h>
+
+/*! The executable index of the program that terminates at once. */
+#define CHILD_TERMINATE_EXECUTABLE (1)
+/*! The executable index of the program that yields YIELD_ITERATIONS times
+    and then terminates. Spawned with a role as argument it instead plays
+    that role in the priority inversion benchmark. */
+#define CHILD_YIELD_EXECUTABLE     (2)
+/*! The executable index of a second copy of the yield program. Nothing
+    else creates it, so the preemption benchmark times building its
+    template. */
+#define CHILD_LARGE_EXECUTABLE     (3)
+
+/*! The size of the read-only data of the yield program. It spans at least
+    one whole 2 Mbyte page, so building a template fills both large and
+    small pages. */
+#define LARGE_IMAGE_SIZE           (4*1024*1024)
+
+/*! The number of yields done by each side of the yield ping-pong. */
+#define YIELD_ITERATIONS           (10000)
+
+/*! The mutex the threads of the priority inversion benchmark share. */
+#define INVERSION_MUTEX            (0)
+
+/*! The number of clock ticks the low priority thread holds the mutex. */
+#define INVERSION_CRITICAL_TICKS   (10)
+
+/*! The number of clock ticks the medium priority thread keeps the CPU
+    busy. */
+#define INVERSION_MEDIUM_TICKS     (40)
+
+/*! The number of zero filled pages the data TLB benchmark writes to and
+    reads. The 16 Mbytes are far more than the data TLB reaches with 4 Kbyte
+    pages. */
+#define DTLB_PAGES                 (4096)
+
+/*! Keeps the CPU busy for a number of clock ticks. The kernel only switches
+    thread in system calls, so the system time is read in the loop. */
+static inline void
+benchmark_busy_ticks(const unsigned long ticks)
+{
+ const unsigned long end = time() + ticks;
+
+ while (time() < end)
+ {
+ }
+}
+
+/*! Reads the time stamp counter. */
+static inline unsigned long
+benchmark_rdtsc(void)
+{
+ unsigned int low, high;
+ __asm volatile("rdtsc" : "=a" (low), "=d" (high));
+ return (((unsigned long) high) << 32) | low;
+}
+
+/*! Appends a string to a line buffer. \return The end of the line. */
+static inline char*
+benchmark_append(char* line, const char* string)
+{
+ while (*string)
+ {
+  *line++ = *string++;
+ }
+ *line = 0;
+ return line;
+}
+
+/*! Appends a decimal number to a line buffer. \return The end of the
+    line. */
+static inline char*
+benchmark_append_number(char* line, unsigned long value)
+{
+ char digits[24];
+ int  count = 0;
+
+ do
+ {
+  digits[count++] = '0' + value%10;
+  value /= 10;
+ } while (value);
+
+ while (count)
+ {
+  *line++ = digits[--count];
+ }
+ *line = 0;
+ return line;
+}
+
+/*! Starts a result line. */
+static inline char*
+benchmark_begin(char* line, const char* name)
+{
+ return benchmark_append(benchmark_append(line, "BENCH "), name);
+}
+
+/*! Appends a key=value pair to a result line. */
+static inline char*
+benchmark_value(char* line, const char* key, const unsigned long value)
+{
+ line = benchmark_append(benchmark_append(line, " "), key);
+ return benchmark_append_number(benchmark_append(line, "="), value);
+}
+
+/*! Ends and prints a result line. */
+static inline void
+benchmark_end(char* const line_start, char* line)
+{
+ benchmark_append(line, "\n");
+ prints(line_start);
+}
+
+/*! Prints the result of a benchmark that repeats an operation. */
+static inline void
+benchmark_report(const char*         name,
+                 const unsigned long iterations,
+                 const unsigned long cycles)
+{
+ char  line_start[160];
+ char* line = benchmark_begin(line_start, name);
+
+ line = benchmark_value(line, "iterations", iterations);
+ line = benchmark_value(line, "cycles", cycles);
+ line = benchmark_value(line, "cycles_per_op", cycles/iterations);
+ benchmark_end(line_start, line);
+}
+
+#endif
@@ -0,0 +1,12 @@
+/*! \file child_terminate.c
+ *      \brief A program that terminates at once. Used to measure process
+ *             creation and termination.
+ *
+ */
+
+#include "benchmark.h"
+
+void
+main(int argc, char* argv[])
+{
+}
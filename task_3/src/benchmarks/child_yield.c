@@ -0,0 +1,89 @@
+/*! \file child_yield.c
+ *      \brief A program that yields a fixed number of times and then
+ *             terminates. The other side of the yield ping-pong. Spawned
+ *             with "low", "medium" or "high" as argument it is one of the
+ *             threads of the priority inversion benchmark. Its large
+ *             read-only data makes the image large.
+ *
+ */
+
+#include "benchmark.h"
+
+/*! Read-only data that fills the image. It is not zero, so it is stored in
+    the image rather than mapped to the zero page. */
+static const char large_image_data[LARGE_IMAGE_SIZE]
+ __attribute__((used)) = {1};
+
+/*! Locks the mutex the low priority thread holds and reports how long the
+    thread was blocked. */
+static void
+inversion_high(void)
+{
+ struct thread_statistics statistics;
+ const unsigned long      start_time = time();
+ unsigned long            blocked_ticks;
+ char                     line_start[160];
+ char*                    line;
+
+ if ((ALL_OK != mutexlock(INVERSION_MUTEX)) ||
+     (ALL_OK != mutexunlock(INVERSION_MUTEX)) ||
+     (ALL_OK != threadstats(-1, &statistics)))
+ {
+  prints("BENCH priority_inversion failed\n");
+  return;
+ }
+ blocked_ticks = time() - start_time;
+
+ /* Without priority inheritance the thread also waits for the medium
+    priority thread. */
+ line = benchmark_begin(line_start, "priority_inversion");
+ line = benchmark_value(line, "critical_section_ticks",
+                        INVERSION_CRITICAL_TICKS);
+ line = benchmark_value(line, "medium_ticks", INVERSION_MEDIUM_TICKS);
+ line = benchmark_value(line, "blocked_ticks", blocked_ticks);
+ line = benchmark_value(line, "mutex_wait_cycles",
+                        statistics.mutex_wait_cycles);
+ line = benchmark_value(line, "bounded",
+                        blocked_ticks <= INVERSION_CRITICAL_TICKS + 1);
+ benchmark_end(line_start, line);
+}
+
+void
+main(int argc, char* argv[])
+{
+ unsigned long i;
+
+ if (argc > 1)
+ {
+  switch (argv[1][0])
+  {
+   case 'l':
+   {
+    mutexlock(INVERSION_MUTEX);
+    benchmark_busy_ticks(INVERSION_CRITICAL_TICKS);
+    mutexunlock(INVERSION_MUTEX);
+    break;
+   }
+
+   case 'm':
+   {
+    benchmark_busy_ticks(INVERSION_MEDIUM_TICKS);
+    break;
+   }
+
+   case 'h':
+   {
+    inversion_high();
+    break;
+   }
+
+   /* Any other role, e.g., "exit", terminates at once. */
+  }
+  return;
+ }
+
+ for(i=0; i<YIELD_ITERATIONS+1; i++)
+ {
+  yield();
+ }
+}
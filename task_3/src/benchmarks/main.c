@@ -0,0 +1,479 @@
+/*! \file main.c
+ *      \brief The benchmark program. It measures the cost of kernel
+ *             operations with the time stamp counter and prints the
+ *             results to the debug port. The benchmarks to run are
+ *             selected with the BENCHMARK variable of the Makefile.
+ *             The machine is shut down when the benchmarks are done.
+ *
+ */
+
+#include "benchmark.h"
+
+#ifndef BENCHMARK
+#define BENCHMARK "all"
+#endif
+
+/*! Measures the round trip of the cheapest system call. */
+static void
+benchmark_null_syscall(void)
+{
+ const unsigned long iterations = 100000;
+ unsigned long       start;
+ unsigned long       i;
+
+ start = benchmark_rdtsc();
+ for(i=0; i<iterations; i++)
+ {
+  version();
+ }
+ benchmark_report("null_syscall", iterations, benchmark_rdtsc() - start);
+}
+
+/*! Measures the cost of reading the system time. */
+static void
+benchmark_time(void)
+{
+ const unsigned long iterations = 100000;
+ unsigned long       start;
+ unsigned long       i;
+
+ start = benchmark_rdtsc();
+ for(i=0; i<iterations; i++)
+ {
+  time();
+ }
+ benchmark_report("time", iterations, benchmark_rdtsc() - start);
+}
+
+/*! Measures the latency of creating a process that terminates at once. The
+    yield lets the new process run to completion before the next one is
+    created. */
+static void
+benchmark_createprocess(void)
+{
+ const unsigned long iterations = 100;
+ unsigned long       start;
+ unsigned long       i;
+
+ /* The first launch of an executable builds its template. Later launches
+    copy it. */
+ start = benchmark_rdtsc();
+ if (0 != createprocess(CHILD_TERMINATE_EXECUTABLE))
+ {
+  prints("BENCH createprocess_first failed\n");
+  return;
+ }
+ yield();
+ benchmark_report("createprocess_first", 1, benchmark_rdtsc() - start);
+
+ start = benchmark_rdtsc();
+ for(i=0; i<iterations; i++)
+ {
+  if (0 != createprocess(CHILD_TERMINATE_EXECUTABLE))
+  {
+   prints("BENCH createprocess_terminate failed\n");
+   return;
+  }
+  yield();
+ }
+ benchmark_report("createprocess_terminate", iterations,
+                  benchmark_rdtsc() - start);
+}
+
+/*! Measures the latency of spawning a process with arguments that
+    terminates at once. */
+static void
+benchmark_spawn(void)
+{
+ static const char* const arguments[] =
+  {"child_terminate", "--role", "worker", "--index", "0", 0};
+ const unsigned long iterations = 100;
+ unsigned long       start;
+ unsigned long       i;
+
+ start = benchmark_rdtsc();
+ for(i=0; i<iterations; i++)
+ {
+  if (0 != spawn(CHILD_TERMINATE_EXECUTABLE, arguments, SPAWN_INHERIT, 0))
+  {
+   prints("BENCH spawn_terminate failed\n");
+   return;
+  }
+  yield();
+ }
+ benchmark_report("spawn_terminate", iterations, benchmark_rdtsc() - start);
+}
+
+/*! Measures a context switch by yielding back and forth with another
+    process. Each yield switches to the other process. */
+static void
+benchmark_yield(void)
+{
+ unsigned long start;
+ unsigned long i;
+
+ if (0 != createprocess(CHILD_YIELD_EXECUTABLE))
+ {
+  prints("BENCH yield_pingpong failed\n");
+  return;
+ }
+
+ /* Let the other process start before measuring. */
+ yield();
+
+ start = benchmark_rdtsc();
+ for(i=0; i<YIELD_ITERATIONS; i++)
+ {
+  yield();
+ }
+ benchmark_report("yield_pingpong", 2*YIELD_ITERATIONS,
+                  benchmark_rdtsc() - start);
+}
+
+/*! Measures how long pause really blocks. */
+static void
+benchmark_pause(void)
+{
+ static const int pause_ticks[] = {1, 2, 10};
+ const unsigned long iterations = 20;
+ unsigned int        j;
+
+ for(j=0; j<sizeof(pause_ticks)/sizeof(pause_ticks[0]); j++)
+ {
+  char                   line_start[160];
+  char*                  line;
+  struct idle_statistics before;
+  struct idle_statistics after;
+  unsigned long          start;
+  unsigned long          start_time;
+  unsigned long          end;
+  unsigned long          wakeups;
+  unsigned long          i;
+
+  /* Start right after a clock tick. */
+  pause(1);
+
+  start_time = time();
+  start = benchmark_rdtsc();
+  idlestats(0, &before);
+  for(i=0; i<iterations; i++)
+  {
+   pause(pause_ticks[j]);
+  }
+  end = benchmark_rdtsc();
+
+  line = benchmark_begin(line_start, "pause");
+  line = benchmark_value(line, "ticks", pause_ticks[j]);
+  line = benchmark_value(line, "iterations", iterations);
+  line = benchmark_value(line, "cycles_per_op", (end - start)/iterations);
+  line = benchmark_value(line, "elapsed_ticks", time() - start_time);
+
+  /* Each pause idles the CPU until the timer interrupt wakes the thread.
+     Boot kernels built with IDLE_MWAIT=1 and 0 to compare. */
+  if (ALL_OK == idlestats(0, &after))
+  {
+   wakeups = after.timer_wakeups - before.timer_wakeups;
+   line = benchmark_value(line, "mwait", after.mwait);
+   line = benchmark_value(line, "timer_wakeups", wakeups);
+   if (0 != wakeups)
+   {
+    line = benchmark_value(line, "cycles_per_wakeup",
+                           (after.timer_wakeup_cycles -
+                            before.timer_wakeup_cycles)/wakeups);
+   }
+  }
+  benchmark_end(line_start, line);
+ }
+}
+
+/*! Measures the cost of the timer interrupts taken while the benchmark
+    sleeps. The controller is reported so runs with and without the local
+    APIC can be told apart. Boot kernels built with X2APIC=1 and 0 to
+    compare x2APIC and xAPIC mode. */
+static void
+benchmark_interrupts(void)
+{
+ struct interrupt_statistics before;
+ struct interrupt_statistics after;
+ unsigned long               interrupts;
+ char                        line_start[160];
+ char*                       line;
+
+ if ((ALL_OK != intstats(&before)) || (ALL_OK != pause(40)) ||
+     (ALL_OK != intstats(&after)) ||
+     (0 == (interrupts = after.interrupts - before.interrupts)))
+ {
+  prints("BENCH interrupts failed\n");
+  return;
+ }
+
+ line = benchmark_begin(line_start, "interrupts");
+ line = benchmark_value(line, "controller", after.controller);
+ line = benchmark_value(line, "interrupts", interrupts);
+ line = benchmark_value(line, "entry_to_eoi_cycles",
+                        (after.entry_to_eoi_cycles -
+                         before.entry_to_eoi_cycles)/interrupts);
+ line = benchmark_value(line, "eoi_cycles",
+                        (after.eoi_cycles - before.eoi_cycles)/interrupts);
+ line = benchmark_value(line, "max_entry_to_eoi_cycles",
+                        after.max_entry_to_eoi_cycles);
+ benchmark_end(line_start, line);
+}
+
+/*! Reports how often a long system call let interrupts be taken and the
+    longest time interrupts were disabled while it ran. */
+static void
+preemption_report(const char* const                        name,
+                  const struct interrupt_statistics* const before,
+                  const struct interrupt_statistics* const after)
+{
+ char  line_start[160];
+ char* line;
+
+ line = benchmark_begin(line_start, name);
+ line = benchmark_value(line, "preemption_points",
+                        after->preemption_points - before->preemption_points);
+ line = benchmark_value(line, "max_interrupts_disabled_cycles",
+                        after->max_interrupts_disabled_cycles);
+ line = benchmark_value(line, "preemption_points_built", PREEMPTION_POINTS);
+ benchmark_end(line_start, line);
+}
+
+/*! Prints one long string and creates a process from a large image whose
+    template is not built yet. Boot kernels built with PREEMPTION_POINTS=1
+    and 0 to compare. */
+static void
+benchmark_preemption(void)
+{
+ static char                 text[4096];
+ static const char* const    arguments[] = {"child_yield", "exit", 0};
+ struct interrupt_statistics before;
+ struct interrupt_statistics after;
+ unsigned long               i;
+
+ for(i=0; i<sizeof(text) - 2; i++)
+ {
+  text[i] = '.';
+ }
+ text[sizeof(text) - 2] = '\n';
+
+ /* Reading the statistics clears the longest time. */
+ if ((ALL_OK != intstats(&before)) || (ALL_OK != prints(text)) ||
+     (ALL_OK != intstats(&after)))
+ {
+  prints("BENCH preemption_prints failed\n");
+  return;
+ }
+ preemption_report("preemption_prints", &before, &after);
+
+ if ((ALL_OK != intstats(&before)) ||
+     (0 != spawn(CHILD_LARGE_EXECUTABLE, arguments, SPAWN_INHERIT, 0)) ||
+     (ALL_OK != intstats(&after)))
+ {
+  prints("BENCH preemption_createprocess failed\n");
+  return;
+ }
+ preemption_report("preemption_createprocess", &before, &after);
+}
+
+/*! Reproduces the classic priority inversion. A low priority thread holds
+    a mutex when a high priority thread locks it while a medium priority
+    thread wants the CPU. The high priority thread reports how long it was
+    blocked. */
+static void
+benchmark_inversion(void)
+{
+ static const char* const low[] = {"child_yield", "low", 0};
+ static const char* const medium[] = {"child_yield", "medium", 0};
+ static const char* const high[] = {"child_yield", "high", 0};
+
+ /* Let the low priority thread take the mutex. */
+ if ((0 != spawn(CHILD_YIELD_EXECUTABLE, low, 1, 0)) ||
+     (ALL_OK != pause(2)) ||
+     (0 != spawn(CHILD_YIELD_EXECUTABLE, medium, THREAD_PRIORITIES - 3, 0)) ||
+     (0 != spawn(CHILD_YIELD_EXECUTABLE, high, THREAD_PRIORITIES - 1, 0)))
+ {
+  prints("BENCH priority_inversion failed\n");
+  return;
+ }
+
+ /* Wait until the high priority thread has had the mutex. */
+ mutexlock(INVERSION_MUTEX);
+ mutexunlock(INVERSION_MUTEX);
+}
+
+/*! The zero filled pages the data TLB benchmark writes to and then reads. */
+static char dtlb_pages[DTLB_PAGES*4096];
+
+/*! \return The size, in Kbytes, of the pages the kernel maps memory with.
+    It matches build_kernel_page_table. */
+static unsigned long
+kernel_page_kib(void)
+{
+ unsigned int eax = 0x80000001, ebx, ecx, edx;
+
+ __asm volatile("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+ return ((1024*1024 == KERNEL_PAGE_KIB) && (0 == (edx & (1<<26)))) ?
+        2*1024 : KERNEL_PAGE_KIB;
+}
+
+/*! Reports the data TLB load misses counted over DTLB_PAGES pages. */
+static void
+dtlb_report(const char* const   name,
+            const unsigned long misses)
+{
+ char  line_start[160];
+ char* line;
+
+ line = benchmark_begin(line_start, name);
+ line = benchmark_value(line, "kernel_page_kib", kernel_page_kib());
+ line = benchmark_value(line, "pages", DTLB_PAGES);
+ line = benchmark_value(line, "counted", 1);
+ line = benchmark_value(line, "dtlb_load_misses", misses);
+ line = benchmark_value(line, "dtlb_load_misses_per_page",
+                        misses/DTLB_PAGES);
+ benchmark_end(line_start, line);
+}
+
+/*! Counts the data TLB load misses of writing once to each of DTLB_PAGES
+    zero filled pages, and then of reading all of them a cache line at a
+    time. Each write faults and the kernel reaches the page tables and the
+    new page frame through its direct map, so the count depends on the size
+    of the kernel pages. The pages span far more than the TLB reaches, so
+    the reads miss on every page. Boot kernels built with
+    KERNEL_PAGE_SIZE=1G, 2M and 4K to compare. */
+static void
+benchmark_dtlb(void)
+{
+ volatile char* const pages = dtlb_pages;
+ const long           counter = perfcount(PERF_EVENT_DTLB_LOAD_MISSES, 1);
+ unsigned long        start;
+ unsigned long        fault_misses;
+ unsigned long        stream_misses;
+ unsigned long        sum = 0;
+ unsigned long        i;
+
+ /* Without the event there is nothing to count, e.g., in an emulator. */
+ if (ERROR == counter)
+ {
+  char  line_start[160];
+  char* line;
+
+  line = benchmark_begin(line_start, "dtlb");
+  line = benchmark_value(line, "kernel_page_kib", kernel_page_kib());
+  line = benchmark_value(line, "pages", DTLB_PAGES);
+  line = benchmark_value(line, "counted", 0);
+  benchmark_end(line_start, line);
+  return;
+ }
+
+ start = rdpmc(counter);
+ for(i=0; i<DTLB_PAGES; i++)
+ {
+  pages[i*4096] = 1;
+ }
+ fault_misses = rdpmc(counter) - start;
+
+ start = rdpmc(counter);
+ for(i=0; i<DTLB_PAGES*4096; i+=64)
+ {
+  sum += pages[i];
+ }
+ stream_misses = rdpmc(counter) - start;
+ perfcount(PERF_EVENT_DTLB_LOAD_MISSES, 0);
+
+ dtlb_report("dtlb", fault_misses);
+ /* Every page was written with 1, so the sum shows the reads were done. */
+ if (DTLB_PAGES != sum)
+ {
+  prints("BENCH dtlb_stream failed\n");
+  return;
+ }
+ dtlb_report("dtlb_stream", stream_misses);
+}
+
+/*! Measures the cost per byte of printing to the debug port. */
+static void
+benchmark_prints(void)
+{
+ static const char   text[] =
+  "...............................................................\n";
+ const unsigned long iterations = 100;
+ unsigned long       start;
+ unsigned long       i;
+ char                line_start[160];
+ char*               line;
+ unsigned long       cycles;
+
+ start = benchmark_rdtsc();
+ for(i=0; i<iterations; i++)
+ {
+  prints(text);
+ }
+ cycles = benchmark_rdtsc() - start;
+
+ line = benchmark_begin(line_start, "prints");
+ line = benchmark_value(line, "bytes", iterations*(sizeof(text) - 1));
+ line = benchmark_value(line, "cycles", cycles);
+ line = benchmark_value(line, "cycles_per_byte",
+                        cycles/(iterations*(sizeof(text) - 1)));
+ benchmark_end(line_start, line);
+}
+
+/*! The benchmarks in the order they run. */
+static const struct
+{
+ const char* name;
+ void        (*run)(void);
+} benchmarks[] =
+{
+ {"null_syscall",  benchmark_null_syscall},
+ {"time",          benchmark_time},
+ {"createprocess", benchmark_createprocess},
+ {"spawn",         benchmark_spawn},
+ {"yield",         benchmark_yield},
+ {"pause",         benchmark_pause},
+ {"interrupts",    benchmark_interrupts},
+ {"preemption",    benchmark_preemption},
+ {"inversion",     benchmark_inversion},
+ {"dtlb",          benchmark_dtlb},
+ {"prints",        benchmark_prints}
+};
+
+/*! \return 1 iff the strings are equal. */
+static int
+equal(const char* a, const char* b)
+{
+ while (*a && (*a == *b))
+ {
+  a++;
+  b++;
+ }
+ return *a == *b;
+}
+
+void
+main(int argc, char* argv[])
+{
+ unsigned int i;
+ int          found = 0;
+
+ for(i=0; i<sizeof(benchmarks)/sizeof(benchmarks[0]); i++)
+ {
+  if (equal(BENCHMARK, "all") || equal(BENCHMARK, benchmarks[i].name))
+  {
+   benchmarks[i].run();
+   found = 1;
+  }
+ }
+
+ if (!found)
+ {
+  prints("BENCH unknown benchmark " BENCHMARK "\n");
+ }
+
+ prints("BENCH done\n");
+
+ /* Stop the emulator so that make bench sees the run has ended. */
+ shutdown(found ? 0 : 1);
+}
@@ -87,6 +87,28 @@ createprocess(const int executable)
  return return_value;
 }
 
+/*! Wrapper for the system call that creates processes with arguments.
+ *  @param executable integer identifying the program to run.
+ *  @param argv 0 terminated array of the strings to pass to main, or 0.
+ *  @param priority the priority of the new thread or SPAWN_INHERIT.
+ *  @param affinity the CPUs the new thread may run on or 0 to inherit.
+ */
+static inline unsigned long
+spawn(const int                executable,
+      const char* const* const argv,
+      const int                priority,
+      const unsigned long      affinity)
+{
+ unsigned long          return_value;
+ register unsigned long r10 __asm("r10") = affinity;
+ __asm volatile("syscall" :
+                 "=a" (return_value) :
+                 "a" (SYSCALL_SPAWN), "D" (executable), "S" (argv),
+                 "d" (priority), "r" (r10) :
+                 "cc", "%r11", "%rcx", "memory");
+ return return_value;
+}
+
 /*! Wrapper for the system call that pauses the process for a 
  *  specified number of ticks. 
  *  @param ticks integer holding the number of ticks the process should 
@@ -116,4 +138,225 @@ time(void)
                  "cc", "%rcx", "%r11");
  return return_value;
 }
+
+/*! Wrapper for the system call that dumps the kernel event trace to the
+ *  debug port.
+ */
+static inline unsigned long
+tracedump(void)
+{
+ unsigned long return_value;
+ __asm volatile("syscall" :
+                 "=a" (return_value) :
+                 "a" (SYSCALL_TRACEDUMP) :
+                 "cc", "%rcx", "%r11");
+ return return_value;
+}
+
+/*! Wrapper for the system call that controls the sampling profiler.
+ *  @param command PROFILE_START, PROFILE_STOP or PROFILE_DUMP.
+ *  @param samples_per_tick the number of samples per clock tick. Only used
+ *         by PROFILE_START.
+ */
+static inline unsigned long
+profile(const int command, const int samples_per_tick)
+{
+ unsigned long return_value;
+ __asm volatile("syscall" :
+                 "=a" (return_value) :
+                 "a" (SYSCALL_PROFILE), "D" (command), "S" (samples_per_tick) :
+                 "cc", "%rcx", "%r11");
+ return return_value;
+}
+
+/*! Wrapper for the system call that enables and disables performance
+ *  counters.
+ *  @param event one of the PERF_EVENT_ values.
+ *  @param enable 1 to enable the counter, 0 to disable it.
+ *  @return the counter to pass to rdpmc when enabling, ALL_OK when
+ *          disabling, ERROR on failure. The counter is never ALL_OK.
+ */
+static inline long
+perfcount(const int event, const int enable)
+{
+ long return_value;
+ __asm volatile("syscall" :
+                 "=a" (return_value) :
+                 "a" (SYSCALL_PERFCOUNT), "D" (event), "S" (enable) :
+                 "cc", "%rcx", "%r11");
+ return return_value;
+}
+
+/*! Wrapper for the system call that lets other threads run. */
+static inline unsigned long
+yield(void)
+{
+ unsigned long return_value;
+ __asm volatile("syscall" :
+                 "=a" (return_value) :
+                 "a" (SYSCALL_YIELD) :
+                 "cc", "%rcx", "%r11");
+ return return_value;
+}
+
+/*! Wrapper for the system call that stops the machine.
+ *  @param status the exit status reported to the emulator.
+ */
+static inline void
+shutdown(const int status)
+{
+ __asm volatile("syscall" :
+                 :
+                 "a" (SYSCALL_SHUTDOWN), "D" (status) :
+                 "cc", "%rcx", "%r11");
+ while(1);
+}
+
+/*! Wrapper for the system call that reads the statistics of a thread.
+ *  @param thread the index of a thread of the calling process or -1 for
+ *         the calling thread.
+ *  @param statistics points to the struct to fill in.
+ */
+static inline long
+threadstats(const int thread, struct thread_statistics* const statistics)
+{
+ long return_value;
+ __asm volatile("syscall" :
+                 "=a" (return_value) :
+                 "a" (SYSCALL_THREADSTATS), "D" (thread), "S" (statistics) :
+                 "cc", "%rcx", "%r11", "memory");
+ return return_value;
+}
+
+/*! Wrapper for the system call that sets the CPUs a thread may run on.
+ *  @param thread the index of the thread or -1 for the calling thread.
+ *  @param mask bit i is set to allow CPU i.
+ */
+static inline long
+setaffinity(const int thread, const unsigned long mask)
+{
+ long return_value;
+ __asm volatile("syscall" :
+                 "=a" (return_value) :
+                 "a" (SYSCALL_SETAFFINITY), "D" (thread), "S" (mask) :
+                 "cc", "%rcx", "%r11");
+ return return_value;
+}
+
+/*! Wrapper for the system call that returns the CPUs a thread may run on.
+ *  @param thread the index of the thread or -1 for the calling thread.
+ *  @return the mask of CPUs, ERROR if there is no such thread.
+ */
+static inline long
+getaffinity(const int thread)
+{
+ long return_value;
+ __asm volatile("syscall" :
+                 "=a" (return_value) :
+                 "a" (SYSCALL_GETAFFINITY), "D" (thread) :
+                 "cc", "%rcx", "%r11");
+ return return_value;
+}
+
+/*! Wrapper for the system call that manages cpusets.
+ *  @param command CPUSET_CREATE, CPUSET_ATTACH or CPUSET_DESTROY.
+ *  @param name the name of the cpuset.
+ *  @param argument the CPUs to reserve for CPUSET_CREATE, the index of the
+ *         process or -1 for CPUSET_ATTACH.
+ */
+static inline long
+cpuset(const int command, const char* const name, const long argument)
+{
+ long return_value;
+ __asm volatile("syscall" :
+                 "=a" (return_value) :
+                 "a" (SYSCALL_CPUSET), "D" (command), "S" (name),
+                 "d" (argument) :
+                 "cc", "%rcx", "%r11", "memory");
+ return return_value;
+}
+
+/*! Wrapper for the system call that dumps the kernel lock statistics to
+ *  the debug port.
+ */
+static inline unsigned long
+lockstats(void)
+{
+ unsigned long return_value;
+ __asm volatile("syscall" :
+                 "=a" (return_value) :
+                 "a" (SYSCALL_LOCKSTATS) :
+                 "cc", "%rcx", "%r11");
+ return return_value;
+}
+
+/*! Wrapper for the system call that reads the interrupt statistics of the
+ *  CPU.
+ *  @param statistics points to the struct to fill in.
+ */
+static inline long
+intstats(struct interrupt_statistics* const statistics)
+{
+ long return_value;
+ __asm volatile("syscall" :
+                 "=a" (return_value) :
+                 "a" (SYSCALL_INTSTATS), "D" (statistics) :
+                 "cc", "%rcx", "%r11", "memory");
+ return return_value;
+}
+
+/*! Wrapper for the system call that reads the idle statistics of a CPU.
+ *  @param cpu the index of the CPU.
+ *  @param statistics points to the struct to fill in.
+ */
+static inline long
+idlestats(const int cpu, struct idle_statistics* const statistics)
+{
+ long return_value;
+ __asm volatile("syscall" :
+                 "=a" (return_value) :
+                 "a" (SYSCALL_IDLESTATS), "D" (cpu), "S" (statistics) :
+                 "cc", "%rcx", "%r11", "memory");
+ return return_value;
+}
+
+/*! Wrapper for the system call that locks a priority inheritance mutex.
+ *  @param mutex the index of the mutex.
+ */
+static inline long
+mutexlock(const int mutex)
+{
+ long return_value;
+ __asm volatile("syscall" :
+                 "=a" (return_value) :
+                 "a" (SYSCALL_MUTEXLOCK), "D" (mutex) :
+                 "cc", "%rcx", "%r11", "memory");
+ return return_value;
+}
+
+/*! Wrapper for the system call that unlocks a priority inheritance mutex.
+ *  @param mutex the index of the mutex.
+ */
+static inline long
+mutexunlock(const int mutex)
+{
+ long return_value;
+ __asm volatile("syscall" :
+                 "=a" (return_value) :
+                 "a" (SYSCALL_MUTEXUNLOCK), "D" (mutex) :
+                 "cc", "%rcx", "%r11", "memory");
+ return return_value;
+}
+
+/*! Reads a performance counter enabled with perfcount.
+ *  @param counter the counter returned by perfcount.
+ */
+static inline unsigned long
+rdpmc(const long counter)
+{
+ unsigned int low, high;
+ /* perfcount returns the index of the counter plus one. */
+ __asm volatile("rdpmc" : "=a" (low), "=d" (high) : "c" (counter - 1));
+ return (((unsigned long) high) << 32) | low;
+}
 #endif
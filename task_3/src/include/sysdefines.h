@@ -16,7 +16,8 @@
 /*! System call that returns the version
  *  of the kernel. */
 #define SYSCALL_VERSION         (0)
-/*! System call that prints a string. */
+/*! System call that prints a string. Returns ERROR if the string does not
+ *  start and end in the user space. */
 #define SYSCALL_PRINTS          (1)
 /*! System call that prints a hexadecimal
  *  value. */
@@ -45,4 +46,244 @@
     number of clock ticks since system start. There are 200 clock ticks per 
     second. */
 #define SYSCALL_TIME            (7)
+
+/*! System call that writes the kernel event trace to the debug port and
+    empties the trace buffers. It takes no parameters. */
+#define SYSCALL_TRACEDUMP       (8)
+
+/*! System call that controls the sampling profiler. The command is passed in
+    rdi. PROFILE_START takes the number of samples per clock tick in rsi. It
+    must divide 5966. Returns ERROR if the command fails. */
+#define SYSCALL_PROFILE         (9)
+
+/*! Starts the profiler. Samples taken earlier are discarded. */
+#define PROFILE_START           (0)
+/*! Stops the profiler. */
+#define PROFILE_STOP            (1)
+/*! Writes the samples to the debug port and discards them. */
+#define PROFILE_DUMP            (2)
+
+/*! System call that enables or disables a performance counter for the
+    calling thread. The event is passed in rdi and 1 to enable or 0 to
+    disable in rsi. Enabling returns the counter index plus one, so that
+    counter 0 can not be mistaken for ALL_OK. The rdpmc instruction takes
+    the index itself. The counter only counts while the thread executes in
+    user mode, except for PERF_EVENT_DTLB_LOAD_MISSES. Returns ERROR if the
+    event can not be counted or all counters are in use. */
+#define SYSCALL_PERFCOUNT       (10)
+
+/*! Counts core clock cycles. */
+#define PERF_EVENT_CYCLES            (0)
+/*! Counts retired instructions. */
+#define PERF_EVENT_INSTRUCTIONS      (1)
+/*! Counts reference clock cycles. */
+#define PERF_EVENT_REFERENCE_CYCLES  (2)
+/*! Counts last level cache references. */
+#define PERF_EVENT_LLC_REFERENCES    (3)
+/*! Counts last level cache misses. */
+#define PERF_EVENT_LLC_MISSES        (4)
+/*! Counts retired branch instructions. */
+#define PERF_EVENT_BRANCHES          (5)
+/*! Counts mispredicted retired branch instructions. */
+#define PERF_EVENT_BRANCH_MISSES     (6)
+/*! Counts data TLB load misses that completed a page walk. The count
+    includes the system calls and page faults of the thread, as kernel pages
+    are only used in kernel mode. Only available on Intel cores from Haswell
+    to Tiger Lake. */
+#define PERF_EVENT_DTLB_LOAD_MISSES  (7)
+
+/*! System call that reads the statistics of a thread. The index of the
+    thread is passed in rdi, -1 means the calling thread. Only threads of
+    the calling process can be read. A pointer to a struct
+    thread_statistics to fill in is passed in rsi. Returns ERROR if there is
+    no such thread in the process or the pointer is bad. */
+#define SYSCALL_THREADSTATS     (11)
+
+/*! The number of buckets in the wakeup latency histogram. Bucket 0 counts
+    latencies below 2^12 cycles. Bucket i, 0<i<15, counts latencies from
+    2^(11+i) up to 2^(12+i) cycles. Bucket 15 counts the rest. */
+#define THREAD_STATISTICS_BUCKETS (16)
+
+/*! Holds the statistics the scheduler keeps for a thread. Times are in time
+    stamp counter cycles. */
+struct thread_statistics
+{
+ unsigned long runnable_wait_cycles;
+ /*!< The time spent in the ready queue. */
+ unsigned long on_cpu_cycles;
+ /*!< The time spent executing. */
+ unsigned long voluntary_switches;
+ /*!< The number of times the thread blocked or yielded. */
+ unsigned long involuntary_switches;
+ /*!< The number of times the thread was preempted. */
+ unsigned long wakeups;
+ /*!< The number of times the thread was woken up from the timer queue. */
+ unsigned long mutex_wait_cycles;
+ /*!< The time spent blocked on mutexes. */
+ unsigned long wakeup_latency_histogram[THREAD_STATISTICS_BUCKETS];
+ /*!< The time from being woken up until running. */
+};
+
+/*! System call that moves the calling thread to the tail of the ready
+    queue. It takes no parameters. */
+#define SYSCALL_YIELD           (12)
+
+/*! System call that stops the machine. The exit status is passed in rdi.
+    Under QEMU with an isa-debug-exit device at port 0xf4 the emulator exits
+    with the status (rdi<<1)|1. Does not return. */
+#define SYSCALL_SHUTDOWN        (13)
+
+/*! System call that creates a new process with one single thread, like
+    createprocess, and passes arguments to it. The index of the executable
+    is passed in rdi, a pointer to a 0 terminated array of string pointers
+    in rsi (0 for no arguments), the priority of the thread in rdx and its
+    affinity mask in r10. The strings are copied to the top of the stack of
+    the new process and main gets them in argc and argv. SPAWN_INHERIT as
+    priority and 0 as affinity give the values of the calling thread.
+    Returns ERROR if the arguments take more than SPAWN_MAX_ARGUMENT_BYTES
+    or if the process can not be created. */
+#define SYSCALL_SPAWN           (14)
+
+/*! The number of thread priorities. Ready threads with a higher priority
+    run before threads with a lower one. */
+#define THREAD_PRIORITIES        (8)
+/*! The priority of the first thread. */
+#define THREAD_PRIORITY_DEFAULT  (4)
+/*! Passed as the priority to spawn to use the priority of the caller. */
+#define SPAWN_INHERIT            (-1)
+/*! The largest size of the argument block spawn puts on the stack, the
+    argv array included. The block is 16 byte aligned in the top page of the
+    stack. */
+#define SPAWN_MAX_ARGUMENT_BYTES (4080)
+/*! System call that sets the CPUs a thread may run on. The index of the
+    thread is passed in rdi, -1 means the calling thread, and the mask in
+    rsi. Bit i of the mask allows CPU i. The thread only runs on the CPUs of
+    the mask that are also in the cpuset of its process. Returns ERROR if
+    there is no such thread or no such CPU. */
+#define SYSCALL_SETAFFINITY     (15)
+
+/*! System call that returns the CPUs a thread may run on, that is the
+    affinity mask of the thread limited to the cpuset of its process. The
+    index of the thread is passed in rdi, -1 means the calling thread.
+    Returns ERROR, which has bits set for CPUs that can not exist, if there
+    is no such thread. */
+#define SYSCALL_GETAFFINITY     (16)
+
+/*! System call that manages cpusets. A cpuset is a named group of CPUs
+    reserved for the processes attached to it. No other process runs on
+    them. The command is passed in rdi and the name of the cpuset in rsi.
+    CPUSET_CREATE takes the CPUs to reserve in rdx. CPUSET_ATTACH takes the
+    index of the process to attach in rdx, -1 means the calling process.
+    New processes are attached to the cpuset of their parent. The CPUs not
+    reserved form the cpuset named "root". The boot CPU services the
+    interrupts and is never reserved. Returns ERROR if the command fails. */
+#define SYSCALL_CPUSET          (17)
+
+/*! Creates a cpuset. */
+#define CPUSET_CREATE           (0)
+/*! Moves a process to a cpuset. */
+#define CPUSET_ATTACH           (1)
+/*! Removes a cpuset with no processes attached. Its CPUs return to the root
+    cpuset. */
+#define CPUSET_DESTROY          (2)
+
+/*! The size of the name of a cpuset, the terminating 0 included. */
+#define CPUSET_NAME_SIZE        (16)
+
+/*! System call that writes the statistics of the kernel locks to the debug
+    port and clears them. Each lock gives a line "LOCK name acquisitions
+    contentions wait_cycles hold_cycles max_hold_cycles" with the numbers in
+    hexadecimal. It takes no parameters. */
+#define SYSCALL_LOCKSTATS       (18)
+
+/*! System call that reads the interrupt statistics of the CPU the calling
+    thread runs on. A pointer to a struct interrupt_statistics to fill in is
+    passed in rdi. Clears max_interrupts_disabled_cycles. Returns ERROR if
+    the pointer is bad. */
+#define SYSCALL_INTSTATS        (19)
+
+/*! Interrupts are delivered by the legacy 8259 programmable interrupt
+    controller. Used when the CPU has no local APIC. */
+#define INTERRUPT_CONTROLLER_PIC    (0)
+/*! Interrupts are delivered by the local APIC through its memory mapped
+    registers. */
+#define INTERRUPT_CONTROLLER_XAPIC  (1)
+/*! Interrupts are delivered by the local APIC in x2APIC mode, which is
+    programmed through MSRs. */
+#define INTERRUPT_CONTROLLER_X2APIC (2)
+
+/*! System call that reads the idle statistics of a CPU. The index of the
+    CPU is passed in rdi. A pointer to a struct idle_statistics to fill in
+    is passed in rsi. Returns ERROR if there is no such CPU or the pointer
+    is bad. */
+#define SYSCALL_IDLESTATS       (20)
+
+/*! Holds the idle statistics of a CPU. Wake ups by other CPUs and by the
+    timer interrupt are counted apart. Times are in time stamp counter
+    cycles. */
+struct idle_statistics
+{
+ unsigned long mwait;
+ /*!< 1 if the CPU waits with MWAIT, 0 if it waits with hlt. */
+ unsigned long wakeups;
+ /*!< The number of times another CPU woke the CPU. */
+ unsigned long wakeup_cycles;
+ /*!< The time from being woken until the CPU picked a thread, summed over
+      all wake ups. */
+ unsigned long max_wakeup_cycles;
+ /*!< The longest time from being woken until the CPU picked a thread. */
+ unsigned long timer_wakeups;
+ /*!< The number of times the timer interrupt woke a thread for the idle
+      CPU to run. */
+ unsigned long timer_wakeup_cycles;
+ /*!< The time from the timer expiring until the CPU ran the thread it woke,
+      summed over all timer wake ups. Without a local APIC the time is
+      counted from the entry of the handler. */
+ unsigned long max_timer_wakeup_cycles;
+ /*!< The longest time from the timer expiring until the CPU ran the thread
+      it woke. */
+};
+
+/*! Holds the interrupt statistics of a CPU. Times are in time stamp counter
+    cycles and are measured from the entry of the C handler, after the
+    context has been saved. */
+struct interrupt_statistics
+{
+ unsigned long controller;
+ /*!< One of the INTERRUPT_CONTROLLER_ values. */
+ unsigned long interrupts;
+ /*!< The number of interrupts handled. */
+ unsigned long entry_to_eoi_cycles;
+ /*!< The time from entering the handler until the end of interrupt was
+      signalled, summed over all interrupts. */
+ unsigned long max_entry_to_eoi_cycles;
+ /*!< The longest time from entering the handler until the end of interrupt
+      was signalled. */
+ unsigned long eoi_cycles;
+ /*!< The time spent signalling the end of interrupt, summed over all
+      interrupts. */
+ unsigned long preemption_points;
+ /*!< The number of times a system call let pending interrupts be taken. */
+ unsigned long max_interrupts_disabled_cycles;
+ /*!< The longest time a system call ran with interrupts disabled, between
+      entering the kernel, preemption points and leaving the system call
+      handler, since the statistics were last read. Bounds the time an
+      interrupt waits for a system call. */
+};
+
+/*! System call that locks a priority inheritance mutex. The index of the
+    mutex, 0 to MAX_NUMBER_OF_MUTEXES-1, is passed in rdi. If another thread
+    owns the mutex the calling thread blocks until it is handed the mutex,
+    and lends its priority to the owner meanwhile. Returns ERROR if there is
+    no such mutex or if waiting would deadlock, as when the thread already
+    owns the mutex. */
+#define SYSCALL_MUTEXLOCK       (21)
+
+/*! System call that unlocks a mutex the calling thread owns. The index of
+    the mutex is passed in rdi. The mutex is handed to the waiting thread of
+    highest priority. Returns ERROR if the thread does not own the mutex. */
+#define SYSCALL_MUTEXUNLOCK     (22)
+
+/*! The number of mutexes. They are shared by all processes. */
+#define MAX_NUMBER_OF_MUTEXES   (32)
 #endif
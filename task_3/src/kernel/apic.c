@@ -0,0 +1,586 @@
+/*! \file apic.c
+ * This file implements the support for the interrupt controllers.
+ */
+
+#include "apic.h"
+#include "paging.h"
+
+/* Note: Look in apic.h for documentation of global variables and
+   functions. */
+
+/* Variables */
+
+int
+interrupt_controller = INTERRUPT_CONTROLLER_PIC;
+
+unsigned int
+local_apic_ids[MAX_NUMBER_OF_CPUS];
+
+struct interrupt_statistics
+interrupt_statistics[MAX_NUMBER_OF_CPUS];
+
+/*! The registers of the local APIC in xAPIC mode. All CPUs see their own
+    local APIC at the same address. */
+static volatile unsigned int*
+local_apic_registers = 0;
+
+/*! The number of local APIC timer ticks in a clock tick. 0 until it has
+    been measured. */
+static unsigned int
+local_apic_timer_ticks_per_clock_tick = 0;
+
+/*! The number of time stamp counter cycles in a clock tick. Measured with
+    local_apic_timer_ticks_per_clock_tick. */
+static unsigned long
+tsc_cycles_per_clock_tick = 0;
+
+/*! The registers of the IO APIC. 0 if there is none. */
+static volatile unsigned int*
+ioapic_registers = 0;
+
+/*! The first global system interrupt handled by the IO APIC. */
+static unsigned int
+ioapic_first_interrupt = 0;
+
+/*! The number of inputs of the IO APIC. */
+static unsigned int
+ioapic_inputs = 0;
+
+/*! The global system interrupt, polarity and trigger mode of each ISA
+    interrupt. The flags are those of the interrupt source overrides of the
+    ACPI tables. ISA interrupts are active high and edge triggered unless
+    overridden. */
+static struct
+{
+ unsigned int   interrupt;
+ unsigned short flags;
+} isa_interrupts[16];
+
+/* Functions */
+
+/*! \return The 32-bit little endian value at an address that may not be
+    aligned. */
+static unsigned int
+read32(const unsigned char* const address
+       /*!< The first byte of the value. */)
+{
+ return address[0] | (address[1] << 8) | (address[2] << 16) |
+        (((unsigned int) address[3]) << 24);
+}
+
+/*! \return 1 if the bytes of an ACPI structure sum to zero, 0 otherwise. */
+static int
+acpi_checksum_ok(const unsigned char* const address
+                 /*!< The first byte of the structure. */,
+                 const unsigned int         length
+                 /*!< The length of the structure in bytes. */)
+{
+ unsigned char sum = 0;
+ register unsigned int i;
+
+ for(i=0; i<length; i++)
+ {
+  sum += address[i];
+ }
+ return 0 == sum;
+}
+
+/*! Searches for the root system description pointer of ACPI. It is in the
+    first Kbyte of the extended BIOS data area or in the BIOS read-only
+    memory, on a 16 byte boundary.
+    \return The address of the pointer or 0 if there is none. */
+static const unsigned char*
+find_rsdp(void)
+{
+ /* The segment of the extended BIOS data area is kept at address 0x40e. */
+ const unsigned long ranges[2][2] =
+  {{((unsigned long) *(volatile unsigned short*) 0x40e) << 4, 1024},
+   {0xe0000, 0x20000}};
+ register int        i;
+
+ for(i=0; i<2; i++)
+ {
+  unsigned long address;
+
+  for(address=ranges[i][0];
+      address<ranges[i][0] + ranges[i][1];
+      address+=16)
+  {
+   const unsigned char* const rsdp = (const unsigned char*) address;
+
+   if (('R' == rsdp[0]) && ('S' == rsdp[1]) && ('D' == rsdp[2]) &&
+       (' ' == rsdp[3]) && ('P' == rsdp[4]) && ('T' == rsdp[5]) &&
+       ('R' == rsdp[6]) && (' ' == rsdp[7]) && acpi_checksum_ok(rsdp, 20))
+   {
+    return rsdp;
+   }
+  }
+ }
+ return 0;
+}
+
+/*! Maps an ACPI table and checks it. The tables are often kept in memory
+    that is not part of the direct map.
+    \return The address of the table or 0 if it is corrupt. */
+static const unsigned char*
+map_acpi_table(const unsigned long address
+               /*!< The physical address of the table. */)
+{
+ const unsigned char* const table = (const unsigned char*) address;
+ unsigned int               length;
+
+ /* The header holds the length of the table. The tables used here are far
+    smaller than 64 Kbyte. */
+ map_device_memory(address, 36);
+ length = read32(table + 4);
+ if ((length < 36) || (length > 0x10000))
+ {
+  return 0;
+ }
+ map_device_memory(address, length);
+ return acpi_checksum_ok(table, length) ? table : 0;
+}
+
+/*! Finds the multiple APIC description table through the root system
+    description table.
+    \return The address of the table or 0 if there is none. */
+static const unsigned char*
+find_madt(void)
+{
+ const unsigned char* const rsdp = find_rsdp();
+ const unsigned char*       rsdt;
+ register unsigned int      offset;
+
+ if ((0 == rsdp) || (0 == (rsdt = map_acpi_table(read32(rsdp + 16)))))
+ {
+  return 0;
+ }
+
+ /* The root table holds the 32-bit addresses of the other tables after its
+    36 byte header. */
+ for(offset=36; offset+4<=read32(rsdt + 4); offset+=4)
+ {
+  const unsigned char* const table = map_acpi_table(read32(rsdt + offset));
+
+  if ((0 != table) && ('A' == table[0]) && ('P' == table[1]) &&
+      ('I' == table[2]) && ('C' == table[3]))
+  {
+   return table;
+  }
+ }
+ return 0;
+}
+
+/*! Reads the IO APIC and the ISA interrupt source overrides from the
+    multiple APIC description table. Only the IO APIC that handles global
+    system interrupt 0 is used. */
+static void
+parse_madt(void)
+{
+ const unsigned char* const madt = find_madt();
+ register unsigned int      offset;
+
+ for(offset=0; offset<16; offset++)
+ {
+  isa_interrupts[offset].interrupt = offset;
+  isa_interrupts[offset].flags = 0;
+ }
+
+ if (0 == madt)
+ {
+  return;
+ }
+
+ /* The entries follow the 44 byte header. Each starts with its type and
+    length. */
+ for(offset=44; offset+2<=read32(madt + 4); offset+=madt[offset+1])
+ {
+  const unsigned char* const entry = madt + offset;
+
+  if (entry[1] < 2)
+  {
+   break;
+  }
+
+  /* Type 1 is an IO APIC. */
+  if ((1 == entry[0]) && (0 == read32(entry + 8)))
+  {
+   ioapic_registers = (volatile unsigned int*) (unsigned long)
+                      read32(entry + 4);
+   ioapic_first_interrupt = read32(entry + 8);
+  }
+
+  /* Type 2 overrides an ISA interrupt. */
+  if ((2 == entry[0]) && (0 == entry[2]) && (entry[3] < 16))
+  {
+   isa_interrupts[entry[3]].interrupt = read32(entry + 4);
+   isa_interrupts[entry[3]].flags = entry[8] | (entry[9] << 8);
+  }
+ }
+}
+
+/*! \return The value of a register of the local APIC of the calling
+    CPU. */
+static unsigned int
+local_apic_read(const unsigned int offset
+                /*!< The offset of the register. */)
+{
+ if (INTERRUPT_CONTROLLER_X2APIC == interrupt_controller)
+ {
+  return (unsigned int) rdmsr(X2APIC_MSR_BASE + offset/16);
+ }
+ return local_apic_registers[offset/4];
+}
+
+/*! Writes a register of the local APIC of the calling CPU. */
+static void
+local_apic_write(const unsigned int offset
+                 /*!< The offset of the register. */,
+                 const unsigned int value
+                 /*!< The value to write. */)
+{
+ if (INTERRUPT_CONTROLLER_X2APIC == interrupt_controller)
+ {
+  wrmsr(X2APIC_MSR_BASE + offset/16, value);
+  return;
+ }
+ local_apic_registers[offset/4] = value;
+}
+
+/*! \return The value of a register of the IO APIC. */
+static unsigned int
+ioapic_read(const unsigned int index
+            /*!< The index of the register. */)
+{
+ ioapic_registers[0] = index;
+ return ioapic_registers[4];
+}
+
+/*! Writes a register of the IO APIC. */
+static void
+ioapic_write(const unsigned int index
+             /*!< The index of the register. */,
+             const unsigned int value
+             /*!< The value to write. */)
+{
+ ioapic_registers[0] = index;
+ ioapic_registers[4] = value;
+}
+
+/*! Writes a redirection entry of the IO APIC. The high half, which holds the
+    destination, is written first so the entry is not unmasked with the old
+    destination. */
+static void
+ioapic_write_redirection(const unsigned int  input
+                         /*!< The input of the IO APIC. */,
+                         const unsigned long entry
+                         /*!< The redirection entry. */)
+{
+ ioapic_write(IOAPIC_REDIRECTION_TABLE + 2*input + 1, entry >> 32);
+ ioapic_write(IOAPIC_REDIRECTION_TABLE + 2*input, (unsigned int) entry);
+}
+
+/*! Measures the local APIC timer ticks in one clock tick. Channel 2 of the
+    programmable interval timer counts down one clock tick while the local
+    APIC timer counts down from its largest value. The output of channel 2
+    is read in bit 5 of port 0x61, where bit 0 is its gate and bit 1 enables
+    the speaker. The time stamp counter cycles in the tick are stored in
+    tsc_cycles_per_clock_tick.
+    \return The number of local APIC timer ticks. */
+static unsigned int
+measure_local_apic_timer(void)
+{
+ unsigned long start;
+
+ outb(0x61, (inb(0x61) & ~0x02) | 0x01);
+
+ /* Channel 2, low byte then high byte, mode 0 counts down once. */
+ outb(0x43, 0xb0);
+ outb(0x42, PIT_TICK_DIVISOR&255);
+ outb(0x42, PIT_TICK_DIVISOR>>8);
+
+ local_apic_write(LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_BY_1);
+ local_apic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+ local_apic_write(LAPIC_TIMER_INITIAL_COUNT, 0xffffffff);
+ start = rdtsc();
+
+ /* The local APIC timer stops at 0, which bounds the wait if channel 2 does
+    not count. */
+ while ((0 == (inb(0x61) & 0x20)) &&
+        (0 != local_apic_read(LAPIC_TIMER_CURRENT_COUNT)))
+ {
+ }
+
+ tsc_cycles_per_clock_tick = rdtsc() - start;
+ return 0xffffffff - local_apic_read(LAPIC_TIMER_CURRENT_COUNT);
+}
+
+void
+initialize_interrupt_controller(void)
+{
+ register unsigned int i;
+
+ /* Remap the PICs to vectors 32 to 47, so a stray interrupt is not taken for
+    an exception, and mask all their inputs. */
+ outb(0x20, 0x11);
+ outb(0xA0, 0x11);
+
+ outb(0x21, 0x20);
+ outb(0xA1, 0x28);
+
+ outb(0x21, 1<<2);
+ outb(0xA1, 2);
+
+ outb(0x21, 1);
+ outb(0xA1, 1);
+
+ /* Check if the CPU has a local APIC. The flag is bit 9 of edx in leaf 1. */
+ if (0 == (cpuid_edx(1) & (1<<9)))
+ {
+  /* Let the PIC deliver the interrupts of the programmable interval
+     timer. */
+  outb(0x21, 0xfe);
+  outb(0xA1, 0xff);
+  return;
+ }
+
+ outb(0x21, 0xff);
+ outb(0xA1, 0xff);
+
+ /* Use x2APIC mode if the CPU supports it. The flag is bit 21 of ecx in
+    leaf 1. Otherwise the registers are memory mapped. X2APIC is 0 when the
+    kernel is built to use xAPIC mode. */
+ if (X2APIC && (0 != (cpuid_ecx(1) & (1<<21))))
+ {
+  interrupt_controller = INTERRUPT_CONTROLLER_X2APIC;
+ }
+ else
+ {
+  const unsigned long address = rdmsr(IA32_APIC_BASE) &
+                                APIC_BASE_ADDRESS_MASK;
+
+  map_device_memory(address, PAGE_SIZE);
+  local_apic_registers = (volatile unsigned int*) address;
+  interrupt_controller = INTERRUPT_CONTROLLER_XAPIC;
+ }
+
+ /* Mask all inputs of the IO APIC. Devices are routed with
+    ioapic_route_irq. */
+ parse_madt();
+ if (0 != ioapic_registers)
+ {
+  map_device_memory((unsigned long) ioapic_registers, PAGE_SIZE);
+  ioapic_inputs = ((ioapic_read(IOAPIC_VERSION) >> 16) & 0xff) + 1;
+  for(i=0; i<ioapic_inputs; i++)
+  {
+   ioapic_write_redirection(i, IOAPIC_MASKED);
+  }
+ }
+
+ initialize_local_apic();
+}
+
+void
+initialize_local_apic(void)
+{
+ const int           cpu = cpu_private_data.cpu_index;
+ const unsigned long apic_base = rdmsr(IA32_APIC_BASE) | APIC_BASE_ENABLE;
+
+ interrupt_statistics[cpu].controller = interrupt_controller;
+ if (INTERRUPT_CONTROLLER_PIC == interrupt_controller)
+ {
+  return;
+ }
+
+ /* x2APIC mode can only be entered from an enabled local APIC. */
+ wrmsr(IA32_APIC_BASE, apic_base);
+ if (INTERRUPT_CONTROLLER_X2APIC == interrupt_controller)
+ {
+  wrmsr(IA32_APIC_BASE, apic_base | APIC_BASE_X2APIC);
+  local_apic_ids[cpu] = local_apic_read(LAPIC_ID);
+ }
+ else
+ {
+  local_apic_ids[cpu] = local_apic_read(LAPIC_ID) >> 24;
+ }
+
+ /* Accept all interrupts. LINT0 carries the interrupts of the PIC, which
+    is masked. */
+ local_apic_write(LAPIC_TPR, 0);
+ local_apic_write(LAPIC_LVT_LINT0, LAPIC_LVT_MASKED);
+ local_apic_write(LAPIC_LVT_ERROR, LAPIC_LVT_MASKED);
+ local_apic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | SPURIOUS_INTERRUPT_VECTOR);
+
+ if (0 == local_apic_timer_ticks_per_clock_tick)
+ {
+  local_apic_timer_ticks_per_clock_tick = measure_local_apic_timer();
+  if (local_apic_timer_ticks_per_clock_tick < PIT_TICK_DIVISOR)
+  {
+   while (1)
+   {
+    kprints("Kernel panic! Can not measure the local APIC timer.\n");
+   }
+  }
+ }
+}
+
+void
+start_local_apic_timer(const int interrupts_per_tick)
+{
+ local_apic_write(LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_BY_1);
+ local_apic_write(LAPIC_LVT_TIMER, LAPIC_LVT_TIMER_PERIODIC |
+                                   TIMER_INTERRUPT_VECTOR);
+ local_apic_write(LAPIC_TIMER_INITIAL_COUNT,
+                  local_apic_timer_ticks_per_clock_tick/interrupts_per_tick);
+}
+
+unsigned long
+local_apic_timer_expired_cycles(void)
+{
+ unsigned long ticks;
+
+ if (INTERRUPT_CONTROLLER_PIC == interrupt_controller)
+ {
+  return 0;
+ }
+
+ /* The periodic timer reloads the initial count when it expires. */
+ ticks = local_apic_read(LAPIC_TIMER_INITIAL_COUNT) -
+         local_apic_read(LAPIC_TIMER_CURRENT_COUNT);
+ return (ticks*tsc_cycles_per_clock_tick)/
+        local_apic_timer_ticks_per_clock_tick;
+}
+
+void
+end_of_interrupt(const unsigned long entry_timestamp)
+{
+ struct interrupt_statistics* const statistics =
+  &interrupt_statistics[cpu_private_data.cpu_index];
+ const unsigned long                start = rdtsc();
+ unsigned long                      end;
+
+ switch(interrupt_controller)
+ {
+  case INTERRUPT_CONTROLLER_X2APIC:
+  {
+   wrmsr(X2APIC_MSR_BASE + LAPIC_EOI/16, 0);
+   break;
+  }
+
+  case INTERRUPT_CONTROLLER_XAPIC:
+  {
+   local_apic_registers[LAPIC_EOI/4] = 0;
+   break;
+  }
+
+  default:
+  {
+   outb(0x20, 0x20);
+  }
+ }
+
+ end = rdtsc();
+ statistics->interrupts++;
+ statistics->eoi_cycles += end - start;
+ statistics->entry_to_eoi_cycles += end - entry_timestamp;
+ if (end - entry_timestamp > statistics->max_entry_to_eoi_cycles)
+ {
+  statistics->max_entry_to_eoi_cycles = end - entry_timestamp;
+ }
+}
+
+void
+send_ipi(const int          cpu,
+         const unsigned int vector)
+{
+ /* A wrmsr to the x2APIC registers is not ordered with earlier stores. */
+ __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+ switch(interrupt_controller)
+ {
+  case INTERRUPT_CONTROLLER_X2APIC:
+  {
+   wrmsr(X2APIC_MSR_BASE + LAPIC_ICR_LOW/16,
+         (((unsigned long) local_apic_ids[cpu]) << 32) | vector);
+   break;
+  }
+
+  case INTERRUPT_CONTROLLER_XAPIC:
+  {
+   local_apic_write(LAPIC_ICR_HIGH, local_apic_ids[cpu] << 24);
+   local_apic_write(LAPIC_ICR_LOW, vector);
+   while (0 != (local_apic_read(LAPIC_ICR_LOW) & LAPIC_ICR_PENDING))
+   {
+    __asm volatile("pause");
+   }
+   break;
+  }
+ }
+}
+
+/*! Finds the IO APIC input of an interrupt.
+    \return The input or -1 if the IO APIC does not handle the interrupt. */
+static int
+ioapic_input(const unsigned int irq
+             /*!< The ISA interrupt or the global system interrupt. */,
+             unsigned long*     flags
+             /*!< Receives the polarity and trigger mode bits of the
+                  redirection entry. */)
+{
+ unsigned int interrupt = irq;
+
+ /* Interrupts that are not ISA interrupts are PCI interrupts, which are
+    active low and level triggered. */
+ *flags = IOAPIC_ACTIVE_LOW | IOAPIC_LEVEL_TRIGGERED;
+ if (irq < 16)
+ {
+  /* Bits 0 and 1 of the override give the polarity, bits 2 and 3 the
+     trigger mode. The value 3 means active low respectively level
+     triggered. */
+  interrupt = isa_interrupts[irq].interrupt;
+  *flags = ((3 == (isa_interrupts[irq].flags & 3)) ?
+            IOAPIC_ACTIVE_LOW : 0) |
+           ((3 == ((isa_interrupts[irq].flags >> 2) & 3)) ?
+            IOAPIC_LEVEL_TRIGGERED : 0);
+ }
+
+ if ((0 == ioapic_registers) || (interrupt < ioapic_first_interrupt) ||
+     (interrupt >= ioapic_first_interrupt + ioapic_inputs))
+ {
+  return -1;
+ }
+ return interrupt - ioapic_first_interrupt;
+}
+
+long
+ioapic_route_irq(const unsigned int irq,
+                 const unsigned int vector,
+                 const int          cpu)
+{
+ unsigned long flags;
+ const int     input = ioapic_input(irq, &flags);
+
+ if ((-1 == input) || (vector < 32) || (vector > 0xfe) ||
+     (cpu < 0) || (cpu >= MAX_NUMBER_OF_CPUS) ||
+     (0 == (online_cpus & (1UL << cpu))))
+ {
+  return ERROR;
+ }
+
+ /* Fixed delivery to the local APIC id in bits 56 to 63. */
+ ioapic_write_redirection(input, (((unsigned long) local_apic_ids[cpu]) << 56) |
+                                 flags | vector);
+ return ALL_OK;
+}
+
+void
+ioapic_mask_irq(const unsigned int irq)
+{
+ unsigned long flags;
+ const int     input = ioapic_input(irq, &flags);
+
+ if (-1 != input)
+ {
+  ioapic_write_redirection(input, IOAPIC_MASKED);
+ }
+}
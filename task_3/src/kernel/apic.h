@@ -0,0 +1,160 @@
+/*! \file apic.h
+ * This file defines the interrupt controllers. The local APIC of each CPU
+ * generates the timer interrupts of the CPU and receives the interrupts of
+ * devices from the IO APIC, which routes each of them to a CPU. The local
+ * APIC is run in x2APIC mode when the CPU supports it. Its registers are then
+ * MSRs, so signalling the end of an interrupt is a wrmsr instead of a write
+ * to uncached memory. The legacy 8259 PICs are remapped and masked. A CPU
+ * without a local APIC keeps the PIC and the programmable interval timer.
+ */
+
+#ifndef _APIC_H_
+#define _APIC_H_
+
+#include "kernel.h"
+
+#define IA32_APIC_BASE            (0x01b)
+/*!< The MSR that holds the physical address of the local APIC registers and
+     enables the local APIC. */
+#define APIC_BASE_X2APIC          (1UL<<10)
+/*!< Set in IA32_APIC_BASE to run the local APIC in x2APIC mode. */
+#define APIC_BASE_ENABLE          (1UL<<11)
+/*!< Set in IA32_APIC_BASE to enable the local APIC. */
+#define APIC_BASE_ADDRESS_MASK    (0x000ffffffffff000UL)
+/*!< Masks out the address of the registers from IA32_APIC_BASE. */
+
+#define X2APIC_MSR_BASE           (0x800)
+/*!< In x2APIC mode the register at offset r is the MSR X2APIC_MSR_BASE +
+     r/16. */
+
+/* Offsets of the local APIC registers. */
+#define LAPIC_ID                  (0x020) /*!< The local APIC id. */
+#define LAPIC_TPR                 (0x080) /*!< The task priority. */
+#define LAPIC_EOI                 (0x0b0) /*!< Written to end an interrupt. */
+#define LAPIC_SVR                 (0x0f0) /*!< The spurious interrupt
+                                               vector. Also enables the
+                                               local APIC. */
+#define LAPIC_ICR_LOW             (0x300) /*!< Sends an interrupt to
+                                               another CPU. In x2APIC mode
+                                               it is one 64-bit register
+                                               with the destination in the
+                                               high half. */
+#define LAPIC_ICR_HIGH            (0x310) /*!< The destination of the
+                                               interrupt in bits 24 to 31.
+                                               Only in xAPIC mode. */
+#define LAPIC_LVT_TIMER           (0x320) /*!< The timer interrupt. */
+#define LAPIC_LVT_LINT0           (0x350) /*!< The interrupt at pin LINT0. */
+#define LAPIC_LVT_ERROR           (0x370) /*!< The error interrupt. */
+#define LAPIC_TIMER_INITIAL_COUNT (0x380) /*!< Starts the timer. */
+#define LAPIC_TIMER_CURRENT_COUNT (0x390) /*!< The count of the timer. */
+#define LAPIC_TIMER_DIVIDE        (0x3e0) /*!< Divides the timer clock. */
+
+#define LAPIC_SVR_ENABLE          (1<<8)
+/*!< Set in LAPIC_SVR to enable the local APIC. */
+#define LAPIC_LVT_MASKED          (1<<16)
+/*!< Set in a local vector table register to mask its interrupt. */
+#define LAPIC_LVT_TIMER_PERIODIC  (1<<17)
+/*!< Set in LAPIC_LVT_TIMER to reload the timer when it reaches 0. */
+#define LAPIC_ICR_PENDING         (1<<12)
+/*!< Set in LAPIC_ICR_LOW while the interrupt has not been sent. Only in
+     xAPIC mode. */
+#define LAPIC_TIMER_DIVIDE_BY_1   (0xb)
+/*!< Written to LAPIC_TIMER_DIVIDE to run the timer at the bus clock. */
+
+/* Registers of the IO APIC. */
+#define IOAPIC_VERSION            (0x01)
+/*!< Bits 16 to 23 hold the number of redirection entries minus one. */
+#define IOAPIC_REDIRECTION_TABLE  (0x10)
+/*!< Entry i is the register pair IOAPIC_REDIRECTION_TABLE + 2*i. */
+
+#define IOAPIC_ACTIVE_LOW         (1UL<<13)
+/*!< Set in a redirection entry if the interrupt is active low. */
+#define IOAPIC_LEVEL_TRIGGERED    (1UL<<15)
+/*!< Set in a redirection entry if the interrupt is level triggered. */
+#define IOAPIC_MASKED             (1UL<<16)
+/*!< Set in a redirection entry to mask the interrupt. */
+
+#define TIMER_INTERRUPT_VECTOR    (32)
+/*!< The vector of the timer interrupt. boot64.s installs its handler. */
+
+#define SPURIOUS_INTERRUPT_VECTOR (0xff)
+/*!< The vector of the spurious interrupts of the local APIC. The handler in
+     enter.s returns from them without signalling the end of interrupt. */
+
+/* Variable declarations */
+
+extern int
+interrupt_controller;
+/*!< One of the INTERRUPT_CONTROLLER_ values. Set by
+     initialize_interrupt_controller. */
+
+extern unsigned int
+local_apic_ids[MAX_NUMBER_OF_CPUS];
+/*!< The local APIC id of each CPU. Interrupts are sent to a CPU by its id. */
+
+extern struct interrupt_statistics
+interrupt_statistics[MAX_NUMBER_OF_CPUS];
+/*!< The interrupt statistics of each CPU. */
+
+/* Function declarations */
+
+/*! Masks the PICs, finds the IO APIC through the ACPI tables and masks all
+    its inputs, and sets up the local APIC of the boot CPU. The PIC is left
+    to deliver the timer interrupts if there is no local APIC. The timer is
+    started by set_timer_interrupts_per_tick. Called from initialize. */
+extern void
+initialize_interrupt_controller(void);
+
+/*! Enables the local APIC of the calling CPU and records its id. The first
+    CPU to call it measures the frequency of the local APIC timers against
+    the programmable interval timer. Called once by each CPU. */
+extern void
+initialize_local_apic(void);
+
+/*! Makes the local APIC timer of the calling CPU interrupt periodically. */
+extern void
+start_local_apic_timer(const int interrupts_per_tick
+                       /*!< The number of timer interrupts per clock
+                            tick. */);
+
+/*! \return The time stamp counter cycles since the local APIC timer of the
+    calling CPU last expired, or 0 if the timer interrupts come from the
+    PIC. */
+extern unsigned long
+local_apic_timer_expired_cycles(void);
+
+/*! Signals the end of an interrupt to the interrupt controller of the
+    calling CPU and updates its interrupt statistics. */
+extern void
+end_of_interrupt(const unsigned long entry_timestamp
+                 /*!< The time stamp counter when the handler was
+                      entered. */);
+
+/*! Sends an inter-processor interrupt to another CPU. Stores made before
+    the call are visible to the CPU when it takes the interrupt. Does
+    nothing if there is no local APIC, as then only the boot CPU runs. */
+extern void
+send_ipi(const int          cpu
+         /*!< The index of the CPU. */,
+         const unsigned int vector
+         /*!< The vector of the interrupt. */);
+
+/*! Routes an interrupt of the IO APIC to a CPU. ISA interrupts are
+    translated to global system interrupts as the ACPI tables tell.
+    \return ALL_OK or ERROR if there is no IO APIC or no such interrupt. */
+extern long
+ioapic_route_irq(const unsigned int irq
+                 /*!< The ISA interrupt, 0 to 15, or the global system
+                      interrupt. */,
+                 const unsigned int vector
+                 /*!< The vector the interrupt is delivered on. */,
+                 const int          cpu
+                 /*!< The index of the CPU. */);
+
+/*! Masks an interrupt of the IO APIC. */
+extern void
+ioapic_mask_irq(const unsigned int irq
+                /*!< The ISA interrupt, 0 to 15, or the global system
+                     interrupt. */);
+
+#endif
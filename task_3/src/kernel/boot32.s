@@ -41,6 +41,10 @@ after_multiboot_header:
  cmpl   $0x2BADB002,%eax
  jne    halt_the_machine  # Ouch, no multiboot capable loader
 
+ # Keep the address of the multiboot information structure in esi. The
+ # 64-bit code reads the memory map from it. Note that cpuid overwrites ebx.
+ movl   %ebx,%esi
+
  # Load multiboot flags into eax
  movl   (%ebx),%eax
  # Check if the memory size field is available
@@ -161,7 +165,10 @@ TSS_descriptor:
  # for an explanation of the page translation mechanism.
  .align 4096
 pml4_base:
- .int   pdpe_base+7,0  # We know the lowest 12 bits of the address are zero
+ # We know the lowest 12 bits of the address are zero. The user bit is not
+ # set so the kernel can only be accessed from supervisor mode. Processes
+ # get their own page tables which share this entry.
+ .int   pdpe_base+3,0
  .skip  4096-8
 
 pdpe_base:
@@ -169,65 +176,15 @@ pdpe_base:
  .skip  4096-8
 
 pde_base:
- .int   pte_page_0+7,0
- .int   pte_page_1+7,0
- .int   pte_page_2+7,0
- .int   pte_page_3+7,0
- .int   pte_page_4+7,0
- .int   pte_page_5+7,0
- .int   pte_page_6+7,0
- .int   pte_page_7+7,0
- .int   pte_page_8+7,0
- .int   pte_page_9+7,0
- .int   pte_page_10+7,0
- .int   pte_page_11+7,0
- .int   pte_page_12+7,0
- .int   pte_page_13+7,0
- .int   pte_page_14+7,0
- .int   pte_page_15+7,0
- .skip  4096-8*16
-
+ # The first gigabyte is mapped with 2 Mbyte pages. This uses one page
+ # directory instead of a page table for each 2 Mbyte and leaves the TLB
+ # with far fewer entries to cache. The kernel replaces this page table with
+ # one that covers all of the memory once it runs in 64-bit mode.
  .set   curr_address,0
-
- .macro generate_pte
  .rept  512
- .int   curr_address+7,0
- .set   curr_address,curr_address+4096
+ .int   curr_address+0x83,0 # Present, writable and a 2 Mbyte page
+ .set   curr_address,curr_address+0x200000
  .endr
- .endm
-
-pte_page_0:
- generate_pte
-pte_page_1:
- generate_pte
-pte_page_2:
- generate_pte
-pte_page_3:
- generate_pte
-pte_page_4:
- generate_pte
-pte_page_5:
- generate_pte
-pte_page_6:
- generate_pte
-pte_page_7:
- generate_pte
-pte_page_8:
- generate_pte
-pte_page_9:
- generate_pte
-pte_page_10:
- generate_pte
-pte_page_11:
- generate_pte
-pte_page_12:
- generate_pte
-pte_page_13:
- generate_pte
-pte_page_14:
- generate_pte
-pte_page_15:
- generate_pte
 
  .bss
  # This is a small temporary stack that we use when checking for the CPUID
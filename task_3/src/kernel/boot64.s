@@ -11,6 +11,9 @@ _start:
  # Save addresses carried over from the 32-bit kernel
  mov    %rbx,cpu_private_data+8
  mov    %rdx,%r15
+ # The address of the multiboot information structure is kept in r14 until
+ # the bss segment, where it is stored, has been cleared.
+ mov    %esi,%r14d
 
  # We can now set the kernel stack
  mov    $stack,%rsp
@@ -94,10 +97,11 @@ interrupt_setup_loop:
  dec    %rdx
  jnz    interrupt_setup_loop
 
- # Write the address of the timer interrupt handler into the interrupt handler
- # table
- mov    $timer_interrupt,%rax
- mov    $IDT+16*32,%rbp
+ # Write the addresses of the interrupt handlers we use into the interrupt
+ # handler table.
+ .macro set_interrupt_handler handler, vector
+ mov    $\handler,%rax
+ mov    $IDT+16*\vector,%rbp
  mov    %eax,%ebx
  and    $0xffff,%ebx
  or     $24*0x10000,%ebx
@@ -108,6 +112,14 @@ interrupt_setup_loop:
  mov    %ebx,4(%rbp)
  shr    $32,%rax
  mov    %eax,8(%rbp)
+ .endm
+
+ set_interrupt_handler page_fault_interrupt, 14
+ set_interrupt_handler timer_interrupt, 32
+ # The vectors of the inter-processor interrupts are defined in ipi.h.
+ set_interrupt_handler reschedule_interrupt, 0xfb
+ set_interrupt_handler call_function_interrupt, 0xfc
+ set_interrupt_handler tlb_shootdown_interrupt, 0xfd
 
  # Force the CPU to use the new TSS
  mov    $40,%eax
@@ -154,14 +166,6 @@ interrupt_setup_loop:
  mov    $0x00000300,%eax
  wrmsr
 
- # Set the ELF_images_start variable to the start of the linked list of
- # executable images
- movq   $start_of_ELF_images,ELF_images_start
-
- # Set the ELF_images_end variable to the end of the linked list of
- # executable images
- movq   $end_of_ELF_images,ELF_images_end
-
  # Set the first_available_memory_byte variable to the address of the first
  # available memory byte. The address is rounded of to the nearest higher
  # address which is evenly dividable with 4096.
@@ -170,10 +174,9 @@ interrupt_setup_loop:
  and    $-4096,%rax
  mov    %rax,first_available_memory_byte
 
- # Set the highest available memory address. For now this is just a hack.
- # The memory management code will be improved in later tasks.
- mov	$(32768-1024-64)*1024,%rax
- mov    %rax,memory_size
+ # Pass on the address of the multiboot information structure. The C code
+ # reads the memory map from it and sets memory_size.
+ mov    %r14,multiboot_information
 
  # We can now switch to c!
  call   initialize
@@ -187,5 +190,13 @@ cpu_private_data:
  .quad  0
  .int   -1
  .int   1
+ .quad  0
+ .quad  0
+ .int   0
+ .int   0
+ .quad  0
+ .int   0
+ .int   0
+ .quad  0
 	
 	
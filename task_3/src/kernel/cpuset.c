@@ -0,0 +1,290 @@
+/*! \file cpuset.c
+ * This file implements CPU affinity and cpusets.
+ */
+
+#include "cpuset.h"
+
+/* Note: Look in cpuset.h for documentation of global variables and
+   functions. */
+
+/* Variables */
+
+struct cpuset
+cpuset_table[MAX_NUMBER_OF_CPUSETS] = {{0, 0, "root"}};
+
+/*! The CPUs reserved by cpusets other than the root cpuset. */
+static unsigned long
+reserved_cpus = 0;
+
+/*! Protects cpuset_table, reserved_cpus, the cpuset of the processes and
+    the affinity and allowed_cpus of the threads. */
+static struct ticket_lock
+cpuset_lock;
+
+/* Functions */
+
+void
+initialize_cpusets(void)
+{
+ ticket_lock_init(&cpuset_lock, "cpusets");
+}
+
+unsigned long
+cpuset_cpus(const int cpuset)
+{
+ if (0 == cpuset)
+ {
+  return online_cpus & ~reserved_cpus;
+ }
+ return cpuset_table[cpuset].cpus & online_cpus;
+}
+
+/*! Does the work of update_allowed_cpus. cpuset_lock has to be held. */
+static void
+update_allowed_cpus_locked(const int thread_index
+                           /*!< The index, into thread_table, of the
+                                thread. */)
+{
+ const unsigned long cpus =
+  cpuset_cpus(process_table[thread_scheduling_table[thread_index].owner]->
+              cpuset);
+ const unsigned long allowed_cpus =
+  thread_table[thread_index]->data.affinity & cpus;
+
+ thread_scheduling_table[thread_index].allowed_cpus =
+  (0 != allowed_cpus) ? allowed_cpus : cpus;
+}
+
+void
+update_allowed_cpus(const int thread_index)
+{
+ ticket_lock_acquire(&cpuset_lock);
+ update_allowed_cpus_locked(thread_index);
+ ticket_lock_release(&cpuset_lock);
+}
+
+/*! Updates the CPUs all threads of a process, or of all processes, may run
+    on. cpuset_lock has to be held. */
+static void
+update_threads(const int process
+               /*!< The index, into process_table, of the process. -1 for
+                    all processes. */)
+{
+ register int i;
+
+ ticket_lock_acquire(&thread_table_lock);
+ for(i=0; i<thread_table_size; i++)
+ {
+  if ((0 != thread_table[i]) &&
+      (-1 != thread_scheduling_table[i].owner) &&
+      ((-1 == process) || (process == thread_scheduling_table[i].owner)))
+  {
+   update_allowed_cpus_locked(i);
+  }
+ }
+ ticket_lock_release(&thread_table_lock);
+}
+
+/*! Does the work of cpuset_move_process. cpuset_lock has to be held. */
+static void
+move_process_locked(const int process
+                    /*!< The index, into process_table, of the process. */,
+                    const int cpuset
+                    /*!< Index, into cpuset_table, of the cpuset. */)
+{
+ struct process* const process_ptr = process_table[process];
+
+ if (0 != process_ptr->cpuset)
+ {
+  cpuset_table[process_ptr->cpuset].processes--;
+ }
+ if (0 != cpuset)
+ {
+  cpuset_table[cpuset].processes++;
+ }
+ process_ptr->cpuset = cpuset;
+
+ /* A process that is being created or has terminated has no threads. */
+ if (0 < process_ptr->threads)
+ {
+  update_threads(process);
+ }
+}
+
+void
+cpuset_move_process(const int process,
+                    const int cpuset)
+{
+ ticket_lock_acquire(&cpuset_lock);
+ move_process_locked(process, cpuset);
+ ticket_lock_release(&cpuset_lock);
+}
+
+long
+set_thread_affinity(const int           thread_index,
+                    const unsigned long mask)
+{
+ const int owner = thread_scheduling_table[thread_index].owner;
+
+ ticket_lock_acquire(&cpuset_lock);
+ if (0 == (mask & cpuset_cpus(process_table[owner]->cpuset)))
+ {
+  ticket_lock_release(&cpuset_lock);
+  return ERROR;
+ }
+
+ thread_table[thread_index]->data.affinity = mask;
+ update_allowed_cpus_locked(thread_index);
+ ticket_lock_release(&cpuset_lock);
+ return ALL_OK;
+}
+
+/*! Copies the name of a cpuset from user space. No lock may be held since
+    reading user memory can fault.
+    \return ALL_OK or ERROR if the name is empty, too long or not in user
+            space. */
+static long
+copy_name(char* const       destination
+          /*!< Receives the name. Has room for CPUSET_NAME_SIZE bytes. */,
+          const char* const name
+          /*!< The name in the user space of the calling process. */)
+{
+ register int i;
+
+ for(i=0; i<CPUSET_NAME_SIZE; i++)
+ {
+  if (!is_user_range(&name[i], 1))
+  {
+   return ERROR;
+  }
+  destination[i] = name[i];
+  if (0 == destination[i])
+  {
+   return (0 == i) ? ERROR : ALL_OK;
+  }
+ }
+ return ERROR;
+}
+
+/*! \return The index, into cpuset_table, of the cpuset with a name or -1 if
+    there is none. cpuset_lock has to be held. */
+static int
+find_cpuset(const char* const name
+            /*!< The 0 terminated name. Not empty. */)
+{
+ register int i;
+
+ for(i=0; i<MAX_NUMBER_OF_CPUSETS; i++)
+ {
+  register int j = 0;
+
+  while ((name[j] == cpuset_table[i].name[j]) && (0 != name[j]))
+  {
+   j++;
+  }
+  if (name[j] == cpuset_table[i].name[j])
+  {
+   return i;
+  }
+ }
+ return -1;
+}
+
+long
+cpuset_command(const unsigned long command,
+               const char* const   name,
+               const long          argument)
+{
+ char         kernel_name[CPUSET_NAME_SIZE];
+ long         return_value = ERROR;
+ register int cpuset;
+
+ if (ALL_OK != copy_name(kernel_name, name))
+ {
+  return ERROR;
+ }
+
+ if (CPUSET_ATTACH == command)
+ {
+  ticket_lock_acquire(&process_table_lock);
+ }
+ ticket_lock_acquire(&cpuset_lock);
+ cpuset = find_cpuset(kernel_name);
+
+ switch(command)
+ {
+  case CPUSET_CREATE:
+  {
+   const unsigned long cpus = argument;
+   register int        i;
+   register int        j;
+
+   /* The root cpuset must keep the boot CPU. */
+   if ((-1 != cpuset) || (0 == cpus) || (cpus != (cpus & online_cpus)) ||
+       (0 != (cpus & (reserved_cpus | (1UL << BOOT_CPU)))))
+   {
+    break;
+   }
+
+   for(i=1; i<MAX_NUMBER_OF_CPUSETS; i++)
+   {
+    if (0 == cpuset_table[i].name[0])
+    {
+     cpuset_table[i].cpus = cpus;
+     cpuset_table[i].processes = 0;
+     for(j=0; j<CPUSET_NAME_SIZE; j++)
+     {
+      cpuset_table[i].name[j] = kernel_name[j];
+     }
+     reserved_cpus |= cpus;
+
+     /* The CPUs are taken from the root cpuset. */
+     update_threads(-1);
+     return_value = ALL_OK;
+     break;
+    }
+   }
+   break;
+  }
+
+  case CPUSET_ATTACH:
+  {
+   const long process = (-1 == argument) ?
+    thread_scheduling_table[cpu_private_data.thread_index].owner : argument;
+
+   if ((-1 == cpuset) || (process < 0) || (process >= process_table_size) ||
+       (0 == process_table[process]))
+   {
+    break;
+   }
+
+   move_process_locked(process, cpuset);
+   return_value = ALL_OK;
+   break;
+  }
+
+  case CPUSET_DESTROY:
+  {
+   if ((cpuset < 1) || (0 != cpuset_table[cpuset].processes))
+   {
+    break;
+   }
+
+   reserved_cpus &= ~cpuset_table[cpuset].cpus;
+   cpuset_table[cpuset].cpus = 0;
+   cpuset_table[cpuset].name[0] = 0;
+
+   /* The CPUs return to the root cpuset. */
+   update_threads(-1);
+   return_value = ALL_OK;
+   break;
+  }
+ }
+
+ ticket_lock_release(&cpuset_lock);
+ if (CPUSET_ATTACH == command)
+ {
+  ticket_lock_release(&process_table_lock);
+ }
+ return return_value;
+}
@@ -0,0 +1,93 @@
+/*! \file cpuset.h
+ * This file defines CPU affinity and cpusets. A thread runs only on the
+ * CPUs that are both in its affinity mask and in the cpuset of its process.
+ * The CPUs a cpuset holds are reserved for its processes. The CPUs that are
+ * not reserved form the root cpuset, which all processes start in. The
+ * scheduler only looks at allowed_cpus in thread_scheduling_table, which
+ * update_allowed_cpus keeps up to date.
+ */
+
+#ifndef _CPUSET_H_
+#define _CPUSET_H_
+
+#include "kernel.h"
+#include "lock.h"
+
+#define MAX_NUMBER_OF_CPUSETS (8)
+/*!< Size of the cpuset_table, the root cpuset included. */
+
+#define BOOT_CPU              (0)
+/*!< The index of the CPU that boots the kernel. It services the interrupts
+     and is never reserved by a cpuset. */
+
+/*! Defines a cpuset. */
+struct cpuset
+{
+ unsigned long cpus;             /*!< Bit i is set iff CPU i is reserved by
+                                      the cpuset. Not used for the root
+                                      cpuset, which holds the online CPUs
+                                      that are not reserved. */
+ int           processes;        /*!< The number of processes attached.
+                                      Not counted for the root cpuset. */
+ char          name[CPUSET_NAME_SIZE];
+                                 /*!< The 0 terminated name. Empty if the
+                                      entry is unused. */
+};
+
+/* Variable declarations */
+
+extern struct cpuset
+cpuset_table[MAX_NUMBER_OF_CPUSETS];
+/*!< Array holding all cpusets. Entry 0 is the root cpuset. */
+
+/* Function declarations */
+
+/*! Initializes the cpuset lock. Called from initialize. */
+extern void
+initialize_cpusets(void);
+
+/*! \return The CPUs of a cpuset that are online. Never 0. Read without
+    the cpuset lock, so the result may be stale when it is used. */
+extern unsigned long
+cpuset_cpus(const int cpuset
+            /*!< Index, into cpuset_table, of the cpuset. */);
+
+/*! Recomputes the CPUs a thread may run on from its affinity and the
+    cpuset of its owner. If they have no CPU in common the thread may run on
+    all CPUs of the cpuset. The owner has to be set. Takes the cpuset
+    lock. */
+extern void
+update_allowed_cpus(const int thread_index
+                    /*!< The index, into thread_table, of the thread. */);
+
+/*! Moves a process to a cpuset and updates the CPUs its threads may run
+    on. Also used to attach new processes and to detach terminating ones
+    by moving them to the root cpuset. */
+extern void
+cpuset_move_process(const int process
+                    /*!< The index, into process_table, of the process. */,
+                    const int cpuset
+                    /*!< Index, into cpuset_table, of the cpuset. */);
+
+/*! Implements the setaffinity system call.
+    \return ALL_OK or ERROR if the mask has no CPU of the cpuset of the
+            thread. */
+extern long
+set_thread_affinity(const int           thread_index
+                    /*!< The index, into thread_table, of the thread. */,
+                    const unsigned long mask
+                    /*!< Bit i allows CPU i. */);
+
+/*! Implements the cpuset system call.
+    \return ALL_OK or ERROR if the command fails. */
+extern long
+cpuset_command(const unsigned long command
+               /*!< One of the CPUSET_ values. */,
+               const char* const   name
+               /*!< The name of the cpuset in the user space of the calling
+                    process. */,
+               const long          argument
+               /*!< The CPUs to reserve or the index of the process to
+                    attach. */);
+
+#endif
@@ -0,0 +1,337 @@
+/*! \file elf.c
+ * This file implements the validation of executable ELF images.
+ */
+
+#include "elf.h"
+
+/* Note: Look in elf.h for documentation of global variables and
+   functions. */
+
+/* Function definitions */
+
+/*! Finds the file bytes that hold a range of addresses.
+    \return The offset, in the ELF image, of the first byte of the range or
+    -1 if the range is not entirely in the file part of a segment. */
+static long
+file_offset_of(const struct executable* const executable
+               /*!< The description of the loadable segments. */,
+               const unsigned long            address
+               /*!< The address of the first byte. */,
+               const unsigned long            size
+               /*!< The size, in bytes, of the range. */)
+{
+ register int i;
+
+ for(i=0; i<executable->number_of_segments; i++)
+ {
+  const struct executable_segment* const segment = &executable->segments[i];
+
+  if ((address >= segment->address) &&
+      (size <= segment->file_size) &&
+      (address - segment->address <= segment->file_size - size))
+  {
+   return segment->offset + (address - segment->address);
+  }
+ }
+
+ return -1;
+}
+
+/*! Finds the relocations through the dynamic section and checks that the
+    kernel can apply them. \return 0 if they are valid, otherwise a message
+    telling what is wrong with them. */
+static const char*
+describe_relocations(const struct Elf64_Ehdr* const image
+                     /*!< The start of the ELF image. */,
+                     const struct Elf64_Phdr* const dynamic
+                     /*!< The PT_DYNAMIC program header. */,
+                     struct executable* const       executable
+                     /*!< The description to fill in. The loadable segments
+                          have to be described. */)
+{
+ const struct Elf64_Dyn* entry = (const struct Elf64_Dyn*)
+                                 (((const char*) image) + dynamic->p_offset);
+ const struct Elf64_Rela* relocation;
+ unsigned long           number_of_entries =
+  dynamic->p_filesz/sizeof(struct Elf64_Dyn);
+ unsigned long           address = 0;
+ unsigned long           size = 0;
+ unsigned long           entry_size = sizeof(struct Elf64_Rela);
+ long                    offset;
+ unsigned long           i;
+
+ for(; (number_of_entries > 0) && (DT_NULL != entry->d_tag);
+     number_of_entries--, entry++)
+ {
+  switch(entry->d_tag)
+  {
+   case DT_RELA:    address = entry->d_val; break;
+   case DT_RELASZ:  size = entry->d_val; break;
+   case DT_RELAENT: entry_size = entry->d_val; break;
+
+   /* There is nobody to resolve symbols, so only the relocations with
+      addends are supported. */
+   case DT_REL:
+   case DT_JMPREL:
+    return "Unsupported relocation.";
+  }
+ }
+
+ if (0 == size)
+ {
+  return 0;
+ }
+
+ if ((!executable->position_independent) ||
+     (entry_size != sizeof(struct Elf64_Rela)) ||
+     (0 != (size % sizeof(struct Elf64_Rela))) ||
+     (0 != (address & 7)) ||
+     (-1 == (offset = file_offset_of(executable, address, size))))
+ {
+  return "Corrupt relocations.";
+ }
+
+ executable->relocations = offset;
+ executable->number_of_relocations = size/sizeof(struct Elf64_Rela);
+
+ /* The page fault handler relocates a page when it is filled. It looks up
+    the relocations of the page with a binary search so they have to be
+    sorted, which the linker does for relative relocations. The relocated
+    words also have to be in the image. */
+ relocation = (const struct Elf64_Rela*) (((const char*) image) + offset);
+ for(i=0; i<executable->number_of_relocations; i++)
+ {
+  if ((R_X86_64_RELATIVE != ELF64_R_TYPE(relocation[i].r_info)) &&
+      (R_X86_64_NONE != ELF64_R_TYPE(relocation[i].r_info)))
+  {
+   return "Unsupported relocation.";
+  }
+
+  if ((executable->memory_footprint_size < 8) ||
+      (relocation[i].r_offset > executable->memory_footprint_size - 8) ||
+      ((i > 0) && (relocation[i].r_offset < relocation[i-1].r_offset)))
+  {
+   return "Corrupt relocations.";
+  }
+ }
+
+ return 0;
+}
+
+const char*
+elf_describe_executable(const struct Elf64_Ehdr* const image,
+                        const unsigned long            image_size,
+                        struct executable* const       executable)
+{
+ const struct Elf64_Phdr* program_header;
+ const struct Elf64_Phdr* dynamic = 0;
+ int                      program_header_index;
+ int                      entry_point_is_executable = 0;
+
+ /* Check that the image is an ELF image and that it is of the right type. */
+ if ((image_size < sizeof(struct Elf64_Ehdr)) ||
+     /* EI_MAG0 - EI_MAG3 have to be 0x7f 'E' 'L' 'F'. */
+     (image->e_ident[EI_MAG0] != 0x7f) ||
+     (image->e_ident[EI_MAG1] != 'E') ||
+     (image->e_ident[EI_MAG2] != 'L') ||
+     (image->e_ident[EI_MAG3] != 'F') ||
+     /* Check that the image is a 64-bit image. */
+     (image->e_ident[EI_CLASS] != 2) ||
+     /* Check that the image is a little endian image. */
+     (image->e_ident[EI_DATA] != 1) ||
+     /* And that the version of the image format is correct. */
+     (image->e_ident[EI_VERSION] != 1) ||
+     /* NB: We do not check the ABI or ABI version. We really should
+        but currently those fields are not set properly by the build
+        tools. They are both set to zero which means: System V ABI,
+        third edition. However, the ABI used is clearly not System V :-) */
+
+     /* Check that the image is executable. Position independent
+        executables are linked with -static -pie. */
+     ((image->e_type != ET_EXEC) && (image->e_type != ET_DYN)) ||
+     /* Check that the image is executable on AMD64. */
+     (image->e_machine != 0x3e) ||
+     /* Check that the object format is correct. */
+     (image->e_version != 1) ||
+     /* Check that the processor dependent flags are all reset. */
+     (image->e_flags != 0) ||
+     /* Check that the length of the header is what we expect. */
+     (image->e_ehsize != sizeof(struct Elf64_Ehdr)) ||
+     /* Check that the size of the program header table entry is what
+        we expect. */
+     (image->e_phentsize != sizeof(struct Elf64_Phdr)) ||
+     /* Check that the number of entries is reasonable. */
+     (image->e_phnum < 0) ||
+     /* The entry point is checked against the segments below. */
+     (image->e_entry < 0) ||
+     /* Finally, check that the program header table is within the image. */
+     (image->e_phoff < 0) ||
+     (image->e_phoff > image_size) ||
+     ((image->e_phoff + image->e_phnum * sizeof(struct Elf64_Phdr)) >
+      image_size))
+ {
+  return "Corrupt executable image.";
+ }
+
+ executable->elf_image = image;
+ executable->memory_footprint_size = 0;
+ executable->entry_point = image->e_entry;
+ executable->relocations = 0;
+ executable->number_of_relocations = 0;
+ executable->position_independent = (image->e_type == ET_DYN);
+ executable->number_of_segments = 0;
+
+ /* Now check the program header table. */
+ program_header = (const struct Elf64_Phdr*)
+                  (((const char*) image) + image->e_phoff);
+
+ for (program_header_index = 0;
+      program_header_index < image->e_phnum;
+      program_header_index++)
+ {
+  const struct Elf64_Phdr* const header =
+   &program_header[program_header_index];
+  struct executable_segment*     segment;
+
+  /* Check that the segment is a type we can handle. Notes and the hints
+     about the stack and relro are ignored. Everything is loaded, and
+     relocated, by the kernel so there can be no dynamic linker. */
+  if ((header->p_type == PT_DYNAMIC) &&
+      (0 == dynamic) &&
+      (header->p_offset >= 0) &&
+      (header->p_filesz >= 0) &&
+      (header->p_offset + header->p_filesz <= image_size) &&
+      (0 == (header->p_offset & 7)))
+  {
+   dynamic = header;
+   continue;
+  }
+
+  if ((header->p_type != PT_NULL) &&
+      (header->p_type != PT_LOAD) &&
+      (header->p_type != PT_PHDR) &&
+      (header->p_type != PT_NOTE) &&
+      (header->p_type != PT_GNU_STACK) &&
+      (header->p_type != PT_GNU_RELRO))
+  {
+   return "Corrupt segment.";
+  }
+
+  if (header->p_type != PT_LOAD)
+  {
+   continue;
+  }
+
+  /* Look more carefully into loadable segments. */
+  if (/* Check if any flags that we can not handle is set. */
+      ((header->p_flags & ~7) != 0) ||
+      /* Check if sizes and offsets look sane. */
+      (header->p_offset < 0) ||
+      (header->p_vaddr < 0) ||
+      (header->p_filesz < 0) ||
+      (header->p_memsz < 0) ||
+      (header->p_filesz > header->p_memsz) ||
+      /* Check if the segment goes beyond the image. */
+      ((header->p_offset + header->p_filesz) > image_size) ||
+      /* Check that the end address does not wrap around. */
+      ((unsigned long) header->p_vaddr + (unsigned long) header->p_memsz <
+       (unsigned long) header->p_vaddr) ||
+      /* The alignment has to be a power of two and the segment has to be
+         placed so that its bytes keep their offsets within aligned
+         blocks. */
+      ((header->p_align > 1) &&
+       ((0 != (header->p_align & (header->p_align - 1))) ||
+        (0 != ((header->p_vaddr - header->p_offset) &
+               (header->p_align - 1))))))
+  {
+   return "Corrupt segment.";
+  }
+
+  if (executable->number_of_segments == MAX_NUMBER_OF_SEGMENTS)
+  {
+   return "Executable image has too many segments.";
+  }
+
+  /* The segments have to be sorted on address and may not overlap. They
+     may share pages and there may be gaps between them. */
+  if (header->p_vaddr < executable->memory_footprint_size)
+  {
+   return "Executable image has illegal memory layout.";
+  }
+
+  segment = &executable->segments[executable->number_of_segments++];
+  segment->offset = header->p_offset;
+  segment->address = header->p_vaddr;
+  segment->file_size = header->p_filesz;
+  segment->memory_size = header->p_memsz;
+  segment->flags = header->p_flags;
+
+  if ((header->p_flags & PF_X) &&
+      (image->e_entry >= header->p_vaddr) &&
+      (image->e_entry < header->p_vaddr + header->p_memsz))
+  {
+   entry_point_is_executable = 1;
+  }
+
+  executable->memory_footprint_size = header->p_vaddr + header->p_memsz;
+ }
+
+ if (0 == executable->memory_footprint_size)
+ {
+  return "Executable image has no loadable segments.";
+ }
+
+ if (!entry_point_is_executable)
+ {
+  return "Corrupt executable image.";
+ }
+
+ if (0 != dynamic)
+ {
+  return describe_relocations(image, dynamic, executable);
+ }
+
+ return 0;
+}
+
+/*! Adds 8 byte words to an FNV-1a style checksum. \return The new
+    checksum. */
+static unsigned long
+checksum_words(unsigned long             checksum
+               /*!< The checksum so far. */,
+               const void* const         data
+               /*!< The words to add. Must be 8 byte aligned. */,
+               const unsigned long       size
+               /*!< The number of words to add. */)
+{
+ const unsigned long* word = (const unsigned long*) data;
+ unsigned long        i;
+
+ for(i=0; i<size; i++)
+ {
+  checksum ^= word[i];
+  checksum *= 0x100000001b3UL;
+ }
+ return checksum;
+}
+
+unsigned long
+elf_checksum(unsigned long                  checksum,
+             const struct executable* const executable)
+{
+ const unsigned long number_of_segments = executable->number_of_segments;
+ const unsigned long position_independent =
+  executable->position_independent;
+
+ checksum = checksum_words(checksum, &executable->memory_footprint_size, 1);
+ checksum = checksum_words(checksum, &executable->entry_point, 1);
+ checksum = checksum_words(checksum, &executable->relocations, 1);
+ checksum = checksum_words(checksum, &executable->number_of_relocations, 1);
+ checksum = checksum_words(checksum, &position_independent, 1);
+ checksum = checksum_words(checksum, &number_of_segments, 1);
+ checksum = checksum_words(checksum, executable->segments,
+                           number_of_segments*
+                           sizeof(struct executable_segment)/8);
+ return checksum_words(checksum, executable->elf_image,
+                       sizeof(struct Elf64_Ehdr)/8);
+}
@@ -0,0 +1,41 @@
+/*! \file elf.h
+ * This file defines the validation of executable ELF images. The code is
+ * shared by the kernel and by the build tool that makes executable_table, so
+ * it must not use anything but the declarations in kernel.h.
+ */
+
+#ifndef _ELF_H_
+#define _ELF_H_
+
+#include "kernel.h"
+
+#define ELF_CHECKSUM_START (0xcbf29ce484222325UL)
+/*!< The checksum of an empty executable table. */
+
+/* Function declarations */
+
+/*! Checks that an ELF image is an executable the kernel can load and
+    describes it. The image is either linked for its addresses or a static
+    position independent executable whose only relocations are relative.
+    The elf_image member of the description is set to image.
+    \return 0 if the image is valid, otherwise a message telling what is
+    wrong with it. */
+extern const char*
+elf_describe_executable(const struct Elf64_Ehdr* const image
+                        /*!< The start of the ELF image. */,
+                        const unsigned long            image_size
+                        /*!< The size, in bytes, of the ELF image. */,
+                        struct executable* const       executable
+                        /*!< The description to fill in. */);
+
+/*! Adds an executable to a checksum. The checksum covers the description
+    and the ELF file header it was made from, but not the address of the
+    image. \return The new checksum. */
+extern unsigned long
+elf_checksum(unsigned long                  checksum
+             /*!< The checksum of the previous executables.
+                  ELF_CHECKSUM_START for the first one. */,
+             const struct executable* const executable
+             /*!< The executable to add. */);
+
+#endif
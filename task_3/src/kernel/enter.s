@@ -5,6 +5,10 @@
 .global syscall_dummy_target
 .global dummy_interrupt
 .global timer_interrupt
+.global reschedule_interrupt
+.global call_function_interrupt
+.global tlb_shootdown_interrupt
+.global page_fault_interrupt
 .global IDT
 .global TSS
 .global stack
@@ -28,17 +32,10 @@ syscall_target:
  mov    %eax,%es
  mov    %eax,%fs
 
- # Get the index to the thread that should be run
- mov    %gs:16,%eax
- # mask off everything except the lowest 8 bits
- and    $255,%rax
- # The size of a thread structure is 1024 bytes. We multiply the index with
- # 1024 to get an offset into the thread_table. Multiplying with 1024 is the
- # same as shifting left 10 bits.
- shl    $10,%rax
- # Add the address of thread_table to get the address of the thread structure.
- # We also add 0x200 to get an address to the integer registers.
- add    $thread_table+0x200,%rax
+ # Get the address of the running thread. We add 0x200 to get an address
+ # to the integer registers.
+ mov    %gs:32,%rax
+ add    $0x200,%rax
 
  # Save most registers
  mov    %rbx,1*8(%rax)
@@ -82,26 +79,31 @@ return_to_user_mode:
  jns    no_idle
 
  # The idle thread:
- swapgs
- sti    # Enable interrupts
- hlt    # Wait for something to happen
- cli    # Disable interrupts
- swapgs
+ # The C code waits for an interrupt or for another CPU to make a thread
+ # ready. Nothing on the stack is needed. Start from the top of the stack
+ # since an interrupt that ends the wait may not return to the C code.
+ mov    $stack,%rsp
+ call   idle_wait
 	
  # Jump back and re-check the ready queue head to see if there are any ready
  # threads that can be run.
  jmp    return_to_user_mode
 
 no_idle:
- # mask off everything except the lowest 8 bits
- and    $255,%rax
- # The size of a thread structure is 1024 bytes. We multiply the index with
- # 1024 to get an offset into the thread_table. Multiplying with 1024 is the
- # same as shifting left 10 bits.
- shl    $10,%rax
- # Add the address of thread_table to get the address of the thread structure.
- # We also add 0x200 to get an address to the integer registers.
- add    $thread_table+0x200,%rax
+ # Load the page table of the process that owns the thread. The load is
+ # skipped if the thread shares address space with the previous thread.
+ call   switch_page_table
+ # The C code may have overwritten rax so get the index again.
+ movslq %gs:16,%rax
+ # The thread_table holds 8 byte pointers to the thread structures. Look up
+ # the thread and remember it as the running thread so that the entry paths
+ # can find it without the table.
+ shl    $3,%rax
+ add    thread_table,%rax
+ mov    (%rax),%rax
+ mov    %rax,%gs:32
+ # We add 0x200 to get an address to the integer registers.
+ add    $0x200,%rax
 
  # Restore the FPU state
  fxrstor -512(%rax)
@@ -206,8 +208,13 @@ dummy_interrupt:
  push   %rax
  push   %rdx
 
- # Check for spurious interrupt
+ # Spurious interrupts of the local APIC, SPURIOUS_INTERRUPT_VECTOR in
+ # apic.h, must not be acknowledged.
  mov    16(%rsp),%rax
+ cmp    $0xff,%rax
+ jz     spurious_return
+
+ # Check for spurious interrupt
  cmp    $0x27,%rax
  jnz    debugger
 
@@ -220,6 +227,7 @@ dummy_interrupt:
  mov    %rdx,%rax
  out    %al,(%dx)
 
+spurious_return:
  pop    %rdx
  pop    %rax
  add    $8,%rsp
@@ -235,6 +243,121 @@ debugger:
  jmp    debugger
 
 
+ # Interrupt handler for page faults. The C code installs the missing page
+ # and the faulting instruction is restarted. Page faults are taken both from
+ # user mode and from the kernel when it touches process memory, e.g., the
+ # string passed to prints. The context is kept on the stack. A system call
+ # that touches process memory that can not be mapped returns ERROR.
+page_fault_interrupt:
+ push   %rax
+ push   %rcx
+ push   %rdx
+ push   %rsi
+ push   %rdi
+ push   %r8
+ push   %r9
+ push   %r10
+ push   %r11
+ push   %rbp
+
+ # Save the FPU state in a 16 byte aligned area on the stack. The C code may
+ # use the SSE registers.
+ mov    %rsp,%rbp
+ sub    $512,%rsp
+ and    $-16,%rsp
+ fxsave (%rsp)
+
+ # Pass the faulting address and the error code to the C code
+ mov    %cr2,%rdi
+ mov    10*8(%rbp),%rsi
+ call   page_fault_handler
+ test   %eax,%eax
+ jnz    page_fault_resolved
+
+ # A fault from user mode that could not be resolved is a bug. So is a fault
+ # from the kernel unless a system call touched a bad user address. Go into
+ # the debugger.
+ testb  $3,12*8(%rbp)
+ jnz    debugger
+ mov    %cr2,%rdi
+ call   system_call_faulted
+ test   %eax,%eax
+ jz     debugger
+
+ # Abandon the system call. Its frames on the kernel stack are discarded.
+ mov    $stack,%rsp
+ call   abort_system_call
+ jmp    return_to_user_mode
+
+page_fault_resolved:
+ fxrstor (%rsp)
+ mov    %rbp,%rsp
+ pop    %rbp
+ pop    %r11
+ pop    %r10
+ pop    %r9
+ pop    %r8
+ pop    %rdi
+ pop    %rsi
+ pop    %rdx
+ pop    %rcx
+ pop    %rax
+ # Remove the error code and restart the faulting instruction
+ add    $8,%rsp
+ iretq
+
+ # Interrupt handlers for the inter-processor interrupts that do not switch
+ # thread. They save the registers the C code may overwrite, like the page
+ # fault handler, and return to the interrupted code.
+ .macro ipi_interrupt name, handler
+\name:
+ push   %rax
+ push   %rcx
+ push   %rdx
+ push   %rsi
+ push   %rdi
+ push   %r8
+ push   %r9
+ push   %r10
+ push   %r11
+ push   %rbp
+
+ mov    %rsp,%rbp
+ sub    $512,%rsp
+ and    $-16,%rsp
+ fxsave (%rsp)
+
+ call   \handler
+
+ fxrstor (%rsp)
+ mov    %rbp,%rsp
+ pop    %rbp
+ pop    %r11
+ pop    %r10
+ pop    %r9
+ pop    %r8
+ pop    %rdi
+ pop    %rsi
+ pop    %rdx
+ pop    %rcx
+ pop    %rax
+ iretq
+ .endm
+
+ ipi_interrupt call_function_interrupt, call_function_interrupt_handler
+ ipi_interrupt tlb_shootdown_interrupt, tlb_shootdown_interrupt_handler
+
+ # Interrupt handler for the reschedule interrupt. It may switch thread so
+ # it saves the context like the timer interrupt.
+reschedule_interrupt:
+ swapgs
+
+ push   %rbp
+
+ # Remember the C code to call in the scratch space
+ movq   $reschedule_interrupt_handler,%gs:0
+ jmp    save_interrupted_context
+
  # Interrupt handler for the timer interrupt
 timer_interrupt:
  swapgs
@@ -242,6 +365,11 @@ timer_interrupt:
  # Push a scratch register onto the stack so that we do not overwrite it
  push   %rbp
 
+ # Remember the C code to call in the scratch space
+ movq   $timer_interrupt_handler,%gs:0
+
+save_interrupted_context:
+
  # Set segment registers to supervisor mode
  mov    $32,%ebp
  mov    %ebp,%ds
@@ -255,24 +383,29 @@ timer_interrupt:
  # thread and we should not save any context.
  test   %ebp,%ebp
  jns    not_in_kernel
- # The idle thread was interrupted. Just remove a stack frame and call the
- # C code.
+ # The idle thread was interrupted. It does not get back to idle_wait, so
+ # clear its idle bit here. Remember where for the profiler. Then
+ # just remove a stack frame and call the C code.
+ mov    %gs:40,%ebp
+ lock btrq %rbp,idle_cpus
+ mov    8(%rsp),%rbp
+ mov    %rbp,%gs:48
  add    $48,%rsp
  jmp    go_to_c
 
 not_in_kernel:
+ # Check if the interrupt was taken at a preemption point in the kernel.
+ # The code segment selector pushed by the CPU then has privilege level 0.
+ testb  $3,16(%rsp)
+ jz     in_system_call
+
  # Interrupt occured outside the idle thread
  # Save all registers.
 
- # mask off everything except the lowest 8 bits
- and    $255,%rbp
- # The size of a thread structure is 1024 bytes. We multiply the index with
- # 1024 to get an offset into the thread_table. Multiplying with 1024 is the
- # same as shifting left 10 bits.
- shl    $10,%rbp
- # Add the address of thread_table to get the address of the thread structure.
- # We also add 0x200 to get an address to the integer registers.
- add    $thread_table+0x200,%rbp
+ # Get the address of the running thread. We add 0x200 to get an address
+ # to the integer registers.
+ mov    %gs:32,%rbp
+ add    $0x200,%rbp
 
  # Save the FPU state
  fxsave -512(%rbp)
@@ -305,11 +438,49 @@ not_in_kernel:
  mov    %al,18*8(%rbp)
 
 go_to_c:
- # Call the timer interrupt handler
- call   timer_interrupt_handler
+ # Call the interrupt handler
+ call   *%gs:0
  # Return back to user mode through the system call code
  jmp    return_to_user_mode
 
+in_system_call:
+ # The interrupted system call continues on the same stack and the thread
+ # is not switched. Save the registers the C code may overwrite, like the
+ # page fault handler, and return to the preemption point. rbp is already
+ # on the stack.
+ push   %rax
+ push   %rcx
+ push   %rdx
+ push   %rsi
+ push   %rdi
+ push   %r8
+ push   %r9
+ push   %r10
+ push   %r11
+
+ mov    %rsp,%rbp
+ sub    $512,%rsp
+ and    $-16,%rsp
+ fxsave (%rsp)
+
+ call   *%gs:0
+
+ fxrstor (%rsp)
+ mov    %rbp,%rsp
+ pop    %r11
+ pop    %r10
+ pop    %r9
+ pop    %r8
+ pop    %rdi
+ pop    %rsi
+ pop    %rdx
+ pop    %rcx
+ pop    %rax
+ pop    %rbp
+ # The preemption point runs with the user gs loaded.
+ swapgs
+ iretq
+
  .data
  .align 8
 TSS:
@@ -0,0 +1,150 @@
+/*! \file idle.c
+ * This file implements the idle loop.
+ */
+
+#include "idle.h"
+#include "threadqueue.h"
+#include "apic.h"
+
+/* Note: Look in idle.h for documentation of global variables and
+   functions. */
+
+/* Variables */
+
+volatile unsigned long
+idle_cpus = 0;
+
+struct idle_statistics
+idle_statistics[MAX_NUMBER_OF_CPUS];
+
+/*! 1 if the CPUs wait with MWAIT, 0 if they wait with hlt. */
+static int
+mwait_enabled = 0;
+
+/*! The wake word of each CPU. It holds the time stamp counter when another
+    CPU woke the CPU, 0 if none did. Each word has its own cache line so
+    that MWAIT is only woken by writes to it. */
+static struct
+{
+ volatile unsigned long wake_timestamp;
+} __attribute__((aligned(64)))
+wake_words[MAX_NUMBER_OF_CPUS];
+
+/* Functions */
+
+void
+initialize_idle(void)
+{
+ register int i;
+
+ /* The flag is bit 3 of ecx in leaf 1. IDLE_MWAIT is 0 when the kernel is
+    built to wait with hlt. */
+ mwait_enabled = IDLE_MWAIT && (0 != (cpuid_ecx(1) & (1<<3)));
+
+ for(i=0; i<MAX_NUMBER_OF_CPUS; i++)
+ {
+  idle_statistics[i].mwait = mwait_enabled;
+ }
+}
+
+void
+idle_wait(void)
+{
+ const unsigned long           cpu = 1UL << cpu_private_data.cpu_index;
+ volatile unsigned long* const wake =
+  &wake_words[cpu_private_data.cpu_index].wake_timestamp;
+
+ __atomic_fetch_or(&idle_cpus, cpu, __ATOMIC_SEQ_CST);
+
+ /* A thread made ready before the bit was set did not wake the CPU. */
+ if (!thread_queue_is_empty(&ready_queue))
+ {
+  schedule_idle_cpu();
+ }
+
+ /* The interrupt entries swap gs, so the user gs has to be loaded while
+    interrupts are enabled. The instruction after sti runs before any
+    interrupt is taken. */
+ if (-1 == cpu_private_data.thread_index)
+ {
+  if (mwait_enabled)
+  {
+   __asm volatile("monitor" : : "a" (wake), "c" (0), "d" (0));
+   if (0 == *wake)
+   {
+    __asm volatile("swapgs\n\tsti\n\tmwait\n\tcli\n\tswapgs" : :
+                   "a" (0), "c" (0) : "memory");
+   }
+  }
+  else
+  {
+   __asm volatile("swapgs\n\tsti\n\thlt\n\tcli\n\tswapgs" : : : "memory");
+  }
+ }
+
+ /* A write of the wake word, or an interrupt that does not switch thread,
+    ended the wait. */
+ __atomic_fetch_and(&idle_cpus, ~cpu, __ATOMIC_SEQ_CST);
+ if (0 != *wake)
+ {
+  idle_woken();
+  schedule_idle_cpu();
+ }
+}
+
+int
+idle_wake_cpu(const int cpu)
+{
+ unsigned long expected = 0;
+
+ /* Keep the time of the first wake up if the CPU has not seen it yet. */
+ __atomic_compare_exchange_n(&wake_words[cpu].wake_timestamp, &expected,
+                             rdtsc(), 0, __ATOMIC_SEQ_CST,
+                             __ATOMIC_RELAXED);
+ return mwait_enabled;
+}
+
+void
+idle_woken(void)
+{
+ struct idle_statistics* const statistics =
+  &idle_statistics[cpu_private_data.cpu_index];
+ const unsigned long           wake_timestamp =
+  __atomic_exchange_n(&wake_words[cpu_private_data.cpu_index].wake_timestamp,
+                      0, __ATOMIC_ACQ_REL);
+ unsigned long                 cycles;
+
+ if (0 == wake_timestamp)
+ {
+  return;
+ }
+
+ cycles = rdtsc() - wake_timestamp;
+ statistics->wakeups++;
+ statistics->wakeup_cycles += cycles;
+ if (cycles > statistics->max_wakeup_cycles)
+ {
+  statistics->max_wakeup_cycles = cycles;
+ }
+}
+
+void
+idle_woken_by_timer(const unsigned long entry_timestamp)
+{
+ struct idle_statistics* const statistics =
+  &idle_statistics[cpu_private_data.cpu_index];
+ unsigned long                 cycles = local_apic_timer_expired_cycles();
+
+ /* The programmable interval timer can not tell when it expired. */
+ if (0 == cycles)
+ {
+  cycles = rdtsc() - entry_timestamp;
+ }
+
+ statistics->timer_wakeups++;
+ statistics->timer_wakeup_cycles += cycles;
+ if (cycles > statistics->max_timer_wakeup_cycles)
+ {
+  statistics->max_timer_wakeup_cycles = cycles;
+ }
+}
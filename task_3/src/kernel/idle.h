@@ -0,0 +1,58 @@
+/*! \file idle.h
+ * This file defines the idle loop. A CPU with no thread to run waits with
+ * MONITOR and MWAIT on a wake word of its own. Another CPU that makes a
+ * thread ready for it wakes it by writing the word, without an interrupt.
+ * CPUs without MWAIT wait with hlt and are woken with the reschedule
+ * interrupt. Interrupts end the wait either way.
+ */
+
+#ifndef _IDLE_H_
+#define _IDLE_H_
+
+#include "kernel.h"
+
+/* Variable declarations */
+
+extern volatile unsigned long
+idle_cpus;
+/*!< Bit i is set while CPU i waits in the idle loop. Cleared by the
+     interrupt entry in enter.s when an interrupt ends the wait. */
+
+extern struct idle_statistics
+idle_statistics[MAX_NUMBER_OF_CPUS];
+/*!< The idle statistics of each CPU. */
+
+/* Function declarations */
+
+/*! Checks if the CPU supports MONITOR and MWAIT. Called from initialize. */
+extern void
+initialize_idle(void);
+
+/*! Waits until an interrupt arrives or another CPU makes a thread ready
+    for the CPU. Called from return_to_user_mode in enter.s when the CPU has
+    no thread to run. It does not return if an interrupt that may switch
+    thread ends the wait. */
+extern void
+idle_wait(void);
+
+/*! Wakes an idle CPU after a thread it may run was made ready.
+    \return 1 if writing the wake word woke the CPU, 0 if it waits with hlt
+            and has to be sent the reschedule interrupt. */
+extern int
+idle_wake_cpu(const int cpu
+              /*!< The index of the CPU. */);
+
+/*! Accounts the time since another CPU woke the calling CPU in its idle
+    statistics. Does nothing if no CPU woke it. */
+extern void
+idle_woken(void);
+
+/*! Accounts the time since the timer expired in the idle statistics of the
+    calling CPU. Called from the timer interrupt handler when it has woken a
+    thread for the idle CPU to run. */
+extern void
+idle_woken_by_timer(const unsigned long entry_timestamp
+                    /*!< The time stamp counter when the handler was
+                         entered. */);
+
+#endif
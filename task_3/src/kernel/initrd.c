@@ -0,0 +1,183 @@
+/*! \file initrd.c
+ * This file implements the loading of executables from boot modules.
+ */
+
+#include "initrd.h"
+#include "elf.h"
+
+/* Note: Look in initrd.h for documentation of global variables and
+   functions. */
+
+/* Function definitions */
+
+/*! Validates an executable image and adds it to executable_table. */
+static void
+add_executable(const struct Elf64_Ehdr* const image
+               /*!< The start of the ELF image. */,
+               const unsigned long            image_size
+               /*!< The size, in bytes, of the ELF image. */)
+{
+ const char* error;
+
+ if (executable_table_size >= MAX_NUMBER_OF_EXECUTABLES)
+ {
+  while (1)
+  {
+   kprints("Kernel panic! Too many executable images found.\n");
+  }
+ }
+
+ error = elf_describe_executable(image, image_size,
+                                 &executable_table[executable_table_size]);
+ if (0 != error)
+ {
+  while (1)
+  {
+   kprints("Kernel panic! ");
+   kprints(error);
+   kprints("\n");
+  }
+ }
+
+ executable_table_size += 1;
+}
+
+/*! Parses a number written with 8 hexadecimal digits, as in cpio headers.
+    \return The number or -1 if a character is not a hexadecimal digit. */
+static long
+parse_hex(const char* const digits
+          /*!< The first digit. */)
+{
+ long         value = 0;
+ register int i;
+
+ for(i=0; i<8; i++)
+ {
+  const char digit = digits[i];
+
+  value <<= 4;
+  if ((digit >= '0') && (digit <= '9'))
+  {
+   value += digit - '0';
+  }
+  else if ((digit >= 'a') && (digit <= 'f'))
+  {
+   value += digit - 'a' + 10;
+  }
+  else if ((digit >= 'A') && (digit <= 'F'))
+  {
+   value += digit - 'A' + 10;
+  }
+  else
+  {
+   return -1;
+  }
+ }
+ return value;
+}
+
+/*! \return 1 iff the first bytes of memory match the string. */
+static int
+starts_with(const char* memory, const char* string)
+{
+ for(; *string; memory++, string++)
+ {
+  if (*memory != *string)
+  {
+   return 0;
+  }
+ }
+ return 1;
+}
+
+/*! Adds the regular files of a newc cpio archive as executables. */
+static void
+add_archive(const char* const   archive
+            /*!< The start of the archive. */,
+            const unsigned long archive_size
+            /*!< The size, in bytes, of the archive. */)
+{
+ unsigned long offset = 0;
+
+ while (1)
+ {
+  const char* const header = archive + offset;
+  long              mode;
+  long              file_size;
+  long              name_size;
+  unsigned long     data_offset;
+
+  if ((offset + CPIO_HEADER_SIZE > archive_size) ||
+      !starts_with(header, "070701") ||
+      (0 > (mode = parse_hex(header + 14))) ||
+      (0 > (file_size = parse_hex(header + 54))) ||
+      (0 > (name_size = parse_hex(header + 94))))
+  {
+   break;
+  }
+
+  /* The name and the data are padded to a multiple of 4 bytes. */
+  data_offset = (offset + CPIO_HEADER_SIZE + name_size + 3) & ~3UL;
+  if ((data_offset + file_size > archive_size) ||
+      (0 == name_size) || (0 != header[CPIO_HEADER_SIZE + name_size - 1]))
+  {
+   break;
+  }
+
+  if (starts_with(header + CPIO_HEADER_SIZE, "TRAILER!!!"))
+  {
+   return;
+  }
+
+  /* Directories and other special files are skipped. The ELF image is only
+     4 byte aligned, which the processor handles. */
+  if (CPIO_MODE_REGULAR == (mode & CPIO_MODE_TYPE))
+  {
+   add_executable((const struct Elf64_Ehdr*) (archive + data_offset),
+                  file_size);
+  }
+
+  offset = (data_offset + file_size + 3) & ~3UL;
+ }
+
+ while (1)
+ {
+  kprints("Kernel panic! Corrupt initrd archive.\n");
+ }
+}
+
+void
+initialize_initrd(void)
+{
+ const struct multiboot_information* const info =
+  (const struct multiboot_information*) multiboot_information;
+ const struct multiboot_module*            module;
+ const int                                 embedded_executables =
+  executable_table_size;
+ unsigned int                              i;
+
+ if (0 == (info->flags & MULTIBOOT_FLAG_MODS))
+ {
+  return;
+ }
+
+ module = (const struct multiboot_module*) (unsigned long) info->mods_addr;
+ for(i=0; i<info->mods_count; i++)
+ {
+  const char* const   start = (const char*) (unsigned long) module[i].mod_start;
+  const unsigned long size = module[i].mod_end - module[i].mod_start;
+
+  if ((size >= 6) && starts_with(start, "070701"))
+  {
+   add_archive(start, size);
+  }
+  else
+  {
+   add_executable((const struct Elf64_Ehdr*) start, size);
+  }
+ }
+
+ kprints("Found ");
+ kprinthex(executable_table_size - embedded_executables);
+ kprints(" executable images in boot modules.\n");
+}
@@ -0,0 +1,34 @@
+/*! \file initrd.h
+ * This file defines the loading of executables from boot modules. A boot
+ * module is either an executable ELF image or a cpio archive, in the "newc"
+ * format, holding executable ELF images. The executables are added to
+ * executable_table after the ones embedded in the kernel image, in the order
+ * of the modules and of the files in each archive. The images are used where
+ * the boot loader put them. The page fault handler copies pages from them
+ * the same way as from the images in the kernel image.
+ */
+
+#ifndef _INITRD_H_
+#define _INITRD_H_
+
+#include "kernel.h"
+
+#define CPIO_HEADER_SIZE (110)
+/*!< The size of the header of a file in a newc cpio archive. It is followed
+     by the file name and the file data, both padded to a multiple of 4
+     bytes. */
+
+#define CPIO_MODE_TYPE    (0170000)
+/*!< Masks the file type bits of the mode field. */
+#define CPIO_MODE_REGULAR (0100000)
+/*!< The file type of a regular file. */
+
+/* Function declarations */
+
+/*! Validates the executables in the boot modules and adds them to
+    executable_table. Panics if a module is corrupt. Called from initialize
+    after initialize_memory has reserved the modules. */
+extern void
+initialize_initrd(void);
+
+#endif
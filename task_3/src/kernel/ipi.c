@@ -0,0 +1,126 @@
+/*! \file ipi.c
+ * This file implements the inter-processor interrupts.
+ */
+
+#include "ipi.h"
+#include "apic.h"
+#include "idle.h"
+
+/* Note: Look in ipi.h for documentation of global variables and
+   functions. */
+
+/* Variables */
+
+/*! Defines a request sent from one CPU to another. */
+struct ipi_request
+{
+ void          (*volatile function)(void* argument);
+                                /*!< The function to run. */
+ void* volatile argument;       /*!< Passed to the function. */
+ volatile int  pending;         /*!< 1 until the function has run. */
+};
+
+/*! The requests of each kind sent to each CPU, indexed by the kind, the
+    receiving CPU and the sending CPU. */
+static struct ipi_request
+ipi_requests[2][MAX_NUMBER_OF_CPUS][MAX_NUMBER_OF_CPUS];
+
+/*! The vector of each kind of request. */
+static const unsigned int
+ipi_vectors[2] = {IPI_CALL_FUNCTION_VECTOR, IPI_TLB_SHOOTDOWN_VECTOR};
+
+/* Functions */
+
+/*! Runs the requests of one kind sent to the calling CPU. */
+static void
+serve_requests(const int kind
+               /*!< IPI_CALL_FUNCTION or IPI_TLB_SHOOTDOWN. */)
+{
+ struct ipi_request* const requests =
+  ipi_requests[kind][cpu_private_data.cpu_index];
+ register int              i;
+
+ for(i=0; i<MAX_NUMBER_OF_CPUS; i++)
+ {
+  if (__atomic_load_n(&requests[i].pending, __ATOMIC_ACQUIRE))
+  {
+   requests[i].function(requests[i].argument);
+   __atomic_store_n(&requests[i].pending, 0, __ATOMIC_RELEASE);
+  }
+ }
+}
+
+void
+ipi_call(const int           kind,
+         const unsigned long cpus,
+         void                (*function)(void* argument),
+         void* const         argument)
+{
+ const int           self = cpu_private_data.cpu_index;
+ const unsigned long targets = cpus & online_cpus & ~(1UL << self);
+ register int        i;
+
+ for(i=0; i<MAX_NUMBER_OF_CPUS; i++)
+ {
+  if (0 != (targets & (1UL << i)))
+  {
+   struct ipi_request* const request = &ipi_requests[kind][i][self];
+
+   request->function = function;
+   request->argument = argument;
+   __atomic_store_n(&request->pending, 1, __ATOMIC_RELEASE);
+   send_ipi(i, ipi_vectors[kind]);
+  }
+ }
+
+ for(i=0; i<MAX_NUMBER_OF_CPUS; i++)
+ {
+  if (0 != (targets & (1UL << i)))
+  {
+   /* The CPU may itself be waiting for this CPU. */
+   while (__atomic_load_n(&ipi_requests[kind][i][self].pending,
+                          __ATOMIC_ACQUIRE))
+   {
+    serve_requests(IPI_TLB_SHOOTDOWN);
+    serve_requests(IPI_CALL_FUNCTION);
+    __asm volatile("pause");
+   }
+  }
+ }
+}
+
+void
+ipi_kick_idle_cpu(const int thread_index)
+{
+ unsigned long cpus;
+
+ /* The thread is in the ready queue before idle_cpus is read. A CPU that
+    sets its bit later finds the thread when it checks the queue. */
+ __atomic_thread_fence(__ATOMIC_SEQ_CST);
+ cpus = thread_scheduling_table[thread_index].allowed_cpus &
+        __atomic_load_n(&idle_cpus, __ATOMIC_SEQ_CST) &
+        ~(1UL << cpu_private_data.cpu_index);
+
+ if ((0 != cpus) && !idle_wake_cpu(__builtin_ctzl(cpus)))
+ {
+  send_ipi(__builtin_ctzl(cpus), IPI_RESCHEDULE_VECTOR);
+ }
+}
+
+void
+call_function_interrupt_handler(void)
+{
+ const unsigned long entry_timestamp = rdtsc();
+
+ serve_requests(IPI_CALL_FUNCTION);
+ end_of_interrupt(entry_timestamp);
+}
+
+void
+tlb_shootdown_interrupt_handler(void)
+{
+ const unsigned long entry_timestamp = rdtsc();
+
+ serve_requests(IPI_TLB_SHOOTDOWN);
+ end_of_interrupt(entry_timestamp);
+}
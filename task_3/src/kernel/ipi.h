@@ -0,0 +1,68 @@
+/*! \file ipi.h
+ * This file defines the inter-processor interrupts. A CPU sends the
+ * reschedule interrupt to an idle CPU when it makes a thread ready that the
+ * idle CPU may run. The function call and TLB shootdown interrupts make
+ * other CPUs run a function and wait until they have. Each has its own
+ * vector so TLB shootdowns are served before other requests.
+ *
+ * Each CPU has one request slot per sending CPU, so sending takes no lock.
+ * A CPU serves the requests of all senders each time it takes the interrupt,
+ * so requests sent while the interrupt is pending are coalesced into one
+ * interrupt. The kernel runs with interrupts disabled, so a CPU waiting for
+ * other CPUs serves the requests sent to it while it waits. It must hold no
+ * spin lock, since the CPUs it waits for may be spinning on it.
+ */
+
+#ifndef _IPI_H_
+#define _IPI_H_
+
+#include "kernel.h"
+
+#define IPI_TLB_SHOOTDOWN_VECTOR (0xfd)
+/*!< The vector of the TLB shootdown interrupt. boot64.s installs its
+     handler. */
+#define IPI_CALL_FUNCTION_VECTOR (0xfc)
+/*!< The vector of the function call interrupt. */
+#define IPI_RESCHEDULE_VECTOR    (0xfb)
+/*!< The vector of the reschedule interrupt. */
+
+#define IPI_CALL_FUNCTION        (0)
+/*!< Selects the function call interrupt in ipi_call. */
+#define IPI_TLB_SHOOTDOWN        (1)
+/*!< Selects the TLB shootdown interrupt in ipi_call. */
+
+/* Function declarations */
+
+/*! Makes other CPUs run a function and waits until all have run it.
+    No spin lock may be held. */
+extern void
+ipi_call(const int           kind
+         /*!< IPI_CALL_FUNCTION or IPI_TLB_SHOOTDOWN. */,
+         const unsigned long cpus
+         /*!< Bit i is set to run the function on CPU i. The calling CPU is
+              skipped. */,
+         void                (*function)(void* argument)
+         /*!< The function. It is run with interrupts disabled. */,
+         void* const         argument
+         /*!< Passed to the function. Has to stay valid until ipi_call
+              returns. */);
+
+/*! Wakes one idle CPU that a thread may run on, if there is one. A CPU
+    waiting with MWAIT is woken through its wake word, one waiting with hlt
+    gets the reschedule interrupt. Called after the thread was put in the
+    ready queue. */
+extern void
+ipi_kick_idle_cpu(const int thread_index
+                  /*!< The index, into thread_table, of the thread. */);
+
+/*! Runs the function call requests sent to the CPU. Called from the
+    interrupt handler in enter.s. */
+extern void
+call_function_interrupt_handler(void);
+
+/*! Runs the TLB shootdown requests sent to the CPU. Called from the
+    interrupt handler in enter.s. */
+extern void
+tlb_shootdown_interrupt_handler(void);
+
+#endif
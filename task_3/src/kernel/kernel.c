@@ -6,35 +6,85 @@
 
 #include "kernel.h"
 #include "threadqueue.h"
+#include "paging.h"
+#include "memory.h"
+#include "slab.h"
+#include "trace.h"
+#include "profile.h"
+#include "pmu.h"
+#include "elf.h"
+#include "initrd.h"
+#include "cpuset.h"
+#include "lock.h"
+#include "apic.h"
+#include "ipi.h"
+#include "idle.h"
+#include "mutex.h"
 
 /* Note: Look in kernel.h for documentation of global variables and
    functions. */
 
 /* Variables */
 
-union thread
-thread_table[MAX_NUMBER_OF_THREADS];
+union thread**
+thread_table = 0;
 
-struct process
-process_table[MAX_NUMBER_OF_PROCESSES];
+int
+thread_table_size = 0;
+
+struct thread_scheduling_data*
+thread_scheduling_table = 0;
+
+/*! The number of entries in thread_scheduling_table. */
+static int
+thread_scheduling_table_size = 0;
+
+struct process**
+process_table = 0;
+
+int
+process_table_size = 0;
+
+/*! The lowest index into thread_table that may be unused. Used to speed up
+    allocate_thread. */
+static int
+first_free_thread_index = 0;
+
+/*! The lowest index into process_table that may be unused. Used to speed up
+    allocate_process. */
+static int
+first_free_process_index = 0;
 
 struct thread_queue
 ready_queue;
 
-struct executable
-executable_table[MAX_NUMBER_OF_PROCESSES];
+struct ticket_lock
+thread_table_lock;
 
-int
-executable_table_size;
+struct ticket_lock
+process_table_lock;
+
+/*! Protects ready_queue. Every system call takes it to run the scheduler,
+    so it is a queue lock. Also taken by the timer interrupt handler. */
+static struct mcs_lock
+ready_queue_lock;
+
+/*! Protects the timer queue. Also taken by the timer interrupt handler. */
+static struct ticket_lock
+timer_queue_lock;
+
+unsigned long
+online_cpus = 1;
 
-/* The following four variables are set by the assembly code. */
+/* executable_table, executable_table_size and executable_table_checksum
+   are generated by the build, see src/tools/mkexecutables.c. */
+
+/* The following variable is set by the assembly code. */
 unsigned long first_available_memory_byte;
 
+/* Set by initialize_memory. */
 unsigned long memory_size;
 
-const struct executable_image* ELF_images_start;
-
-const char* ELF_images_end;
 /* Initialize the timer queue to be empty. */
 int
 timer_queue_head=-1;
@@ -43,11 +93,20 @@ timer_queue_head=-1;
 long
 system_time=0;
 
+int
+timer_interrupts_per_tick=1;
+
+/*! The number of timer interrupts left until the next clock tick. */
+static int
+timer_interrupts_left=1;
+
 /* Function definitions */
 
 void
 kprints(const char* string)
 {
+ register int characters = 0;
+
  /* Loop until we have found the null character. */
  while(1)
  {
@@ -56,6 +115,12 @@ kprints(const char* string)
   if (curr)
   {
    outb(0xe9, curr);
+   /* Long strings from the prints system call let interrupts in. */
+   if (PRINTS_CHARACTERS_PER_PREEMPTION_POINT == ++characters)
+   {
+    kernel_preemption_point();
+    characters = 0;
+   }
   }
   else
   {
@@ -64,6 +129,31 @@ kprints(const char* string)
  }
 }
 
+int
+kprints_user(const char* string)
+{
+ register int characters = 0;
+
+ /* The string may not reach into the kernel, e.g., through the identity
+    map. */
+ while(is_user_range(string, 1))
+ {
+  register const char curr = *string++;
+
+  if (0 == curr)
+  {
+   return ALL_OK;
+  }
+  outb(0xe9, curr);
+  if (PRINTS_CHARACTERS_PER_PREEMPTION_POINT == ++characters)
+  {
+   kernel_preemption_point();
+   characters = 0;
+  }
+ }
+ return ERROR;
+}
+
 void
 kprinthex(const register long value)
 {
@@ -84,274 +174,373 @@ prepare_process(const struct Elf64_Ehdr* elf_image,
                 const unsigned int       process,
                 unsigned long            memory_footprint_size)
 {
- /* Get the address of the program header table. */
- int                program_header_index;
- struct Elf64_Phdr* program_header = ((struct Elf64_Phdr*)
-                                       (((char*) (elf_image)) +
-                                        elf_image->e_phoff));
- unsigned long      used_memory = 0;
- unsigned long      address_of_first_instruction = 0;
+ int                executable_index;
  struct prepare_process_return_value ret_val = {0, 0};
+ const unsigned long creation_time_stamp = rdtsc();
 
- /* First check that we have enough memory. */
- if (first_available_memory_byte + memory_footprint_size >= memory_size)
+ /* First check that the image fits in the user space below the stack. */
+ if ((0 == memory_footprint_size) ||
+     (memory_footprint_size > USER_SPACE_SIZE - USER_STACK_SIZE))
  {
-  /* No, we don't. */
   return ret_val;
  }
 
- /* Scan through the program header table and copy all PT_LOAD segments to
-    memory. Perform checks at the same time.*/
-
- for (program_header_index = 0;
-      program_header_index < elf_image->e_phnum;
-      program_header_index++)
+ /* The image has to be one of the validated executables. Its segments are
+    loaded from the description in executable_table by the page fault
+    handler. */
+ for(executable_index=0;
+     (executable_index<executable_table_size) &&
+     (executable_table[executable_index].elf_image != elf_image);
+     executable_index++)
  {
-  if (PT_LOAD == program_header[program_header_index].p_type)
-  {
-   /* Calculate destination adress. */
-   unsigned long* dst = (unsigned long *) (first_available_memory_byte + 
-                                           used_memory);
-
-   /* Check for odd things. */
-   if (
-       /* Check if the segment is contigous */
-       (used_memory != program_header[program_header_index].p_vaddr) ||
-       /* Check if the segmen fits in memory. */
-       (used_memory + program_header[program_header_index].p_memsz >
-        memory_footprint_size) ||
-       /* Check if the segment has an odd size. We require the segement
-          size to be an even multiple of 8. */
-       (0 != (program_header[program_header_index].p_memsz&7)) ||
-       (0 != (program_header[program_header_index].p_filesz&7)))
-   {
-    /* Something went wrong. Return an error. */
-    return ret_val;
-   }
-
-   /* First copy p_filesz from the image to memory. */
-   {
-    /* Calculate the source address. */
-    unsigned long* src = (unsigned long *) (((char*) elf_image)+
-     program_header[program_header_index].p_offset);
-    unsigned long count = program_header[program_header_index].p_filesz/8;
-
-    for(; count>0; count--)
-    {
-     *dst++=*src++;
-    }
-   }
-
-
-   /* Then write p_memsz-p_filesz bytes of zeros. This to pad the segment. */
-   {
-    unsigned long count = (program_header[program_header_index].p_memsz-
-                           program_header[program_header_index].p_filesz)/8;
-
-    for(; count>0; count--)
-    {
-     *dst++=0;
-    }
-   }
+ }
+ if ((executable_index == executable_table_size) ||
+     (executable_table[executable_index].memory_footprint_size >
+      memory_footprint_size))
+ {
+  return ret_val;
+ }
 
-   /* Finally update the amount of used memory. */
-   used_memory += program_header[program_header_index].p_memsz;
-  }
+ /* Build the page table of the process. The image will be mapped at
+    USER_SPACE_START plus the load offset in the address space of the
+    process. */
+ ret_val.page_table_address = build_process_page_table();
+ if (0 == ret_val.page_table_address)
+ {
+  return ret_val;
  }
 
+ process_table[process]->page_table_root = ret_val.page_table_address;
+ /* The PCID may have been used by a terminated process. Make sure that TLB
+    entries tagged with it are flushed. */
+ process_table[process]->pcid = (process % 4095) + 1;
+ forget_pcid(process_table[process]->pcid);
+ process_table[process]->elf_image = elf_image;
+ process_table[process]->memory_footprint_size = memory_footprint_size;
+ process_table[process]->resident_pages = 0;
+ process_table[process]->creation_time_stamp = creation_time_stamp;
+ process_table[process]->first_instruction_cycles = 0;
+ process_table[process]->executable = executable_index;
+ /* A position independent image can be loaded at any page aligned offset
+    and is relocated as its pages are filled. Each process has an address
+    space of its own, so the start of the user space is always free and
+    keeps large pages possible for segments aligned to 2 Mbyte. */
+ process_table[process]->load_offset = 0;
+
+ /* Start from the template of the executable. The first process that runs
+    the executable pays for building it. If memory is too short for the
+    template the pages are loaded as they are touched instead. */
+ map_executable_template(process_table[process]);
+ process_table[process]->launch_cycles = rdtsc() - creation_time_stamp;
+
  /* Find out the address to the first instruction to be executed. */
- ret_val.first_instruction_address = first_available_memory_byte +
-                                     elf_image->e_entry;
+ ret_val.first_instruction_address =
+  USER_SPACE_START + process_table[process]->load_offset +
+  executable_table[executable_index].entry_point;
 
- /* Claim the memory. */
- first_available_memory_byte += memory_footprint_size;
- /* And round to nearest higher multiple of 4096 */
- first_available_memory_byte += 4096-1;
- first_available_memory_byte &= -4096;
+ trace_event(TRACE_EVENT_PROCESS_CREATE, process,
+             process_table[process]->launch_cycles);
 
  return ret_val;
 }
 
-void
-cleanup_process(const int process)
+int
+is_user_range(const void* const   address,
+              const unsigned long size)
 {
+ return ((unsigned long) address >= USER_SPACE_START) &&
+        (size <= USER_SPACE_SIZE) &&
+        ((unsigned long) address - USER_SPACE_START <= USER_SPACE_SIZE - size);
 }
 
-void
-initialize(void)
+/*! Accounts the time since interrupts were last taken in the interrupt
+    statistics of the CPU. */
+static void
+account_interrupts_disabled(void)
 {
- register int i;
+ struct interrupt_statistics* const statistics =
+  &interrupt_statistics[cpu_private_data.cpu_index];
+ const unsigned long                cycles =
+  rdtsc() - cpu_private_data.interrupts_disabled_timestamp;
 
- /* Loop over all threads in the thread table and reset the owner. */
- for(i=0; i<MAX_NUMBER_OF_THREADS; i++)
+ if (cycles > statistics->max_interrupts_disabled_cycles)
  {
-  thread_table[i].data.owner=-1; /* -1 is an illegal process_table index.
-                                     We use that to show that the thread
-                                     is dormant. */
+  statistics->max_interrupts_disabled_cycles = cycles;
  }
+}
 
- /* Loop over all processes in the thread table and mark them as not
-    executing. */
- for(i=0; i<MAX_NUMBER_OF_PROCESSES; i++)
+void
+kernel_preemption_point(void)
+{
+ /* PREEMPTION_POINTS is 0 when the kernel is built without preemption
+    points, to measure how long interrupts are disabled without them. */
+ if (!PREEMPTION_POINTS || !cpu_private_data.preemptible)
  {
-  process_table[i].threads=0;    /* No executing process has less than 1
-                                    thread. */
+  return;
  }
 
- /* Initialize the ready queue. */
- thread_queue_init(&ready_queue);
+ account_interrupts_disabled();
+ interrupt_statistics[cpu_private_data.cpu_index].preemption_points++;
+
+ /* The interrupt handlers must not open a window of their own. The entries
+    of the timer and reschedule interrupts swap gs, so the user gs is loaded
+    while interrupts are enabled, as in idle_wait. Interrupts are taken
+    after the nop. */
+ cpu_private_data.preemptible = 0;
+ __asm volatile("swapgs\n\tsti\n\tnop\n\tcli\n\tswapgs" : : : "memory");
+ cpu_private_data.preemptible = 1;
+ cpu_private_data.interrupts_disabled_timestamp = rdtsc();
+}
 
- /* Go through the linked list of executable images and verify that they
-    are correct. At the same time build the executable_table. */
+/*! Copies the arguments of a new thread to the top of the stack of its
+    process. The block holds the argv array followed by the strings. Sets the
+    stack pointer below the block and passes argc in rdi and argv in rsi.
+    \return ALL_OK or ERROR if the arguments are bad or do not fit. */
+static long
+set_up_stack(const int                thread_index
+             /*!< The index, into thread_table, of the new thread. Its
+                  owner has to be set. */,
+             const char* const* const argv
+             /*!< 0 terminated array of the arguments in the address space
+                  that is loaded. 0 for no arguments. */)
+{
+ struct process* const process =
+  process_table[thread_scheduling_table[thread_index].owner];
+ const unsigned long   stack_top = USER_SPACE_START + USER_SPACE_SIZE;
+ unsigned long         argc = 0;
+ unsigned long         size = sizeof(char*);
+ unsigned long         block_address;
+ unsigned long         frame;
+ unsigned long*        pointers;
+ char*                 strings;
+ unsigned long         i;
+
+ /* Measure the arguments. The block has to fit in the top page of the
+    stack. */
+ if (0 != argv)
  {
-  const struct executable_image* image;
-
-  for (image=ELF_images_start; 0!=image; image=image->next)
+  while (1)
   {
-   unsigned long      image_size;
+   const char* string;
 
-   /* First calculate the size of the image. */
-   if (0 != image->next)
+   if (!user_range_accessible(&argv[argc], sizeof(char*), PF_R))
    {
-    image_size = ((char *) (image->next)) - ((char *) image) -1;
+    return ERROR;
    }
-   else
+   string = argv[argc];
+   if (0 == string)
    {
-    image_size = ((char *) ELF_images_end) - ((char *) image) - 1;
+    break;
    }
 
-   /* Check that the image is an ELF image and that it is of the
-      right type. */
-   if (
-       /* EI_MAG0 - EI_MAG3 have to be 0x7f 'E' 'L' 'F'. */
-       (image->elf_image.e_ident[EI_MAG0] != 0x7f) ||
-       (image->elf_image.e_ident[EI_MAG1] != 'E') ||
-       (image->elf_image.e_ident[EI_MAG2] != 'L') ||
-       (image->elf_image.e_ident[EI_MAG3] != 'F') ||
-       /* Check that the image is a 64-bit image. */
-       (image->elf_image.e_ident[EI_CLASS] != 2) ||
-       /* Check that the image is a little endian image. */
-       (image->elf_image.e_ident[EI_DATA] != 1) ||
-       /* And that the version of the image format is correct. */
-       (image->elf_image.e_ident[EI_VERSION] != 1) ||
-       /* NB: We do not check the ABI or ABI version. We really should
-          but currently those fields are not set properly by the build
-          tools. They are both set to zero which means: System V ABI,
-          third edition. However, the ABI used is clearly not System V :-) */
-
-       /* Check that the image is executable. */
-       (image->elf_image.e_type != 2) ||
-       /* Check that the image is executable on AMD64. */
-       (image->elf_image.e_machine != 0x3e) ||
-       /* Check that the object format is correct. */
-       (image->elf_image.e_version != 1) ||
-       /* Check that the processor dependent flags are all reset. */
-       (image->elf_image.e_flags != 0) ||
-       /* Check that the length of the header is what we expect. */
-       (image->elf_image.e_ehsize != sizeof(struct Elf64_Ehdr)) ||
-       /* Check that the size of the program header table entry is what
-          we expect. */
-       (image->elf_image.e_phentsize != sizeof(struct Elf64_Phdr)) ||
-       /* Check that the number of entries is reasonable. */
-       (image->elf_image.e_phnum < 0) ||
-       (image->elf_image.e_phnum > 8) ||
-       /* Check that the entry point is within the image. */
-       (image->elf_image.e_entry < 0) ||
-       (image->elf_image.e_entry >= image_size) ||
-       /* Finally, check that the program header table is within the image. */
-       (image->elf_image.e_phoff > image_size) ||
-       ((image->elf_image.e_phoff +
-         image->elf_image.e_phnum * sizeof(struct Elf64_Phdr)) > image_size )
-      )
-
+   size += sizeof(char*);
+   do
    {
-    /* There is something wrong with the image. */
-    while (1)
+    if ((size >= SPAWN_MAX_ARGUMENT_BYTES) ||
+        !user_range_accessible(string, 1, PF_R))
     {
-     kprints("Kernel panic! Corrupt executable image.\n");
+     return ERROR;
     }
-    continue;
-   }
+    size++;
+   } while (0 != *string++);
+   argc++;
+  }
+ }
 
-   /* Now check the program header table. */
-   {
-    int                program_header_index;
-    struct Elf64_Phdr* program_header = ((struct Elf64_Phdr*)
-                                         (((char*) &(image->elf_image)) +
-                                          image->elf_image.e_phoff));
-    unsigned long      memory_footprint_size = 0;
-
-    for (program_header_index = 0;
-         program_header_index < image->elf_image.e_phnum;
-         program_header_index++)
-    {
-     /* First sanity check the entry. */
-     if (
-         /* Check that the segment is a type we can handle. */
-         (program_header[program_header_index].p_type < 0) ||
-         (!((program_header[program_header_index].p_type == PT_NULL) ||
-            (program_header[program_header_index].p_type == PT_LOAD) ||
-            (program_header[program_header_index].p_type == PT_PHDR))) ||
-         /* Look more carefully into loadable segments. */
-         ((program_header[program_header_index].p_type == PT_LOAD) &&
-           /* Check if any flags that we can not handle is set. */
-          (((program_header[program_header_index].p_flags & ~7) != 0) ||
-           /* Check if sizes and offsets look sane. */
-           (program_header[program_header_index].p_offset < 0) ||
-           (program_header[program_header_index].p_vaddr < 0) ||
-           (program_header[program_header_index].p_filesz < 0) ||
-           (program_header[program_header_index].p_memsz < 0) ||
-          /* Check if the segment has an odd size. We require the
-             segment size to be an even multiple of 8. */
-           (0 != (program_header[program_header_index].p_memsz&7)) ||
-           (0 != (program_header[program_header_index].p_filesz&7)) ||
-           /* Check if the segment goes beyond the image. */
-           ((program_header[program_header_index].p_offset +
-             program_header[program_header_index].p_filesz) > image_size)))
-        )
-     {
-      while (1)
-      {
-       kprints("Kernel panic! Corrupt segment.\n");
-      }
-     }
-
-     /* Check that all PT_LOAD segments are contiguous starting from
-        address 0. Also, calculate the memory footprint of the image. */
-     if (program_header[program_header_index].p_type == PT_LOAD)
-     {
-      if (program_header[program_header_index].p_vaddr !=
-          memory_footprint_size)
-      {
-       while (1)
-       {
-        kprints("Kernel panic! Executable image has illegal memory layout.\n");
-       }
-      }
-
-      memory_footprint_size += program_header[program_header_index].p_memsz;
-     }
-    }
+ block_address = (stack_top - size) & -16UL;
+ frame = process_page_address(process, stack_top - PAGE_SIZE);
+ if (0 == frame)
+ {
+  return ERROR;
+ }
 
-    executable_table[executable_table_size].memory_footprint_size =
-     memory_footprint_size;
-   }
+ /* The top page of the stack is written through the direct map. */
+ pointers = (unsigned long*) (frame + (block_address -
+                                       (stack_top - PAGE_SIZE)));
+ strings = (char*) &pointers[argc + 1];
+ for(i=0; i<argc; i++)
+ {
+  const char* string = argv[i];
 
-   executable_table[executable_table_size].elf_image = &(image->elf_image);
-   executable_table_size += 1;
+  pointers[i] = block_address + (strings - (char*) pointers);
+  while (0 != (*strings++ = *string++))
+  {
+  }
+ }
+ pointers[argc] = 0;
+
+ thread_table[thread_index]->data.registers.integer_registers.rsp =
+  block_address;
+ thread_table[thread_index]->data.registers.integer_registers.rdi = argc;
+ thread_table[thread_index]->data.registers.integer_registers.rsi =
+  block_address;
+ return ALL_OK;
+}
 
-   kprints("Found an executable image.\n");
+long
+spawn_process(const long               executable,
+              const char* const* const argv,
+              const long               priority,
+              const unsigned long      affinity)
+{
+ const int calling_thread = cpu_private_data.thread_index;
+ struct prepare_process_return_value prepare_process_ret_val;
+ int       process;
+ int       thread;
+
+ if ((executable < 0) || (executable >= executable_table_size) ||
+     (priority < SPAWN_INHERIT) || (priority >= THREAD_PRIORITIES) ||
+     ((0 != affinity) &&
+      (0 == (affinity &
+             cpuset_cpus(process_table[thread_scheduling_table[calling_thread].
+                                       owner]->cpuset)))))
+ {
+  return ERROR;
+ }
 
-   if (executable_table_size >= MAX_NUMBER_OF_PROCESSES)
+ process = allocate_process();
+ if (process < 0)
+ {
+  return ERROR;
+ }
+
+ prepare_process_ret_val =
+  prepare_process(executable_table[executable].elf_image, process,
+                  executable_table[executable].memory_footprint_size);
+
+ /* prepare_process fails when memory is exhausted. */
+ if (0 == prepare_process_ret_val.first_instruction_address)
+ {
+  kprints("Error starting image\n");
+  release_process(process);
+  return ERROR;
+ }
+
+ process_table[process]->parent =
+  thread_scheduling_table[calling_thread].owner;
+ cpuset_move_process(process,
+                     process_table[process_table[process]->parent]->cpuset);
+
+ thread = allocate_thread();
+ if (thread < 0)
+ {
+  cleanup_process(process);
+  return ERROR;
+ }
+
+ thread_scheduling_table[thread].owner = process;
+ thread_scheduling_table[thread].priority =
+  (SPAWN_INHERIT == priority) ?
+  thread_table[calling_thread]->data.base_priority : priority;
+ thread_table[thread]->data.base_priority =
+  thread_scheduling_table[thread].priority;
+ thread_table[thread]->data.affinity =
+  (0 == affinity) ? thread_table[calling_thread]->data.affinity : affinity;
+ update_allowed_cpus(thread);
+ thread_table[thread]->data.registers.integer_registers.rflags = 0x200;
+ thread_table[thread]->data.registers.integer_registers.rip =
+  prepare_process_ret_val.first_instruction_address;
+
+ process_table[process]->threads += 1;
+
+ if (ALL_OK != set_up_stack(thread, argv))
+ {
+  release_thread(thread);
+  cleanup_process(process);
+  return ERROR;
+ }
+
+ {
+  struct mcs_node     node;
+  const unsigned long flags = mcs_lock_acquire_irqsave(&ready_queue_lock,
+                                                       &node);
+
+  set_thread_state(thread, THREAD_STATE_READY);
+  thread_queue_enqueue(&ready_queue, thread);
+  mcs_lock_release_irqrestore(&ready_queue_lock, &node, flags);
+ }
+ ipi_kick_idle_cpu(thread);
+ return ALL_OK;
+}
+
+void
+cleanup_process(const int process)
+{
+ trace_event(TRACE_EVENT_PROCESS_EXIT, process,
+             process_table[process]->resident_pages);
+
+ /* Release the page table and the memory holding the process image. */
+ release_process_page_table(process_table[process]->page_table_root);
+ process_table[process]->page_table_root = 0;
+
+ cpuset_move_process(process, 0);
+ release_process(process);
+}
+
+void
+initialize(void)
+{
+ /* Hand all usable memory to the page frame allocator. This has to be done
+    before anything else allocates memory. */
+ initialize_memory();
+
+ /* Replace the boot page table and enable PCIDs. */
+ initialize_paging();
+
+ /* Start tracing kernel events. */
+ initialize_trace();
+
+ /* Stop the performance counters and let user mode read them. */
+ initialize_pmu();
+
+ /* Each global structure has its own lock. */
+ ticket_lock_init(&process_table_lock, "process_table");
+ ticket_lock_init(&thread_table_lock, "thread_table");
+ ticket_lock_init(&timer_queue_lock, "timer_queue");
+ mcs_lock_init(&ready_queue_lock, "ready_queue");
+ initialize_cpusets();
+ initialize_mutexes();
+
+ /* Threads and processes are allocated from object caches. The thread and
+    process tables start out empty and grow on demand. */
+ object_cache_init(&thread_cache, sizeof(union thread), 4, "thread_cache");
+ object_cache_init(&process_cache, sizeof(struct process), 1,
+                   "process_cache");
+
+ /* Initialize the ready queue. */
+ thread_queue_init(&ready_queue);
+
+ /* The executable images embedded in the kernel image were validated and
+    described when the kernel was built. Only check that the table was not
+    damaged. */
+ {
+  const unsigned long start = rdtsc();
+  unsigned long       checksum = ELF_CHECKSUM_START;
+  register int        i;
+
+  for(i=0; i<executable_table_size; i++)
+  {
+   checksum = elf_checksum(checksum, &executable_table[i]);
+  }
+
+  if (checksum != executable_table_checksum)
+  {
+   while (1)
    {
-    while (1)
-    {
-     kprints("Kernel panic! Too many executable images found.\n");
-    }
+    kprints("Kernel panic! Corrupt executable table.\n");
    }
   }
+
+  kprints("Checked ");
+  kprinthex(executable_table_size);
+  kprints(" executable images in ");
+  kprinthex(rdtsc() - start);
+  kprints(" cycles.\n");
  }
 
+ /* Then add the executable images passed as boot modules. */
+ initialize_initrd();
+
  /* Check that actually some executable files are found. Also check that the
     thread structure is of the right size. The assembly code will break if it
     is not. */
@@ -369,7 +558,19 @@ initialize(void)
  /* Use the ELF program header table and copy the right portions of the
     image to memory. This is done by prepare_process. */
  {
-  struct prepare_process_return_value prepare_process_ret_val = 
+  struct prepare_process_return_value prepare_process_ret_val;
+
+  /* Start executable program 0 as process 0. At this point, there are no
+     processes or threads so the first ones allocated get index 0. */
+  if ((0 != allocate_process()) || (0 != allocate_thread()))
+  {
+   while (1)
+   {
+    kprints("Kernel panic! Can not allocate process 0!\n");
+   }
+  }
+
+  prepare_process_ret_val =
    prepare_process(executable_table[0].elf_image,
                    0,
                    executable_table[0].memory_footprint_size);
@@ -382,78 +583,513 @@ initialize(void)
    }
   }
 
-  /* Start executable program 0 as process 0. At this point, there are no
-     processes so we can just grab entry 0 and use it. */
-  process_table[0].parent=-1;    /* We put -1 to indicate that there is no
+  process_table[0]->parent=-1;    /* We put -1 to indicate that there is no
                                     parent process. */
-  process_table[0].threads=1;
+  process_table[0]->threads=1;
 
-  /* We need a thread. We just take the first one as no threads are running or
-     have been allocated at this point. */
-  thread_table[0].data.owner=0;  /* 0 is the index of the first process. */
+  thread_scheduling_table[0].owner=0;  /* 0 is the index of the first
+                                          process. */
+  update_allowed_cpus(0);
+  set_thread_state(0, THREAD_STATE_RUNNING);
 
   /* We reset all flags and enable interrupts */
-  thread_table[0].data.registers.integer_registers.rflags=0x200;
+  thread_table[0]->data.registers.integer_registers.rflags=0x200;
 
   /* And set the start address. */
-  thread_table[0].data.registers.integer_registers.rip =
+  thread_table[0]->data.registers.integer_registers.rip =
    prepare_process_ret_val.first_instruction_address;
 
+  /* Process 0 gets no arguments. */
+  if (ALL_OK != set_up_stack(0, 0))
+  {
+   while (1)
+   {
+    kprints("Kernel panic! Can not set up the stack of process 0!\n");
+   }
+  }
+
   /* Finally we set the current thread. */
   cpu_private_data.thread_index = 0;
  }
 
+ /* Set up the interrupt controllers. The legacy PIC is masked if the CPU
+    has a local APIC. */
+ initialize_interrupt_controller();
+
+ /* Choose how idle CPUs wait. */
+ initialize_idle();
+
  /* Set up the timer hardware to generate interrupts 200 times a second. */
- outb(0x43, 0x36);
- outb(0x40, 78);
- outb(0x40, 23);
+ set_timer_interrupts_per_tick(1);
 
- /* Now we set up the interrupt controller to allow timer interrupts. */
- outb(0x20, 0x11);
- outb(0xA0, 0x11);
+ kprints("\n\n\nThe kernel has booted!\n\n\n");
+ /* Now go back to assembly language code and let the process run. */
+}
 
- outb(0x21, 0x20);
- outb(0xA1, 0x28);
+void
+set_timer_interrupts_per_tick(const int interrupts_per_tick)
+{
+ const int divisor = PIT_TICK_DIVISOR/interrupts_per_tick;
 
- outb(0x21, 1<<2);
- outb(0xA1, 2);
+ if (INTERRUPT_CONTROLLER_PIC != interrupt_controller)
+ {
+  start_local_apic_timer(interrupts_per_tick);
+ }
+ else
+ {
+  outb(0x43, 0x36);
+  outb(0x40, divisor&255);
+  outb(0x40, divisor>>8);
+ }
 
- outb(0x21, 1);
- outb(0xA1, 1);
+ timer_interrupts_per_tick = interrupts_per_tick;
+ timer_interrupts_left = interrupts_per_tick;
+}
 
- outb(0x21, 0xfe);
- outb(0xA1, 0xff);
+/*! Doubles the number of entries in a table of pointers. The table is kept
+    in page frames. The new entries are set to 0.
+    \return 1 on success, 0 if memory is exhausted. */
+static int
+grow_table(void*** const table
+           /*!< Points to the variable pointing to the table. */,
+           int* const    table_size
+           /*!< Points to the variable holding the number of entries. */)
+{
+ const int           new_size = (0 == *table_size) ?
+                                (int) (PAGE_SIZE/sizeof(void*)) :
+                                2 * *table_size;
+ void** const        new_table = (void**)
+  allocate_page_frames((new_size*sizeof(void*))/PAGE_SIZE, 1);
+ register int        i;
+
+ if (0 == new_table)
+ {
+  return 0;
+ }
 
- kprints("\n\n\nThe kernel has booted!\n\n\n");
- /* Now go back to assembly language code and let the process run. */
+ for(i=0; i<*table_size; i++)
+ {
+  new_table[i] = (*table)[i];
+ }
+ for(; i<new_size; i++)
+ {
+  new_table[i] = 0;
+ }
+
+ if (0 != *table_size)
+ {
+  release_page_frames((unsigned long) *table,
+                      (*table_size*sizeof(void*))/PAGE_SIZE);
+ }
+
+ *table = new_table;
+ *table_size = new_size;
+ return 1;
 }
 
-int
-allocate_thread(void)
+/*! Finds an unused entry in a table of pointers, growing the table if it is
+    full.
+    \return The index of the entry or -1 if memory is exhausted. */
+static int
+find_free_entry(void*** const table
+                /*!< Points to the variable pointing to the table. */,
+                int* const    table_size
+                /*!< Points to the variable holding the number of entries. */,
+                int* const    first_free_index
+                /*!< Points to the lowest index that may be unused. */)
 {
  register int i;
- /* loop over all threads and find a free thread. */
- for(i=0; i<MAX_NUMBER_OF_THREADS; i++)
+
+ for(i=*first_free_index; i<*table_size; i++)
  {
-  /* An owner index of -1 means that the thread is available. */
-  if (-1 == thread_table[i].data.owner)
+  if (0 == (*table)[i])
   {
+   *first_free_index = i + 1;
    return i;
   }
  }
 
- /* We return -1 to indicate that there are no available threads. */
- return -1;
+ /* The table is full. The first new entry is free after growing it. */
+ i = *table_size;
+ if (!grow_table(table, table_size))
+ {
+  return -1;
+ }
+ *first_free_index = i + 1;
+ return i;
+}
+
+/*! Grows thread_scheduling_table so that it has an entry for each entry in
+    thread_table. The table is kept in page frames. thread_table_lock has to
+    be held. The queue locks are taken while the table moves.
+    \return 1 on success, 0 if memory is exhausted. */
+static int
+grow_thread_scheduling_table(void)
+{
+ struct thread_scheduling_data* const old_table = thread_scheduling_table;
+ const int                      old_size = thread_scheduling_table_size;
+ struct thread_scheduling_data* new_table;
+ struct mcs_node                node;
+ unsigned long                  flags;
+ register int                   i;
+
+ if (thread_scheduling_table_size >= thread_table_size)
+ {
+  return 1;
+ }
+
+ new_table = (struct thread_scheduling_data*)
+  allocate_page_frames((thread_table_size*
+                        sizeof(struct thread_scheduling_data) +
+                        PAGE_SIZE - 1)/PAGE_SIZE, 1);
+ if (0 == new_table)
+ {
+  return 0;
+ }
+
+ flags = ticket_lock_acquire_irqsave(&timer_queue_lock);
+ mcs_lock_acquire(&ready_queue_lock, &node);
+ for(i=0; i<old_size; i++)
+ {
+  new_table[i] = old_table[i];
+ }
+ thread_scheduling_table = new_table;
+ thread_scheduling_table_size = thread_table_size;
+ mcs_lock_release(&ready_queue_lock, &node);
+ ticket_lock_release_irqrestore(&timer_queue_lock, flags);
+
+ if (0 != old_size)
+ {
+  release_page_frames((unsigned long) old_table,
+                      (old_size*sizeof(struct thread_scheduling_data) +
+                       PAGE_SIZE - 1)/PAGE_SIZE);
+ }
+ return 1;
+}
+
+/*! Sets all bytes of an object to zero. */
+static void
+clear_object(void* const         object
+             /*!< Points to the object. Must be 8 byte aligned. */,
+             const unsigned long size
+             /*!< Size of the object in bytes. Must be a multiple of 8. */)
+{
+ register unsigned long i;
+
+ for(i=0; i<size/8; i++)
+ {
+  ((unsigned long*) object)[i] = 0;
+ }
+}
+
+int
+allocate_thread(void)
+{
+ union thread* const thread = object_cache_allocate(&thread_cache);
+ register int        i;
+
+ if (0 == thread)
+ {
+  /* We return -1 to indicate that there are no available threads. */
+  return -1;
+ }
+
+ ticket_lock_acquire(&thread_table_lock);
+ i = find_free_entry((void***) &thread_table, &thread_table_size,
+                     &first_free_thread_index);
+ if ((-1 == i) || !grow_thread_scheduling_table())
+ {
+  ticket_lock_release(&thread_table_lock);
+  object_cache_free(&thread_cache, thread);
+  return -1;
+ }
+
+ clear_object(thread, sizeof(union thread));
+ clear_object(&thread_scheduling_table[i],
+              sizeof(struct thread_scheduling_data));
+ thread_scheduling_table[i].next = -1;
+ thread_scheduling_table[i].owner = -1;
+ thread_scheduling_table[i].priority = THREAD_PRIORITY_DEFAULT;
+ thread_scheduling_table[i].allowed_cpus = online_cpus;
+ thread->data.affinity = -1UL;
+ thread->data.base_priority = THREAD_PRIORITY_DEFAULT;
+ thread->data.waiting_for_mutex = -1;
+ thread_table[i] = thread;
+ ticket_lock_release(&thread_table_lock);
+ return i;
+}
+
+/*! Changes the state of a thread and updates its statistics. */
+static void
+change_thread_state(const int thread_index
+                    /*!< The index, into thread_table, of the thread. */,
+                    const int state
+                    /*!< One of the THREAD_STATE_ values. */,
+                    const int voluntary
+                    /*!< 1 if a running thread gives up the CPU by itself,
+                         0 if it is preempted. */)
+{
+ struct thread_scheduling_data* const scheduling_data =
+  &thread_scheduling_table[thread_index];
+ struct thread_statistics* const      statistics =
+  &thread_table[thread_index]->data.statistics;
+ const unsigned long                  now = rdtsc();
+ const unsigned long                  elapsed =
+  now - scheduling_data->state_timestamp;
+
+ switch(scheduling_data->state)
+ {
+  case THREAD_STATE_RUNNING:
+  {
+   statistics->on_cpu_cycles += elapsed;
+   if (voluntary)
+   {
+    statistics->voluntary_switches++;
+   }
+   else
+   {
+    statistics->involuntary_switches++;
+   }
+   break;
+  }
+
+  case THREAD_STATE_READY:
+  {
+   statistics->runnable_wait_cycles += elapsed;
+   break;
+  }
+
+  case THREAD_STATE_SLEEPING:
+  {
+   statistics->wakeups++;
+   scheduling_data->wakeup_timestamp = now;
+   break;
+  }
+
+  case THREAD_STATE_BLOCKED:
+  {
+   statistics->mutex_wait_cycles += elapsed;
+   break;
+  }
+ }
+
+ if ((THREAD_STATE_RUNNING == state) &&
+     (0 != scheduling_data->wakeup_timestamp))
+ {
+  /* Find the histogram bucket from the position of the highest set bit. */
+  const unsigned long latency = now - scheduling_data->wakeup_timestamp;
+  int                 bucket = (latency < 2) ?
+                               0 : 63 - __builtin_clzl(latency) - 11;
+
+  if (bucket < 0)
+  {
+   bucket = 0;
+  }
+  else if (bucket >= THREAD_STATISTICS_BUCKETS)
+  {
+   bucket = THREAD_STATISTICS_BUCKETS - 1;
+  }
+  statistics->wakeup_latency_histogram[bucket]++;
+  scheduling_data->wakeup_timestamp = 0;
+ }
+
+ scheduling_data->state = state;
+ scheduling_data->state_timestamp = now;
+}
+
+void
+set_thread_state(const int thread_index,
+                 const int state)
+{
+ /* A running thread only goes to sleep or blocks by itself. */
+ change_thread_state(thread_index, state,
+                     (THREAD_STATE_SLEEPING == state) ||
+                     (THREAD_STATE_BLOCKED == state));
+}
+
+void
+yield_thread(const int thread_index)
+{
+ struct mcs_node     node;
+ const unsigned long flags = mcs_lock_acquire_irqsave(&ready_queue_lock,
+                                                      &node);
+
+ change_thread_state(thread_index, THREAD_STATE_READY, 1);
+ thread_queue_enqueue(&ready_queue, thread_index);
+ mcs_lock_release_irqrestore(&ready_queue_lock, &node, flags);
+
+ /* The thread may not be allowed to run on this CPU. */
+ ipi_kick_idle_cpu(thread_index);
+}
+
+void
+wake_thread(const int thread_index)
+{
+ struct mcs_node     node;
+ const unsigned long flags = mcs_lock_acquire_irqsave(&ready_queue_lock,
+                                                      &node);
+
+ set_thread_state(thread_index, THREAD_STATE_READY);
+ thread_queue_enqueue(&ready_queue, thread_index);
+ mcs_lock_release_irqrestore(&ready_queue_lock, &node, flags);
+
+ ipi_kick_idle_cpu(thread_index);
+}
+
+void
+set_thread_priority(const int thread_index,
+                    const int priority)
+{
+ struct mcs_node     node;
+ const unsigned long flags = mcs_lock_acquire_irqsave(&ready_queue_lock,
+                                                      &node);
+
+ /* The ready queue keeps a thread at the priority it was enqueued with. */
+ if (THREAD_STATE_READY == thread_scheduling_table[thread_index].state)
+ {
+  thread_queue_remove(&ready_queue, thread_index);
+  thread_scheduling_table[thread_index].priority = priority;
+  thread_queue_enqueue(&ready_queue, thread_index);
+ }
+ else
+ {
+  thread_scheduling_table[thread_index].priority = priority;
+ }
+ mcs_lock_release_irqrestore(&ready_queue_lock, &node, flags);
+}
+
+void
+release_thread(const int thread_index)
+{
+ union thread* const thread = thread_table[thread_index];
+
+ /* The threads waiting for the mutexes of the thread get them. */
+ mutex_release_all(thread_index);
+
+ ticket_lock_acquire(&thread_table_lock);
+ thread_scheduling_table[thread_index].owner = -1;
+ thread_table[thread_index] = 0;
+
+ if (thread_index < first_free_thread_index)
+ {
+  first_free_thread_index = thread_index;
+ }
+ ticket_lock_release(&thread_table_lock);
+
+ object_cache_free(&thread_cache, thread);
+}
+
+int
+allocate_process(void)
+{
+ struct process* const process = object_cache_allocate(&process_cache);
+ register int          i;
+
+ if (0 == process)
+ {
+  return -1;
+ }
+
+ clear_object(process, sizeof(struct process));
+
+ ticket_lock_acquire(&process_table_lock);
+ i = find_free_entry((void***) &process_table, &process_table_size,
+                     &first_free_process_index);
+ if (-1 != i)
+ {
+  process_table[i] = process;
+ }
+ ticket_lock_release(&process_table_lock);
+
+ if (-1 == i)
+ {
+  object_cache_free(&process_cache, process);
+ }
+ return i;
+}
+
+void
+release_process(const int process_index)
+{
+ struct process* const process = process_table[process_index];
+
+ ticket_lock_acquire(&process_table_lock);
+ process_table[process_index] = 0;
+
+ if (process_index < first_free_process_index)
+ {
+  first_free_process_index = process_index;
+ }
+ ticket_lock_release(&process_table_lock);
+
+ object_cache_free(&process_cache, process);
+}
+
+/*! Does the bookkeeping needed when the CPU switches from one thread to
+    another. Called at the end of the system call and interrupt handlers if
+    the scheduler picked a new thread. */
+static void
+thread_switched(const int previous_thread_index
+                /*!< Index of the thread switched out. -1 if the CPU was
+                     idle. The thread may have terminated. */,
+                const int next_thread_index
+                /*!< Index of the thread switched in. -1 if the CPU goes
+                     idle. */)
+{
+ trace_event(TRACE_EVENT_CONTEXT_SWITCH, previous_thread_index,
+             next_thread_index);
+ pmu_switch_thread(previous_thread_index, next_thread_index);
+}
+
+/*! Ends a system call. The scheduler picks the thread to run. */
+static void
+finish_system_call(const int calling_thread_index
+                   /*!< Index of the thread that made the system call. */,
+                   const int schedule
+                   /*!< 1 iff scheduling decisions have to be remade. */)
+{
+ /* The thread is gone if it terminated. */
+ if (0 != thread_table[calling_thread_index])
+ {
+  trace_event(TRACE_EVENT_SYSCALL_EXIT, SYSCALL_ARGUMENTS.rax,
+              calling_thread_index);
+ }
+
+ cpu_private_data.preemptible = 0;
+ account_interrupts_disabled();
+
+ {
+  struct mcs_node     node;
+  const unsigned long flags = mcs_lock_acquire_irqsave(&ready_queue_lock,
+                                                       &node);
+
+  scheduler_called_from_system_call_handler(schedule);
+  mcs_lock_release_irqrestore(&ready_queue_lock, &node, flags);
+ }
+
+ if (calling_thread_index != cpu_private_data.thread_index)
+ {
+  thread_switched(calling_thread_index, cpu_private_data.thread_index);
+ }
 }
 
 extern void
 system_call_handler(void)
 {
  register int schedule = 0;
+ const int    calling_thread_index = cpu_private_data.thread_index;
 
  /* Reset the interrupt flag indicating that the context of the caller was
     saved by the system call routine. */
- thread_table[cpu_private_data.thread_index].data.registers.from_interrupt=0;
+ thread_table[cpu_private_data.thread_index]->data.registers.from_interrupt=0;
+
+ /* Interrupts may be taken at preemption points until the scheduler is
+    called. */
+ cpu_private_data.interrupts_disabled_timestamp = rdtsc();
+ cpu_private_data.preemptible = 1;
+
+ trace_event(TRACE_EVENT_SYSCALL_ENTER, SYSCALL_ARGUMENTS.rax,
+             calling_thread_index);
 
  switch(SYSCALL_ARGUMENTS.rax)
  {
@@ -479,71 +1115,13 @@ system_call_handler(void)
    schedule=1;
 
    /* And insert the thread into the timer queue. */
-
-   /* The timer queue is a linked list of threads. The head (first entry)
-      (thread) in the list has a list_data field that holds the number of
-      ticks to wait before the thread is made ready. The next entries (threads)
-      has a list_data field that holds the number of ticks to wait after the
-      previous thread is made ready. This is called to use a delta-time and
-      makes the code to test if threads should be made ready very quick. It
-      also, unfortunately, makes the code that insert code into the queue
-      rather complex. */
-
-   /* If the queue is empty put the thread as only entry. */
-   if (-1 == timer_queue_head)
-   {
-    thread_table[tmp_thread_index].data.next=-1;
-    thread_table[tmp_thread_index].data.list_data=timer_ticks;
-    timer_queue_head=tmp_thread_index;
-   }
-   else
    {
-    /* Check if the thread should be made ready before the head of the
-       previous timer queue. */
-    register int curr_timer_queue_entry=timer_queue_head;
+    const unsigned long flags =
+     ticket_lock_acquire_irqsave(&timer_queue_lock);
 
-    if (thread_table[curr_timer_queue_entry].data.list_data>timer_ticks)
-    {
-     /* If so set it up as the head in the new timer queue. */
-
-     thread_table[curr_timer_queue_entry].data.list_data-=timer_ticks;
-     thread_table[tmp_thread_index].data.next=curr_timer_queue_entry;
-     thread_table[tmp_thread_index].data.list_data=timer_ticks;
-     timer_queue_head=tmp_thread_index;
-    }
-    else
-    {
-     register int prev_timer_queue_entry = curr_timer_queue_entry;
-
-     /* Search until the end of the queue or until we found the right spot. */
-     while((-1 != thread_table[curr_timer_queue_entry].data.next) &&
-           (timer_ticks>=thread_table[curr_timer_queue_entry].data.list_data))
-     {
-      timer_ticks-=thread_table[curr_timer_queue_entry].data.list_data;
-      prev_timer_queue_entry=curr_timer_queue_entry;
-      curr_timer_queue_entry=thread_table[curr_timer_queue_entry].data.next;
-     }
-
-
-     if (timer_ticks>=thread_table[curr_timer_queue_entry].data.list_data)
-     {
-      /* Insert the thread into the queue after the existing entry. */
-      thread_table[tmp_thread_index].data.next=
-       thread_table[curr_timer_queue_entry].data.next;
-      thread_table[curr_timer_queue_entry].data.next=tmp_thread_index;
-      thread_table[tmp_thread_index].data.list_data=timer_ticks-
-       thread_table[curr_timer_queue_entry].data.list_data;
-     }
-     else
-     {
-      /* Insert the thread into the queue before the existing entry. */
-      thread_table[tmp_thread_index].data.next=
-       curr_timer_queue_entry;
-      thread_table[prev_timer_queue_entry].data.next=tmp_thread_index;
-      thread_table[tmp_thread_index].data.list_data=timer_ticks;
-      thread_table[curr_timer_queue_entry].data.list_data-=timer_ticks;
-     }
-    }
+    set_thread_state(tmp_thread_index, THREAD_STATE_SLEEPING);
+    timer_queue_insert(tmp_thread_index, timer_ticks);
+    ticket_lock_release_irqrestore(&timer_queue_lock, flags);
    }
    break;
   }
@@ -562,57 +1140,147 @@ system_call_handler(void)
   }
  }
 
- scheduler_called_from_system_call_handler(schedule);
+ finish_system_call(calling_thread_index, schedule);
+}
+
+int
+system_call_faulted(const unsigned long fault_address)
+{
+ /* System calls are preemptible until the scheduler is called. The flag is
+    cleared while interrupts are taken at a preemption point. */
+ return cpu_private_data.preemptible &&
+        is_user_range((const void*) fault_address, 1);
+}
+
+extern void
+abort_system_call(void)
+{
+ SYSCALL_ARGUMENTS.rax = ERROR;
+ finish_system_call(cpu_private_data.thread_index, 0);
 }
 
 extern void
 timer_interrupt_handler(void)
 {
- register int thread_changed=0;
+ register int    thread_changed=0;
  /*!< Interrupt hander code may set this variable to 0. The variable is
       used as input to the scheduler to indicate if the interrupt code has
       updated scheduling data structures. */
+ const int           interrupted_thread_index =
+  cpu_private_data.thread_index;
+ const unsigned long entry_timestamp = rdtsc();
+ struct mcs_node     node;
+
+ profile_sample(interrupted_thread_index);
+
+ /* When the profiler runs the timer interrupts more often than once per
+    clock tick. Only the last interrupt of a clock tick advances time. */
+ if (0 != --timer_interrupts_left)
+ {
+  end_of_interrupt(entry_timestamp);
+  return;
+ }
+ timer_interrupts_left = timer_interrupts_per_tick;
 
  /* Increment system time. */
  system_time++;
 
+ /* Interrupts are disabled in the handler. The timer queue lock is taken
+    before the ready queue lock. */
+ ticket_lock_acquire(&timer_queue_lock);
+ mcs_lock_acquire(&ready_queue_lock, &node);
+
  /* Check if there are any thread that we should make ready.
     First check if there are any threads at all in the timer
     queue. */
  if (-1 != timer_queue_head)
  {
-  /* Then decrement the list_data in the head. */
-  thread_table[timer_queue_head].data.list_data-=1;
-
-  /* Then remove all elements including with a list_data equal to zero
-     and insert them into the ready queue. These are the threads that
-     should be woken up. */
-  while((-1 != timer_queue_head) &&
-        /* We remove all entries less than or equal to 0. Equality should be
-           enough but checking with less than or equal may hide the symptoms
-           of some bugs and make the system more stable. */
-        (thread_table[timer_queue_head].data.list_data<=0))
-  {
-   register int tmp_thread_index=timer_queue_head;
-   /* Remove the head element.*/
-   timer_queue_head=thread_table[tmp_thread_index].data.next;
+  register int tmp_thread_index;
+  register int woken_threads=0;
+
+  timer_queue_tick();
 
-   /* Let the woken thread run if the CPU is not running any thread. */
-   if (-1 == cpu_private_data.thread_index)
+  /* Then remove the threads that should be woken up and insert them into
+     the ready queue. */
+  while(-1 != (tmp_thread_index=timer_queue_remove_expired()))
+  {
+   /* Let the woken thread run if the CPU is not running any thread and
+      the thread may run on the CPU. */
+   if ((-1 == cpu_private_data.thread_index) &&
+       (0 != (thread_scheduling_table[tmp_thread_index].allowed_cpus &
+              (1UL << cpu_private_data.cpu_index))))
    {
     cpu_private_data.thread_index = tmp_thread_index;
+    set_thread_state(tmp_thread_index, THREAD_STATE_RUNNING);
     thread_changed=1;
    }
    else
    {
     /* Or insert it into the ready queue. */
+    set_thread_state(tmp_thread_index, THREAD_STATE_READY);
     thread_queue_enqueue(&ready_queue, tmp_thread_index);
+    ipi_kick_idle_cpu(tmp_thread_index);
    }
+
+   trace_event(TRACE_EVENT_WAKEUP, tmp_thread_index,
+               tmp_thread_index == cpu_private_data.thread_index);
+   woken_threads++;
+  }
+
+  if (0 != woken_threads)
+  {
+   trace_event(TRACE_EVENT_TIMER_EXPIRY, system_time, woken_threads);
   }
  }
+ ticket_lock_release(&timer_queue_lock);
 
  scheduler_called_from_timer_interrupt_handler(thread_changed);
+ mcs_lock_release(&ready_queue_lock, &node);
+
+ /* The interrupt ended the wait of the idle CPU. */
+ if ((-1 == interrupted_thread_index) &&
+     (-1 != cpu_private_data.thread_index))
+ {
+  idle_woken_by_timer(entry_timestamp);
+ }
+
+ if (interrupted_thread_index != cpu_private_data.thread_index)
+ {
+  thread_switched(interrupted_thread_index, cpu_private_data.thread_index);
+ }
 
  /* Acknowledge interrupt so that new interrupts can be sent to the CPU. */
- outb(0x20, 0x20);
+ end_of_interrupt(entry_timestamp);
+}
+
+void
+schedule_idle_cpu(void)
+{
+ struct mcs_node node;
+
+ /* A CPU that runs a thread picks up the new thread when it next calls the
+    scheduler. */
+ if (-1 != cpu_private_data.thread_index)
+ {
+  return;
+ }
+
+ mcs_lock_acquire(&ready_queue_lock, &node);
+ scheduler_called_from_system_call_handler(1);
+ mcs_lock_release(&ready_queue_lock, &node);
+
+ if (-1 != cpu_private_data.thread_index)
+ {
+  thread_switched(-1, cpu_private_data.thread_index);
+ }
+}
+
+extern void
+reschedule_interrupt_handler(void)
+{
+ const unsigned long entry_timestamp = rdtsc();
+
+ idle_woken();
+ schedule_idle_cpu();
+ end_of_interrupt(entry_timestamp);
 }
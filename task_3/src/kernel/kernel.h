@@ -12,7 +12,7 @@
 
 /* Macros */
 
-#define SYSCALL_ARGUMENTS (thread_table[cpu_private_data.thread_index].\
+#define SYSCALL_ARGUMENTS (thread_table[cpu_private_data.thread_index]->\
                            data.registers.integer_registers)
 /*!< Macro used in the system call switch to access the arguments to the 
      system call. */
@@ -20,10 +20,11 @@
 #define KERNEL_VERSION        (0x0000000100000000)
 /*!< Kernel version number. */
 
-#define MAX_NUMBER_OF_PROCESSES (16)
-/*!< Size of the process_table. */
-#define MAX_NUMBER_OF_THREADS   (256)
-/*!< Size of the thread_table. */
+#define MAX_NUMBER_OF_EXECUTABLES (16)
+/*!< Size of the executable_table. */
+#define MAX_NUMBER_OF_CPUS      (8)
+/*!< The largest number of CPUs the kernel can handle. Data that is private to
+     a CPU is kept in arrays of this size. */
 
 /* Type declarations */
 
@@ -62,7 +63,26 @@ struct context
       Set to 0 otherwise. */
 };
 
-/*! Defines a thread. */
+#define PMU_MAX_COUNTERS (8)
+/*!< The largest number of general purpose performance counters a thread can
+     use. */
+
+/*! Defines the performance counter state of a thread. The counters only
+    count while the thread executes in user mode. */
+struct pmu_context
+{
+ unsigned long event_select[PMU_MAX_COUNTERS];
+                                /*!< The value of the event select MSR of
+                                     each counter. 0 if the counter is not used
+                                     by the thread. */
+ unsigned long counter[PMU_MAX_COUNTERS];
+                                /*!< The value of each counter when the thread
+                                     was switched out. */
+ unsigned int  counters_in_use; /*!< Bit i is set iff counter i is used. */
+};
+
+/*! Defines a thread. Only the context is kept here. The data used by the
+    scheduler is kept in thread_scheduling_table. */
 union thread
 {
  struct
@@ -70,22 +90,70 @@ union thread
   struct context registers;     /*!< The context of the thread. Note: the
                                      context of the thread could include more
                                      than the accessible registers. */
-  int            owner;         /*!< The index identifies the process that owns
-                                     this thread. The owner can be retrieved from
-                                     the process_table by using the index.  */
-  int            next;          /*!< This is an index into the thread_table.
+  struct pmu_context
+                 pmu;           /*!< The performance counters of the thread.
+                                     Saved and restored by pmu_switch_thread. */
+  struct thread_statistics
+                 statistics;    /*!< Updated by set_thread_state. */
+  unsigned long  affinity;      /*!< The CPUs the thread asked to run on.
+                                     Bit i allows CPU i. Set by the spawn and
+                                     setaffinity system calls. */
+  int            base_priority; /*!< The priority the thread was created
+                                     with. The priority in
+                                     thread_scheduling_table is higher while
+                                     the thread owns a mutex a thread of
+                                     higher priority waits for. */
+  int            waiting_for_mutex;
+                                /*!< Index, into mutex_table, of the mutex
+                                     the thread is blocked on. -1 if none. */
+ }               data;
+ char            padding[1024];
+};
+
+#define THREAD_STATE_NEW      (0)
+/*!< The thread has been allocated but has not been made ready. */
+#define THREAD_STATE_RUNNING  (1)
+/*!< The thread is executing on a CPU. */
+#define THREAD_STATE_READY    (2)
+/*!< The thread is in the ready queue. */
+#define THREAD_STATE_SLEEPING (3)
+/*!< The thread is in the timer queue. */
+#define THREAD_STATE_BLOCKED  (4)
+/*!< The thread waits in the queue of a mutex. */
+
+/*! Defines the data the scheduler keeps for a thread. The entry is aligned
+    to a cache line so that walking a linked list of threads touches one cache
+    line per thread and never the context. */
+struct thread_scheduling_data
+{
+ int            next;           /*!< This is an index into the thread_table.
                                      The index corresponds to the thread
                                      following this thread in a linked list.
                                      A thread can be in a number of linked
                                      lists. */
-  unsigned long  list_data;     /*!< This member variable has different
+ int            owner;          /*!< The index identifies the process that
+                                     owns this thread. The owner can be
+                                     retrieved from the process_table by using
+                                     the index. -1 if the entry is unused. */
+ int            state;          /*!< One of the THREAD_STATE_ values. */
+ int            priority;       /*!< The scheduling priority of the thread.
+                                     0 to THREAD_PRIORITIES-1, higher runs
+                                     first. */
+ unsigned long  list_data;      /*!< This member variable has different
                                      meaning depending on what list the thread
                                      resides in. In the timer queue this
                                      variable is either an absolute time or a
                                      delta time.*/
- }               data;
- char            padding[1024];
-};
+ unsigned long  allowed_cpus;   /*!< Bit i is set if the thread may run on
+                                     CPU i. The affinity of the thread
+                                     limited to the cpuset of its owner. Set
+                                     by update_allowed_cpus. */
+ unsigned long  state_timestamp;/*!< The time stamp counter when the state
+                                     last changed. */
+ unsigned long  wakeup_timestamp;
+                                /*!< The time stamp counter when the thread
+                                     was woken up. 0 once it runs. */
+} __attribute__((aligned(64)));
 
 /*! Defines a process. */
 struct process
@@ -94,6 +162,39 @@ struct process
                                       process. */
  int             parent;         /*!< This is an index into process_table. The
                                       index corresponds to the parent process. */
+ unsigned long   page_table_root;/*!< The physical address of the PML4 of the
+                                      page table of the process. */
+ const struct Elf64_Ehdr*
+                 elf_image;      /*!< The ELF image the process is loaded
+                                      from. Pages are copied from it when the
+                                      process first touches them. */
+ unsigned long   memory_footprint_size;
+                                 /*!< Size, in bytes, of the process image. */
+ unsigned long   resident_pages; /*!< The number of page frames holding
+                                      the process image. Mappings of the zero
+                                      page and of pages shared with the
+                                      executable template are not counted. */
+ unsigned long   creation_time_stamp;
+                                 /*!< The time stamp counter when the process
+                                      was created. */
+ unsigned long   launch_cycles;  /*!< The number of cycles it took to
+                                      prepare the process. */
+ unsigned long   first_instruction_cycles;
+                                 /*!< The number of cycles from the creation
+                                      of the process until its first
+                                      instruction ran. 0 until then. */
+ int             pcid;           /*!< The process-context identifier used
+                                      when the page table is loaded. PCIDs are
+                                      shared when there are more than 4095
+                                      processes. */
+ int             executable;     /*!< Index, into executable_table, of the
+                                      program the process runs. */
+ unsigned long   load_offset;    /*!< Offset, from USER_SPACE_START, of the
+                                      address the image is loaded at. It is
+                                      page aligned. */
+ int             cpuset;         /*!< Index, into cpuset_table, of the
+                                      cpuset the process is attached to. 0 is
+                                      the root cpuset. */
 };
 
 /* ELF image structures. The names from the ELF64 specification are used and
@@ -161,15 +262,26 @@ struct Elf64_Phdr
  long p_filesz; /*!< The number of bytes the segment occupies in the
                      image. */
  long p_memsz;  /*!< The number of bytes the segment occupies in memory. */
- long p_align;  /*!< The alignment the segment should have in memory. This
-                     field is currently being ignored. */
+ long p_align;  /*!< The alignment the segment should have in memory.
+                     p_vaddr and p_offset are equal modulo p_align. */
 };
 
+/* Values used in e_type */
+#define ET_EXEC 2 /*!< The image is loaded at the addresses it is linked for. */
+#define ET_DYN  3 /*!< The image is position independent. It may be loaded
+                       at any address if it is relocated. */
 
 /* Values used in p_type */
-#define PT_NULL 0 /*!< The entry is not used. */
-#define PT_LOAD 1 /*!< The segment can be loaded into memory. */
-#define PT_PHDR 6 /*!< The segment only hold a program header table. */
+#define PT_NULL      0          /*!< The entry is not used. */
+#define PT_LOAD      1          /*!< The segment can be loaded into memory. */
+#define PT_DYNAMIC   2          /*!< The segment holds the dynamic section. */
+#define PT_INTERP    3          /*!< The image needs a dynamic linker. */
+#define PT_NOTE      4          /*!< The segment holds notes. */
+#define PT_PHDR      6          /*!< The segment only hold a program header
+                                     table. */
+#define PT_GNU_STACK 0x6474e551 /*!< Tells if the stack is executable. */
+#define PT_GNU_RELRO 0x6474e552 /*!< Part of a segment that may be made read
+                                     only after relocation. */
 
 /* Values used in p_flags */
 #define PF_X        0x1        /*!< Segment can be executed.*/
@@ -177,10 +289,59 @@ struct Elf64_Phdr
 #define PF_R        0x4        /*!< Segment can be read. */
 #define PF_MASKPERM 0x0000FFFF /*!< Used to mask the permission bits */
 
+/*! Defines an entry in the dynamic section. */
+struct Elf64_Dyn
+{
+ long          d_tag; /*!< The type of the entry. */
+ unsigned long d_val; /*!< A value or an address, depending on d_tag. */
+};
+
+/* Values used in d_tag */
+#define DT_NULL     0  /*!< Marks the end of the dynamic section. */
+#define DT_RELA     7  /*!< The address of the relocations with addends. */
+#define DT_RELASZ   8  /*!< The size, in bytes, of the DT_RELA relocations. */
+#define DT_RELAENT  9  /*!< The size, in bytes, of a DT_RELA relocation. */
+#define DT_REL      17 /*!< The address of the relocations without addends. */
+#define DT_JMPREL   23 /*!< The address of the PLT relocations. */
+
+/*! Defines a relocation with an addend. */
+struct Elf64_Rela
+{
+ unsigned long r_offset; /*!< The address of the word to relocate. */
+ unsigned long r_info;   /*!< The symbol and the type of the relocation. */
+ long          r_addend; /*!< The value added to the relocated word. */
+};
+
+#define ELF64_R_TYPE(info) ((info)&0xffffffff)
+/*!< Extracts the relocation type from r_info. */
+
+/* Relocation types */
+#define R_X86_64_NONE     0 /*!< Nothing is done. */
+#define R_X86_64_RELATIVE 8 /*!< The word is set to the load address plus the
+                                 addend. */
+
 /* Data structures describing the executable images embedded in the kernel
    image. */
 
-/*! Defines an executable program. */
+#define MAX_NUMBER_OF_SEGMENTS (8)
+/*!< The largest number of loadable segments in an executable. */
+
+/*! Describes a loadable segment of an executable program. */
+struct executable_segment
+{
+ unsigned long offset;      /*!< Offset of the segment bytes in the ELF
+                                 image. */
+ unsigned long address;     /*!< Offset, from the load address, of the
+                                 segment when loaded. */
+ unsigned long file_size;   /*!< The number of bytes copied from the ELF
+                                 image. */
+ unsigned long memory_size; /*!< The size of the segment in memory. Bytes
+                                 after file_size are zero filled. */
+ unsigned long flags;       /*!< The PF_ flags of the segment. */
+};
+
+/*! Defines an executable program. The description is made from the ELF
+    headers when the program is validated. */
 struct executable
 {
  const struct Elf64_Ehdr* elf_image;             /*!< The start of the ELF
@@ -188,22 +349,78 @@ struct executable
  unsigned long            memory_footprint_size; /*!< Size in bytes of the
                                                       program's memory foot
                                                       print when loaded. */
+ unsigned long            entry_point;           /*!< Offset, from the
+                                                      load address, of the
+                                                      first instruction. */
+ unsigned long            relocations;           /*!< Offset, in the ELF
+                                                      image, of the
+                                                      R_X86_64_RELATIVE
+                                                      relocations sorted on
+                                                      r_offset. */
+ unsigned long            number_of_relocations; /*!< The number of entries
+                                                      in relocations. */
+ int                      position_independent;  /*!< 1 if the image may be
+                                                      loaded at any page
+                                                      aligned address. */
+ int                      number_of_segments;    /*!< The number of entries
+                                                      in segments. */
+ struct executable_segment
+                          segments[MAX_NUMBER_OF_SEGMENTS];
+                                                 /*!< The loadable segments
+                                                      sorted on address. */
+};
+
+/* Multiboot structures. The names are taken from the multiboot
+   specification. */
+
+#define MULTIBOOT_FLAG_MEMORY (1<<0) /*!< mem_lower and mem_upper are valid. */
+#define MULTIBOOT_FLAG_MODS   (1<<3) /*!< mods_count and mods_addr are valid. */
+#define MULTIBOOT_FLAG_MMAP   (1<<6) /*!< mmap_length and mmap_addr are valid.
+                                      */
+
+#define MULTIBOOT_MEMORY_AVAILABLE (1) /*!< Type of memory map entries that
+                                            describe RAM the kernel may use. */
+
+/*! Defines the multiboot information structure passed by the boot loader.
+    Only the fields used by the kernel are named. */
+struct multiboot_information
+{
+ unsigned int flags;        /*!< Shows which of the other fields are valid. */
+ unsigned int mem_lower;    /*!< Kbytes of memory below 1 Mbyte. */
+ unsigned int mem_upper;    /*!< Kbytes of memory above 1 Mbyte, up to the
+                                 first hole. */
+ unsigned int boot_device;  /*!< Not used. */
+ unsigned int cmdline;      /*!< Not used. */
+ unsigned int mods_count;   /*!< The number of boot modules. */
+ unsigned int mods_addr;    /*!< Physical address of the first boot module
+                                 descriptor. */
+ unsigned int syms[4];      /*!< Not used. */
+ unsigned int mmap_length;  /*!< Size, in bytes, of the memory map. */
+ unsigned int mmap_addr;    /*!< Physical address of the memory map. */
 };
 
-/*! Defines an executable image embedded into the kernel image. The executable
-    images are linked together into a linked list. The linked list is built at
-    link time, see the kernel link script. */
-struct executable_image
+/*! Defines a boot module descriptor. The boot loader loads each module into
+    memory and passes an array of these. */
+struct multiboot_module
 {
- const struct executable_image* const next; /*!< Points to the next
-                                                 executable image. The last
-                                                 executable image in the list
-                                                 will have a next pointer
-                                                 equal to 0, i.e., null. */
- const struct Elf64_Ehdr              elf_image; /*!< The ELF image file 
-                                                      header. */
+ unsigned int mod_start;    /*!< Physical address of the first byte. */
+ unsigned int mod_end;      /*!< Physical address of the byte after the
+                                 last. */
+ unsigned int string;       /*!< Physical address of the module command
+                                 line. */
+ unsigned int reserved;     /*!< Not used. */
 };
 
+/*! Defines an entry in the multiboot memory map. The size field does not
+    count itself so the next entry starts size+4 bytes after the current. */
+struct multiboot_mmap_entry
+{
+ unsigned int  size;        /*!< Size of the entry, not counting this field. */
+ unsigned long base_addr;   /*!< Physical address of the first byte. */
+ unsigned long length;      /*!< Size, in bytes, of the region. */
+ unsigned int  type;        /*!< MULTIBOOT_MEMORY_AVAILABLE for usable RAM. */
+} __attribute__((packed));
+
 /*! Defines the structure pointed to by the kernel GS_BASE. Every CPU has one
     of these. */
 struct CPU_private
@@ -217,43 +434,92 @@ struct CPU_private
                                       has index -1. */
  int            ticks_left_of_time_slice;
                                  /*!< Can be used by a preemptive scheduler. */
+ unsigned long  page_table_switches_skipped;
+                                 /*!< The number of times a thread was
+                                      scheduled without loading cr3 because it
+                                      shares address space with the previously
+                                      running thread. */
+ union thread*  current_thread;  /*!< Points to the thread executing on the
+                                      CPU. Set when returning to user mode and
+                                      used by the assembly code entry paths to
+                                      save the context. */
+ int            cpu_index;       /*!< Index of the CPU into arrays holding
+                                      per-CPU data. */
+ unsigned long  interrupted_kernel_rip;
+                                 /*!< The instruction the last timer
+                                      interrupt of the idle thread interrupted.
+                                      Used by the profiler. */
+ int            preemptible;     /*!< 1 while the CPU runs a system call and
+                                      may take interrupts at preemption
+                                      points. */
+ unsigned long  interrupts_disabled_timestamp;
+                                 /*!< The time stamp counter when the system
+                                      call was entered or the last preemption
+                                      point was left. */
 };
 
 /* Variable declarations */
 
-extern union thread
-thread_table[MAX_NUMBER_OF_THREADS];
-/*!< Array holding all threads in the systems. */
+extern union thread**
+thread_table;
+/*!< Array holding pointers to all threads in the systems. A thread index is
+     an index into this array. Unused entries are 0. The threads are allocated
+     from thread_cache and the array grows when it is full. */
+
+extern int
+thread_table_size;
+/*!< The number of entries in thread_table. */
+
+extern struct thread_scheduling_data*
+thread_scheduling_table;
+/*!< Array holding the scheduling data of all threads. It is indexed by
+     thread index and has at least thread_table_size entries. */
 
-extern struct process
-process_table[MAX_NUMBER_OF_PROCESSES];
-/*!< Array holding all processes in the system. */
+extern struct process**
+process_table;
+/*!< Array holding pointers to all processes in the system. A process index
+     is an index into this array. Unused entries are 0. The processes are
+     allocated from process_cache and the array grows when it is full. */
+
+extern int
+process_table_size;
+/*!< The number of entries in process_table. */
+
+extern struct ticket_lock
+thread_table_lock;
+/*!< Protects thread_table, its size, the growth of thread_scheduling_table
+     and the allocation of threads. See lock.h for the lock order. */
+
+extern struct ticket_lock
+process_table_lock;
+/*!< Protects process_table, its size and the allocation of processes. */
 
 extern struct executable
-executable_table[MAX_NUMBER_OF_PROCESSES];
+executable_table[MAX_NUMBER_OF_EXECUTABLES];
 /*!< Array holding descriptions of all executable programs. */
 
 extern int
 executable_table_size;
 /*!< The number of executable programs in the executable_table */
 
-extern const struct executable_image*
-ELF_images_start;
-/*!< The first executable image in the linked list of executable images. */
-
-extern const char*
-ELF_images_end;
-/*!< The address of the first byte after the end of the last ELF image. This
-     variable is used for sanity checking. */
+extern const unsigned long
+executable_table_checksum;
+/*!< The checksum of executable_table computed when it was built. */
 
 extern unsigned long
 first_available_memory_byte;
-/*!< The address of the first memory byte not used by any running process.
-     This variable is used to implement a crude memory allocation scheme. */
+/*!< The address of the first memory byte after the kernel image. The page
+     frame allocator places its bookkeeping here. */
 
 extern unsigned long
 memory_size;
-/*!< Size, in bytes, of the memory. */
+/*!< The address of the first byte after the highest usable RAM region. It
+     is computed from the multiboot memory map. */
+
+extern unsigned long
+multiboot_information;
+/*!< Physical address of the multiboot information structure. Set by the
+     assembly code. */
 
 /*! \note Linked lists are terminated with a thread with a next index of -1. */
 
@@ -274,10 +540,23 @@ system_time;
      number of clock  ticks since system start. There are 200 clock ticks
      per second. */
 
+#define PIT_TICK_DIVISOR (5966)
+/*!< The divisor that makes the programmable interval timer interrupt 200
+     times a second. */
+
+extern int
+timer_interrupts_per_tick;
+/*!< The number of timer interrupts per clock tick. It is larger than 1 when
+     the profiler samples at a higher rate than the clock ticks. */
+
 extern struct CPU_private
 cpu_private_data;
 /*!< Holds data private to the CPU. */
 
+extern unsigned long
+online_cpus;
+/*!< Bit i is set if CPU i runs the kernel. Only the boot CPU does. */
+
 /* Function declarations */
 
 /*! Helper struct that is used to return values from prepare_process. */
@@ -286,12 +565,14 @@ struct prepare_process_return_value
  unsigned long first_instruction_address
   /*!< The address of the first instruction in the prepared process image. */;
  unsigned long page_table_address
-  /*!< Will not be used until databar assignment 4. */;
+  /*!< The physical address of the PML4 of the page table of the process. */;
 };
 
-/*! Copies an ELF image to memory and prepares a process. prepare_process
-    does some checks to avoid that corrupt images gets copied to memory.
-    However, the checks are not as thorough as the check in initialize.
+/*! Prepares a process to run an ELF image. Nothing is copied up front. The
+    pages of the image are installed by page_fault_handler when the process
+    first touches them. prepare_process does some checks to avoid that
+    corrupt images gets loaded. However, the checks are not as thorough as
+    the check in initialize.
     \return A prepare_process_return_value struct holding the first address
             of the process image and an address to the page table for
             the process. */
@@ -304,9 +585,26 @@ prepare_process(const struct Elf64_Ehdr* elf_image
                  /*!< Holds the maximum amount of memory, in bytes,
                       the image is allowed to use. */);
 
+/*! Creates a process with one thread that runs an executable and makes
+    the thread ready. The arguments are copied to the top of the stack of the
+    process and the thread starts with argc in rdi and argv in rsi. Used by
+    the createprocess and spawn system calls.
+    \return ALL_OK or ERROR if the executable or the arguments are bad or
+            resources are exhausted. */
+extern long
+spawn_process(const long               executable
+              /*!< Index, into executable_table, of the program to run. */,
+              const char* const* const argv
+              /*!< 0 terminated array of the arguments in the address space
+                   of the calling thread. 0 for no arguments. */,
+              const long               priority
+              /*!< The priority of the thread or SPAWN_INHERIT. */,
+              const unsigned long      affinity
+              /*!< The CPUs the thread may run on, 0 to inherit. */);
+
 /*! This is the last thing that is run when a process terminates. It performs
-    all cleanup activities. Right now it is empty but in assignment 4 it will,
-    for example, release the memory owned by the process. */
+    all cleanup activities such as releasing the memory owned by the
+    process. */
 extern void
 cleanup_process(const int process /*!< The index, into process_table, of the
                                        terminating process. */);
@@ -316,17 +614,92 @@ cleanup_process(const int process /*!< The index, into process_table, of the
 extern void
 initialize(void);
 
-/*! Allocate one thread. The allocated thread is not initialized.
-    Rip and rflags need to be set for the thread to start properly.
+/*! Programs the timer to interrupt a number of times per clock tick. The
+    system time still advances once per clock tick. With a local APIC only
+    the timer of the calling CPU is programmed. */
+extern void
+set_timer_interrupts_per_tick(const int interrupts_per_tick
+                              /*!< The number of timer interrupts per clock
+                                   tick. Must divide PIT_TICK_DIVISOR. */);
+
+/*! Changes the state of a thread and accounts the time spent in the old
+    state in the statistics of the thread. */
+extern void
+set_thread_state(const int thread_index
+                 /*!< The index, into thread_table, of the thread. */,
+                 const int state
+                 /*!< One of the THREAD_STATE_ values. */);
+
+/*! Moves the running thread to the tail of the ready queue. The caller has
+    to call the scheduler to pick the next thread. */
+extern void
+yield_thread(const int thread_index
+             /*!< The index, into thread_table, of the running thread. */);
+
+/*! Puts a blocked thread in the ready queue and wakes an idle CPU that may
+    run it. */
+extern void
+wake_thread(const int thread_index
+            /*!< The index, into thread_table, of the blocked thread. */);
+
+/*! Changes the scheduling priority of a thread that is not blocked. A
+    thread in the ready queue is moved to the queue of its new priority. */
+extern void
+set_thread_priority(const int thread_index
+                    /*!< The index, into thread_table, of the thread. */,
+                    const int priority
+                    /*!< The new priority. */);
+
+/*! \return 1 iff a range of addresses is in the user space. */
+extern int
+is_user_range(const void* const   address
+              /*!< The first address. */,
+              const unsigned long size
+              /*!< The size, in bytes, of the range. */);
+
+/*! Allocate one thread. The allocated thread is cleared, has the default
+    priority and may run on all CPUs. Owner, rip, rflags and the stack
+    need to be set for the thread to start properly.
     \return An index into thread_table or -1 if no thread could be allocated.*/
-extern inline int
+extern int
 allocate_thread(void);
 
+/*! Releases a thread allocated by allocate_thread. */
+extern void
+release_thread(const int thread_index
+               /*!< The index, into thread_table, of the thread. */);
+
+/*! Allocate one process. The allocated process is cleared.
+    \return An index into process_table or -1 if no process could be
+            allocated.*/
+extern int
+allocate_process(void);
+
+/*! Releases a process allocated by allocate_process. */
+extern void
+release_process(const int process_index
+                /*!< The index, into process_table, of the process. */);
+
 /*! This function gets called from the assembly code and responds to the
     system calls. */
 extern void
 system_call_handler(void);
 
+/*! Called from the page fault handler when a fault from the kernel could
+    not be resolved. \return 1 iff the fault is on user memory touched by a
+    system call, e.g., through a bad pointer argument. */
+extern int
+system_call_faulted(const unsigned long fault_address
+                    /*!< The address that caused the fault. */);
+
+/*! Ends a system call that took a page fault on user memory that could not
+    be resolved. The system call returns ERROR and the rest of it is
+    skipped. Called from the page fault handler on the top of the kernel
+    stack, which then returns to user mode. No lock may be held while a
+    system call touches user memory. */
+extern void
+abort_system_call(void);
+
 /*! This function gets called from the system call handler and implements
     system calls. The return value is not used until assignment 3. */
 extern int
@@ -337,12 +710,45 @@ system_call_implementation(void);
 extern void
 timer_interrupt_handler(void);
 
-/*! Outputs a string to the bochs console. */
+/*! Picks a thread from the ready queue if the calling CPU is idle. Called
+    when another CPU has made a thread ready that this CPU may run. */
+extern void
+schedule_idle_cpu(void);
+
+/*! Called from the interrupt handler when another CPU has made a thread
+    ready that this CPU may run. An idle CPU picks a thread from the ready
+    queue. */
+extern void
+reschedule_interrupt_handler(void);
+
+#define PRINTS_CHARACTERS_PER_PREEMPTION_POINT (64)
+/*!< kprints passes a preemption point each time it has printed this many
+     characters. */
+
+/*! Takes the interrupts that are pending if the CPU runs a system call.
+    Called between the steps of long kernel operations so that the time with
+    interrupts disabled is bounded. The interrupted thread keeps running, so
+    a thread woken by an interrupt is scheduled when the system call
+    returns. Must not be called with a lock held that an interrupt handler
+    takes, i.e., the timer queue lock or the ready queue lock. */
+extern void
+kernel_preemption_point(void);
+
+/*! Outputs a string to the bochs console. Strings longer than
+    PRINTS_CHARACTERS_PER_PREEMPTION_POINT pass preemption points. */
 extern void
 kprints(const char* const string
         /*!< points to a null terminated string */
         );
 
+/*! Outputs a string in the user space of the calling process to the bochs
+    console, as kprints does. Printing stops at the end of the user space.
+    \return ALL_OK or ERROR if the string does not start and end in the
+    user space. */
+extern int
+kprints_user(const char* const string
+             /*!< points to a null terminated string in the user space */);
+
 /*! Prints a long formatted as a hexadecimal number to the bochs console. */
 extern void
 kprinthex(const register long value
@@ -371,6 +777,22 @@ outb(const register unsigned short port_number,
  __asm volatile("outb %%al,%%dx" : : "d" (port_number), "a" (output_value));
 }
 
+/*! Wrapper for a byte in instruction. \return The byte read. */
+inline static unsigned char
+inb(const register unsigned short port_number)
+{
+ unsigned char input_value;
+ __asm volatile("inb %%dx,%%al" : "=a" (input_value) : "d" (port_number));
+ return input_value;
+}
+
+#define DEBUG_EXIT_PORT (0xf4)
+/*!< The port of the QEMU isa-debug-exit device. Writing a value v to it makes
+     QEMU exit with the status (v<<1)|1. Other machines ignore the write. */
+
+#define BOCHS_SHUTDOWN_PORT (0x8900)
+/*!< Writing the string "Shutdown" to this port powers off Bochs. */
+
 /*! Wrapper for a word out instruction. */
 inline static void
 outw(const register unsigned short port_number, 
@@ -379,4 +801,105 @@ outw(const register unsigned short port_number,
  __asm volatile("outw %%ax,%%dx" : : "d" (port_number), "a" (output_value));
 }
 
+/*! Wrapper for the cpuid instruction. \return The value of eax after cpuid
+    has been executed with the leaf passed in eax. */
+inline static unsigned int
+cpuid_eax(const register unsigned int leaf)
+{
+ unsigned int eax, ebx, ecx, edx;
+ __asm volatile("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) :
+                          "a" (leaf), "c" (0));
+ return eax;
+}
+
+/*! Wrapper for the cpuid instruction. \return The value of ebx after cpuid
+    has been executed with the leaf passed in eax. */
+inline static unsigned int
+cpuid_ebx(const register unsigned int leaf)
+{
+ unsigned int eax, ebx, ecx, edx;
+ __asm volatile("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) :
+                          "a" (leaf), "c" (0));
+ return ebx;
+}
+
+/*! Wrapper for the cpuid instruction. \return The value of ecx after cpuid
+    has been executed with the leaf passed in eax. */
+inline static unsigned int
+cpuid_ecx(const register unsigned int leaf)
+{
+ unsigned int eax, ebx, ecx, edx;
+ __asm volatile("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) :
+                          "a" (leaf), "c" (0));
+ return ecx;
+}
+
+/*! Wrapper for the cpuid instruction. \return The value of edx after cpuid
+    has been executed with the leaf passed in eax. */
+inline static unsigned int
+cpuid_edx(const register unsigned int leaf)
+{
+ unsigned int eax, ebx, ecx, edx;
+ __asm volatile("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) :
+                          "a" (leaf), "c" (0));
+ return edx;
+}
+
+/*! Wrapper for the rdtsc instruction. \return The time stamp counter. */
+inline static unsigned long
+rdtsc(void)
+{
+ unsigned int low, high;
+ __asm volatile("rdtsc" : "=a" (low), "=d" (high));
+ return (((unsigned long) high) << 32) | low;
+}
+
+/*! Invalidates the TLB entry of the page holding an address. */
+inline static void
+invlpg(const register unsigned long address)
+{
+ __asm volatile("invlpg (%0)" : : "r" (address) : "memory");
+}
+
+/*! Reads control register 4. */
+inline static unsigned long
+read_cr4(void)
+{
+ unsigned long value;
+ __asm volatile("mov %%cr4,%0" : "=r" (value));
+ return value;
+}
+
+/*! Writes control register 4. */
+inline static void
+write_cr4(const register unsigned long value)
+{
+ __asm volatile("mov %0,%%cr4" : : "r" (value) : "memory");
+}
+
+/*! Writes control register 3, i.e., loads a new page table. */
+inline static void
+write_cr3(const register unsigned long value)
+{
+ __asm volatile("mov %0,%%cr3" : : "r" (value) : "memory");
+}
+
+/*! Wrapper for the rdmsr instruction. \return The value of the MSR. */
+inline static unsigned long
+rdmsr(const register unsigned int msr)
+{
+ unsigned int low, high;
+ __asm volatile("rdmsr" : "=a" (low), "=d" (high) : "c" (msr));
+ return (((unsigned long) high) << 32) | low;
+}
+
+/*! Wrapper for the wrmsr instruction. */
+inline static void
+wrmsr(const register unsigned int  msr,
+      const register unsigned long value)
+{
+ __asm volatile("wrmsr" : : "c" (msr), "a" ((unsigned int) value),
+                            "d" ((unsigned int) (value >> 32)));
+}
+
 #endif
@@ -0,0 +1,267 @@
+/*! \file lock.c
+ * This file implements the kernel spin locks.
+ */
+
+#include "lock.h"
+
+/* Note: Look in lock.h for documentation of global variables and
+   functions. */
+
+/* Variables */
+
+/*! The statistics of the locks reported by lock_dump. */
+static struct lock_statistics*
+registered_locks[MAX_NUMBER_OF_LOCKS];
+
+/*! The number of entries used in registered_locks. */
+static int
+number_of_registered_locks = 0;
+
+/* Functions */
+
+/*! Tells the CPU that it is spinning. */
+static inline void
+cpu_relax(void)
+{
+ __asm volatile("pause" : : : "memory");
+}
+
+/*! Disables interrupts. \return The flags before they were disabled. */
+static inline unsigned long
+interrupts_save(void)
+{
+ unsigned long flags;
+
+ __asm volatile("pushfq\n\tpopq %0\n\tcli" : "=r" (flags) : : "memory");
+ return flags;
+}
+
+/*! Enables interrupts if they were enabled in the saved flags. */
+static inline void
+interrupts_restore(const unsigned long flags)
+{
+ if (0 != (flags & 0x200))
+ {
+  __asm volatile("sti" : : : "memory");
+ }
+}
+
+/*! Clears the statistics of a lock and registers them for lock_dump. */
+static void
+register_lock(struct lock_statistics* const statistics
+              /*!< Points to the statistics of the lock. */,
+              const char* const             name
+              /*!< The name of the lock. */)
+{
+ statistics->name = name;
+ statistics->acquisitions = 0;
+ statistics->contentions = 0;
+ statistics->wait_cycles = 0;
+ statistics->hold_cycles = 0;
+ statistics->max_hold_cycles = 0;
+
+ if (number_of_registered_locks < MAX_NUMBER_OF_LOCKS)
+ {
+  registered_locks[number_of_registered_locks++] = statistics;
+ }
+}
+
+/*! Accounts the time a lock was held. Called by the holder just before the
+    lock is released. */
+static inline void
+account_hold(struct lock_statistics* const statistics
+             /*!< Points to the statistics of the lock. */,
+             const unsigned long           acquired_timestamp
+             /*!< The time stamp counter when the lock was taken. */)
+{
+ const unsigned long hold_cycles = rdtsc() - acquired_timestamp;
+
+ statistics->hold_cycles += hold_cycles;
+ if (hold_cycles > statistics->max_hold_cycles)
+ {
+  statistics->max_hold_cycles = hold_cycles;
+ }
+}
+
+void
+ticket_lock_init(struct ticket_lock* const lock,
+                 const char* const         name)
+{
+ lock->next_ticket = 0;
+ lock->now_serving = 0;
+ lock->acquired_timestamp = 0;
+ register_lock(&lock->statistics, name);
+}
+
+void
+ticket_lock_acquire(struct ticket_lock* const lock)
+{
+ const unsigned int ticket =
+  __atomic_fetch_add(&lock->next_ticket, 1, __ATOMIC_RELAXED);
+
+ if (ticket != __atomic_load_n(&lock->now_serving, __ATOMIC_ACQUIRE))
+ {
+  const unsigned long start = rdtsc();
+
+  while (ticket != __atomic_load_n(&lock->now_serving, __ATOMIC_ACQUIRE))
+  {
+   cpu_relax();
+  }
+  lock->statistics.contentions++;
+  lock->statistics.wait_cycles += rdtsc() - start;
+ }
+
+ lock->statistics.acquisitions++;
+ lock->acquired_timestamp = rdtsc();
+}
+
+void
+ticket_lock_release(struct ticket_lock* const lock)
+{
+ account_hold(&lock->statistics, lock->acquired_timestamp);
+
+ /* Only the holder writes now_serving. */
+ __atomic_store_n(&lock->now_serving, lock->now_serving + 1,
+                  __ATOMIC_RELEASE);
+}
+
+unsigned long
+ticket_lock_acquire_irqsave(struct ticket_lock* const lock)
+{
+ const unsigned long flags = interrupts_save();
+
+ ticket_lock_acquire(lock);
+ return flags;
+}
+
+void
+ticket_lock_release_irqrestore(struct ticket_lock* const lock,
+                               const unsigned long       flags)
+{
+ ticket_lock_release(lock);
+ interrupts_restore(flags);
+}
+
+void
+mcs_lock_init(struct mcs_lock* const lock,
+              const char* const      name)
+{
+ lock->tail = 0;
+ lock->acquired_timestamp = 0;
+ register_lock(&lock->statistics, name);
+}
+
+void
+mcs_lock_acquire(struct mcs_lock* const lock,
+                 struct mcs_node* const node)
+{
+ struct mcs_node* previous;
+
+ node->next = 0;
+ node->locked = 1;
+
+ /* Join the queue. The lock is ours at once if the queue was empty. */
+ previous = __atomic_exchange_n(&lock->tail, node, __ATOMIC_ACQ_REL);
+ if (0 != previous)
+ {
+  const unsigned long start = rdtsc();
+
+  __atomic_store_n(&previous->next, node, __ATOMIC_RELEASE);
+  while (__atomic_load_n(&node->locked, __ATOMIC_ACQUIRE))
+  {
+   cpu_relax();
+  }
+  lock->statistics.contentions++;
+  lock->statistics.wait_cycles += rdtsc() - start;
+ }
+
+ lock->statistics.acquisitions++;
+ lock->acquired_timestamp = rdtsc();
+}
+
+void
+mcs_lock_release(struct mcs_lock* const lock,
+                 struct mcs_node* const node)
+{
+ struct mcs_node* next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+
+ account_hold(&lock->statistics, lock->acquired_timestamp);
+
+ if (0 == next)
+ {
+  struct mcs_node* expected = node;
+
+  /* Free the lock if no CPU is queued behind us. */
+  if (__atomic_compare_exchange_n(&lock->tail, &expected, 0, 0,
+                                  __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+  {
+   return;
+  }
+
+  /* A CPU is joining the queue. Wait until it has linked its node. */
+  while (0 == (next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE)))
+  {
+   cpu_relax();
+  }
+ }
+
+ /* Hand the lock to the next CPU. */
+ __atomic_store_n(&next->locked, 0, __ATOMIC_RELEASE);
+}
+
+unsigned long
+mcs_lock_acquire_irqsave(struct mcs_lock* const lock,
+                         struct mcs_node* const node)
+{
+ const unsigned long flags = interrupts_save();
+
+ mcs_lock_acquire(lock, node);
+ return flags;
+}
+
+void
+mcs_lock_release_irqrestore(struct mcs_lock* const lock,
+                            struct mcs_node* const node,
+                            const unsigned long    flags)
+{
+ mcs_lock_release(lock, node);
+ interrupts_restore(flags);
+}
+
+void
+lock_dump(void)
+{
+ register int i;
+
+ /* The statistics are read without taking the locks. A lock held while
+    they are cleared may count a few cycles too many or too few. */
+ for(i=0; i<number_of_registered_locks; i++)
+ {
+  struct lock_statistics* const statistics = registered_locks[i];
+
+  kprints("LOCK ");
+  kprints(statistics->name);
+  kprints(" ");
+  kprinthex(statistics->acquisitions);
+  kprints(" ");
+  kprinthex(statistics->contentions);
+  kprints(" ");
+  kprinthex(statistics->wait_cycles);
+  kprints(" ");
+  kprinthex(statistics->hold_cycles);
+  kprints(" ");
+  kprinthex(statistics->max_hold_cycles);
+  kprints("\n");
+
+  statistics->acquisitions = 0;
+  statistics->contentions = 0;
+  statistics->wait_cycles = 0;
+  statistics->hold_cycles = 0;
+  statistics->max_hold_cycles = 0;
+
+  /* No lock is held. The interrupt handlers only take the timer queue and
+     ready queue locks, and those statistics are printed and cleared with
+     interrupts disabled. */
+  kernel_preemption_point();
+ }
+}
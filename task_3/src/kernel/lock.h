@@ -0,0 +1,161 @@
+/*! \file lock.h
+ * This file defines the kernel spin locks. Ticket locks are small and fair
+ * and are used for structures that are seldom contended. MCS locks queue the
+ * waiting CPUs on nodes they own, so each waiter spins on its own cache line,
+ * and are used for the structures every system call touches. The _irqsave
+ * variants disable interrupts while the lock is held and are used for locks
+ * that are also taken by interrupt handlers.
+ *
+ * Each lock keeps statistics on how often it is taken, how often and how long
+ * CPUs wait for it and how long it is held. The statistics of all locks are
+ * written to the debug port by the lockstats system call.
+ *
+ * Each global kernel structure has its own lock. The locks are always taken
+ * in this order:
+ *
+ *  process table, cpusets, thread table, mutexes, timer queue, ready queue,
+ *  executable templates, object cache depots, page frames.
+ *
+ * first_available_memory_byte is only written by initialize_memory before
+ * other CPUs run and needs no lock.
+ */
+
+#ifndef _LOCK_H_
+#define _LOCK_H_
+
+#include "kernel.h"
+
+#define MAX_NUMBER_OF_LOCKS (16)
+/*!< The largest number of locks whose statistics are reported. Locks
+     initialized when the table is full still work but are not reported. */
+
+/*! Defines the statistics kept for a lock. Times are in time stamp counter
+    cycles. The statistics are only updated by the holder of the lock. */
+struct lock_statistics
+{
+ const char*   name;            /*!< The name reported by lock_dump. */
+ unsigned long acquisitions;    /*!< The number of times it was taken. */
+ unsigned long contentions;     /*!< The number of times a CPU had to wait
+                                     for it. */
+ unsigned long wait_cycles;     /*!< The time CPUs spent waiting for it. */
+ unsigned long hold_cycles;     /*!< The time it was held. */
+ unsigned long max_hold_cycles; /*!< The longest time it was held. */
+};
+
+/*! Defines a ticket lock. A CPU takes a ticket and waits until it is
+    served. */
+struct ticket_lock
+{
+ volatile unsigned int  next_ticket;
+                                /*!< The ticket the next CPU gets. */
+ volatile unsigned int  now_serving;
+                                /*!< The ticket of the holder. */
+ unsigned long          acquired_timestamp;
+                                /*!< The time stamp counter when the lock
+                                     was taken. */
+ struct lock_statistics statistics;
+                                /*!< The statistics of the lock. */
+} __attribute__((aligned(64)));
+
+/*! Defines the queue node a CPU uses while it waits for or holds an MCS
+    lock. The node is usually kept on the stack of the caller. */
+struct mcs_node
+{
+ struct mcs_node* volatile next;/*!< The next CPU in the queue. */
+ volatile int              locked;
+                                /*!< 1 while the CPU has to wait. */
+};
+
+/*! Defines an MCS queue lock. */
+struct mcs_lock
+{
+ struct mcs_node*       tail;   /*!< The last CPU in the queue, 0 if the
+                                     lock is free. */
+ unsigned long          acquired_timestamp;
+                                /*!< The time stamp counter when the lock
+                                     was taken. */
+ struct lock_statistics statistics;
+                                /*!< The statistics of the lock. */
+} __attribute__((aligned(64)));
+
+/* Function declarations */
+
+/*! Initializes a free ticket lock and registers it for lock_dump. */
+extern void
+ticket_lock_init(struct ticket_lock* const lock
+                 /*!< Points to the lock. */,
+                 const char* const         name
+                 /*!< The name of the lock. */);
+
+/*! Takes a ticket lock, spinning until it is free. */
+extern void
+ticket_lock_acquire(struct ticket_lock* const lock
+                    /*!< Points to the lock. */);
+
+/*! Releases a ticket lock taken with ticket_lock_acquire. */
+extern void
+ticket_lock_release(struct ticket_lock* const lock
+                    /*!< Points to the lock. */);
+
+/*! Disables interrupts and takes a ticket lock.
+    \return The flags to pass to ticket_lock_release_irqrestore. */
+extern unsigned long
+ticket_lock_acquire_irqsave(struct ticket_lock* const lock
+                            /*!< Points to the lock. */);
+
+/*! Releases a ticket lock and enables interrupts if they were enabled when
+    it was taken. */
+extern void
+ticket_lock_release_irqrestore(struct ticket_lock* const lock
+                               /*!< Points to the lock. */,
+                               const unsigned long       flags
+                               /*!< Returned by
+                                    ticket_lock_acquire_irqsave. */);
+
+/*! Initializes a free MCS lock and registers it for lock_dump. */
+extern void
+mcs_lock_init(struct mcs_lock* const lock
+              /*!< Points to the lock. */,
+              const char* const      name
+              /*!< The name of the lock. */);
+
+/*! Takes an MCS lock, spinning on the node until it is free. */
+extern void
+mcs_lock_acquire(struct mcs_lock* const lock
+                 /*!< Points to the lock. */,
+                 struct mcs_node* const node
+                 /*!< The node of the caller. Has to stay valid until the
+                      lock is released. */);
+
+/*! Releases an MCS lock taken with mcs_lock_acquire. */
+extern void
+mcs_lock_release(struct mcs_lock* const lock
+                 /*!< Points to the lock. */,
+                 struct mcs_node* const node
+                 /*!< The node passed to mcs_lock_acquire. */);
+
+/*! Disables interrupts and takes an MCS lock.
+    \return The flags to pass to mcs_lock_release_irqrestore. */
+extern unsigned long
+mcs_lock_acquire_irqsave(struct mcs_lock* const lock
+                         /*!< Points to the lock. */,
+                         struct mcs_node* const node
+                         /*!< The node of the caller. */);
+
+/*! Releases an MCS lock and enables interrupts if they were enabled when it
+    was taken. */
+extern void
+mcs_lock_release_irqrestore(struct mcs_lock* const lock
+                            /*!< Points to the lock. */,
+                            struct mcs_node* const node
+                            /*!< The node passed to
+                                 mcs_lock_acquire_irqsave. */,
+                            const unsigned long    flags
+                            /*!< Returned by mcs_lock_acquire_irqsave. */);
+
+/*! Writes the statistics of all registered locks to the debug port and
+    clears them. A preemption point is passed after each lock. */
+extern void
+lock_dump(void);
+
+#endif
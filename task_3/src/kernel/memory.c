@@ -0,0 +1,299 @@
+/*! \file memory.c
+ * This file implements the page frame allocator. Page frames are tracked in a
+ * bitmap with one bit per frame. A set bit means that the frame is in use or
+ * is not RAM.
+ */
+
+#include "memory.h"
+#include "paging.h"
+#include "lock.h"
+
+/* Note: Look in memory.h for documentation of global variables and
+   functions. */
+
+/* Variables */
+
+unsigned long
+free_page_frames = 0;
+
+unsigned long
+multiboot_information;
+
+/*! The bitmap holding one bit per page frame. */
+static unsigned long*
+frame_bitmap;
+
+/*! The number of page frames described by frame_bitmap. */
+static unsigned long
+number_of_frames;
+
+/*! The index, into frame_bitmap, of the first word that may have a free
+    frame. Used to speed up single frame allocations. */
+static unsigned long
+first_free_word = 0;
+
+/*! Protects the bitmap, first_free_word and free_page_frames. */
+static struct mcs_lock
+page_frame_lock;
+
+/* Function definitions */
+
+/*! \return 1 iff the frame is in use. */
+static inline int
+frame_is_used(const unsigned long frame)
+{
+ return 0 != (frame_bitmap[frame/64] & (1UL << (frame%64)));
+}
+
+/*! Marks a range of frames as used or free. The range may extend beyond the
+    end of the bitmap. */
+static void
+mark_frames(unsigned long       first_frame
+            /*!< The first frame in the range. */,
+            const unsigned long end_frame
+            /*!< The frame after the last frame in the range. */,
+            const int           used
+            /*!< 1 if the frames should be marked as used, 0 if free. */)
+{
+ for(; (first_frame<end_frame) && (first_frame<number_of_frames);
+     first_frame++)
+ {
+  if (used)
+  {
+   frame_bitmap[first_frame/64] |= 1UL << (first_frame%64);
+  }
+  else
+  {
+   frame_bitmap[first_frame/64] &= ~(1UL << (first_frame%64));
+  }
+ }
+}
+
+void
+initialize_memory(void)
+{
+ const struct multiboot_information* const info =
+  (const struct multiboot_information*) multiboot_information;
+ const struct multiboot_mmap_entry*        entry;
+ unsigned long                             bitmap_words;
+ unsigned long                             frame;
+
+ mcs_lock_init(&page_frame_lock, "page_frames");
+
+ /* First find the end of the highest usable RAM region. Fall back to the
+    size of upper memory if the boot loader did not pass a memory map. */
+ memory_size = 0;
+ if (info->flags & MULTIBOOT_FLAG_MMAP)
+ {
+  for(entry = (const struct multiboot_mmap_entry*) (unsigned long)
+              info->mmap_addr;
+      ((unsigned long) entry) < info->mmap_addr + info->mmap_length;
+      entry = (const struct multiboot_mmap_entry*)
+              (((const char*) entry) + entry->size + 4))
+  {
+   if ((MULTIBOOT_MEMORY_AVAILABLE == entry->type) &&
+       (entry->base_addr + entry->length > memory_size))
+   {
+    memory_size = entry->base_addr + entry->length;
+   }
+  }
+ }
+ else if (info->flags & MULTIBOOT_FLAG_MEMORY)
+ {
+  memory_size = 0x100000 + ((unsigned long) info->mem_upper)*1024;
+ }
+
+ if (memory_size > MAX_MEMORY_SIZE)
+ {
+  memory_size = MAX_MEMORY_SIZE;
+ }
+ memory_size &= -PAGE_SIZE;
+
+ /* Boot modules are usually loaded right after the kernel image. Move the
+    first available byte past them so that the bitmap does not overwrite
+    them. */
+ if (info->flags & MULTIBOOT_FLAG_MODS)
+ {
+  const struct multiboot_module* const module =
+   (const struct multiboot_module*) (unsigned long) info->mods_addr;
+  unsigned int                         i;
+
+  for(i=0; i<info->mods_count; i++)
+  {
+   if ((module[i].mod_end > first_available_memory_byte) &&
+       (module[i].mod_start < memory_size))
+   {
+    first_available_memory_byte = module[i].mod_end;
+   }
+  }
+  first_available_memory_byte = (first_available_memory_byte + 7) & -8;
+ }
+
+ /* Place the bitmap after the kernel image. Every frame starts out used. */
+ number_of_frames = memory_size/PAGE_SIZE;
+ bitmap_words = (number_of_frames + 63)/64;
+ frame_bitmap = (unsigned long*) first_available_memory_byte;
+ for(frame=0; frame<bitmap_words; frame++)
+ {
+  frame_bitmap[frame] = ~0UL;
+ }
+
+ /* Then release the usable RAM regions. Partial frames are not used. */
+ if (info->flags & MULTIBOOT_FLAG_MMAP)
+ {
+  for(entry = (const struct multiboot_mmap_entry*) (unsigned long)
+              info->mmap_addr;
+      ((unsigned long) entry) < info->mmap_addr + info->mmap_length;
+      entry = (const struct multiboot_mmap_entry*)
+              (((const char*) entry) + entry->size + 4))
+  {
+   if (MULTIBOOT_MEMORY_AVAILABLE == entry->type)
+   {
+    mark_frames((entry->base_addr + PAGE_SIZE - 1)/PAGE_SIZE,
+                (entry->base_addr + entry->length)/PAGE_SIZE,
+                0);
+   }
+  }
+ }
+ else
+ {
+  mark_frames(0x100000/PAGE_SIZE, number_of_frames, 0);
+ }
+
+ /* Everything up to the end of the bitmap holds the BIOS data, the kernel
+    image or the bitmap itself. The multiboot structures are kept as well. */
+ first_available_memory_byte += bitmap_words*8 + PAGE_SIZE - 1;
+ first_available_memory_byte &= -PAGE_SIZE;
+ mark_frames(0, first_available_memory_byte/PAGE_SIZE, 1);
+ mark_frames(multiboot_information/PAGE_SIZE,
+             (multiboot_information + sizeof(struct multiboot_information) +
+              PAGE_SIZE - 1)/PAGE_SIZE,
+             1);
+ if (info->flags & MULTIBOOT_FLAG_MMAP)
+ {
+  mark_frames(info->mmap_addr/PAGE_SIZE,
+              (((unsigned long) info->mmap_addr) + info->mmap_length +
+               PAGE_SIZE - 1)/PAGE_SIZE,
+              1);
+ }
+ if (info->flags & MULTIBOOT_FLAG_MODS)
+ {
+  /* The modules hold the executable images that are not part of the kernel
+     image. Processes are loaded from them so they are kept. */
+  const struct multiboot_module* const module =
+   (const struct multiboot_module*) (unsigned long) info->mods_addr;
+  unsigned int                         i;
+
+  mark_frames(info->mods_addr/PAGE_SIZE,
+              (((unsigned long) info->mods_addr) +
+               info->mods_count*sizeof(struct multiboot_module) +
+               PAGE_SIZE - 1)/PAGE_SIZE,
+              1);
+  for(i=0; i<info->mods_count; i++)
+  {
+   mark_frames(module[i].mod_start/PAGE_SIZE,
+               (((unsigned long) module[i].mod_end) + PAGE_SIZE - 1)/PAGE_SIZE,
+               1);
+  }
+ }
+
+ for(frame=0; frame<number_of_frames; frame++)
+ {
+  if (!frame_is_used(frame))
+  {
+   free_page_frames++;
+  }
+ }
+}
+
+/*! Does the work of allocate_page_frames. page_frame_lock has to be held.
+    \return The physical address of the first page frame or 0. */
+static unsigned long
+find_page_frames(const unsigned long count
+                 /*!< The number of page frames to allocate. */,
+                 const unsigned long alignment
+                 /*!< The alignment, in frames, of the first frame. */)
+{
+ unsigned long frame;
+
+ if ((1 == count) && (1 == alignment))
+ {
+  /* Single frames are the common case. Skip full words of the bitmap. */
+  unsigned long word;
+
+  for(word=first_free_word; word<(number_of_frames + 63)/64; word++)
+  {
+   if (~0UL != frame_bitmap[word])
+   {
+    frame = word*64 + __builtin_ctzl(~frame_bitmap[word]);
+    if (frame >= number_of_frames)
+    {
+     break;
+    }
+    first_free_word = word;
+    mark_frames(frame, frame+1, 1);
+    free_page_frames--;
+    return frame*PAGE_SIZE;
+   }
+  }
+  return 0;
+ }
+
+ /* Search for a long enough run of free frames. The search is first fit. */
+ frame = 0;
+ while (1)
+ {
+  unsigned long run;
+
+  frame = (frame + alignment - 1) & ~(alignment - 1);
+  if (frame + count > number_of_frames)
+  {
+   return 0;
+  }
+
+  for(run=0; (run<count) && !frame_is_used(frame+run); run++)
+  {
+  }
+
+  if (run == count)
+  {
+   mark_frames(frame, frame+count, 1);
+   free_page_frames -= count;
+   return frame*PAGE_SIZE;
+  }
+
+  /* Restart the search after the used frame. */
+  frame += run + 1;
+ }
+}
+
+unsigned long
+allocate_page_frames(const unsigned long count,
+                     const unsigned long alignment)
+{
+ struct mcs_node node;
+ unsigned long   address;
+
+ mcs_lock_acquire(&page_frame_lock, &node);
+ address = find_page_frames(count, alignment);
+ mcs_lock_release(&page_frame_lock, &node);
+ return address;
+}
+
+void
+release_page_frames(const unsigned long address,
+                    const unsigned long count)
+{
+ const unsigned long first_frame = address/PAGE_SIZE;
+ struct mcs_node     node;
+
+ mcs_lock_acquire(&page_frame_lock, &node);
+ mark_frames(first_frame, first_frame+count, 0);
+ free_page_frames += count;
+
+ if (first_frame/64 < first_free_word)
+ {
+  first_free_word = first_frame/64;
+ }
+ mcs_lock_release(&page_frame_lock, &node);
+}
@@ -0,0 +1,47 @@
+/*! \file memory.h
+ * This file defines the page frame allocator.
+ */
+
+#ifndef _MEMORY_H_
+#define _MEMORY_H_
+
+#include "kernel.h"
+
+#define MAX_MEMORY_SIZE (0x0000008000000000UL)
+/*!< The largest amount of memory the kernel can use. It is the amount of
+     memory that fits in the direct map, i.e., in the first PML4 entry. */
+
+/* Variable declarations */
+
+extern unsigned long
+free_page_frames;
+/*!< The number of page frames that are not allocated. */
+
+/* Function declarations */
+
+/*! Parses the multiboot memory map, sets memory_size and hands all usable
+    RAM to the page frame allocator. Frames below first_available_memory_byte
+    and the frames holding the allocator bookkeeping are never handed out.
+    Called from initialize before any memory is allocated. */
+extern void
+initialize_memory(void);
+
+/*! Allocates a number of contiguous page frames.
+    \return The physical address of the first page frame or 0 if there is no
+            free run of frames that is long enough. */
+extern unsigned long
+allocate_page_frames(const unsigned long count
+                     /*!< The number of page frames to allocate. */,
+                     const unsigned long alignment
+                     /*!< The first frame is aligned to this many frames. Must
+                          be a power of two. */);
+
+/*! Releases contiguous page frames previously allocated with
+    allocate_page_frames. */
+extern void
+release_page_frames(const unsigned long address
+                    /*!< Physical address of the first page frame. */,
+                    const unsigned long count
+                    /*!< The number of page frames to release. */);
+
+#endif
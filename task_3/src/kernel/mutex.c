@@ -0,0 +1,219 @@
+/*! \file mutex.c
+ * This file implements the priority inheritance mutexes.
+ */
+
+#include "mutex.h"
+#include "lock.h"
+
+/* Note: Look in mutex.h for documentation of global variables and
+   functions. */
+
+/* Variables */
+
+struct mutex
+mutex_table[MAX_NUMBER_OF_MUTEXES];
+
+/*! Protects mutex_table and the waiting_for_mutex and base_priority of the
+    threads. */
+static struct ticket_lock
+mutex_table_lock;
+
+/* Functions */
+
+void
+initialize_mutexes(void)
+{
+ register int i;
+
+ ticket_lock_init(&mutex_table_lock, "mutexes");
+ for(i=0; i<MAX_NUMBER_OF_MUTEXES; i++)
+ {
+  mutex_table[i].owner = -1;
+  thread_queue_init(&mutex_table[i].waiters);
+ }
+}
+
+/*! \return The priority of the first thread waiting for a mutex or -1 if
+    no thread waits. */
+static int
+highest_waiter_priority(const int mutex
+                        /*!< Index, into mutex_table, of the mutex. */)
+{
+ const int thread_index = thread_queue_head(&mutex_table[mutex].waiters);
+
+ return (-1 == thread_index) ?
+        -1 : thread_scheduling_table[thread_index].priority;
+}
+
+/*! Changes the priority of a thread. A thread blocked on a mutex is moved
+    to the queue of its new priority among the waiters. mutex_table_lock
+    has to be held. */
+static void
+change_priority(const int thread_index
+                /*!< The index, into thread_table, of the thread. */,
+                const int priority
+                /*!< The new priority. */)
+{
+ const int mutex = thread_table[thread_index]->data.waiting_for_mutex;
+
+ if (priority == thread_scheduling_table[thread_index].priority)
+ {
+  return;
+ }
+
+ if (-1 == mutex)
+ {
+  set_thread_priority(thread_index, priority);
+  return;
+ }
+
+ thread_queue_remove(&mutex_table[mutex].waiters, thread_index);
+ thread_scheduling_table[thread_index].priority = priority;
+ thread_queue_enqueue(&mutex_table[mutex].waiters, thread_index);
+}
+
+/*! Lends the priority of the first waiter of a mutex to its owner. If the
+    owner waits for a mutex the priority is lent on along the chain.
+    mutex_table_lock has to be held. */
+static void
+lend_priority(int mutex
+              /*!< Index, into mutex_table, of the mutex. */)
+{
+ register int i;
+
+ /* A chain holds each mutex at most once as mutex_lock refuses to close a
+    cycle. */
+ for(i=0; (i<MAX_NUMBER_OF_MUTEXES) && (-1 != mutex); i++)
+ {
+  const int owner = mutex_table[mutex].owner;
+  const int priority = highest_waiter_priority(mutex);
+
+  if (priority <= thread_scheduling_table[owner].priority)
+  {
+   return;
+  }
+  change_priority(owner, priority);
+  mutex = thread_table[owner]->data.waiting_for_mutex;
+ }
+}
+
+/*! Gives a mutex to its first waiter and makes the waiter ready, or frees
+    the mutex if no thread waits. mutex_table_lock has to be held. */
+static void
+hand_over(const int mutex
+          /*!< Index, into mutex_table, of the mutex. */)
+{
+ const int next = thread_queue_head(&mutex_table[mutex].waiters);
+
+ mutex_table[mutex].owner = next;
+ if (-1 == next)
+ {
+  return;
+ }
+
+ thread_queue_remove(&mutex_table[mutex].waiters, next);
+ thread_table[next]->data.waiting_for_mutex = -1;
+
+ /* The new owner is lent the priority of the threads still waiting. It is
+    in no queue so the priority is simply set. */
+ if (highest_waiter_priority(mutex) > thread_scheduling_table[next].priority)
+ {
+  thread_scheduling_table[next].priority = highest_waiter_priority(mutex);
+ }
+ wake_thread(next);
+}
+
+long
+mutex_lock(const int  thread_index,
+           const long mutex)
+{
+ register int i;
+ int          owner;
+
+ if ((mutex < 0) || (mutex >= MAX_NUMBER_OF_MUTEXES))
+ {
+  return ERROR;
+ }
+
+ ticket_lock_acquire(&mutex_table_lock);
+ if (-1 == mutex_table[mutex].owner)
+ {
+  mutex_table[mutex].owner = thread_index;
+  ticket_lock_release(&mutex_table_lock);
+  return ALL_OK;
+ }
+
+ /* Waiting would deadlock if the owner, or a thread it waits for through
+    the chain, is the calling thread. */
+ owner = mutex_table[mutex].owner;
+ for(i=0; (i<MAX_NUMBER_OF_MUTEXES) && (-1 != owner); i++)
+ {
+  const int waiting_for = thread_table[owner]->data.waiting_for_mutex;
+
+  if (owner == thread_index)
+  {
+   ticket_lock_release(&mutex_table_lock);
+   return ERROR;
+  }
+  owner = (-1 == waiting_for) ? -1 : mutex_table[waiting_for].owner;
+ }
+
+ set_thread_state(thread_index, THREAD_STATE_BLOCKED);
+ thread_table[thread_index]->data.waiting_for_mutex = mutex;
+ thread_queue_enqueue(&mutex_table[mutex].waiters, thread_index);
+ lend_priority(mutex);
+ ticket_lock_release(&mutex_table_lock);
+ return ALL_OK;
+}
+
+long
+mutex_unlock(const int  thread_index,
+             const long mutex)
+{
+ int          priority;
+ register int i;
+
+ if ((mutex < 0) || (mutex >= MAX_NUMBER_OF_MUTEXES))
+ {
+  return ERROR;
+ }
+
+ ticket_lock_acquire(&mutex_table_lock);
+ if (thread_index != mutex_table[mutex].owner)
+ {
+  ticket_lock_release(&mutex_table_lock);
+  return ERROR;
+ }
+
+ hand_over(mutex);
+
+ /* Keep what is lent through the mutexes the thread still owns. */
+ priority = thread_table[thread_index]->data.base_priority;
+ for(i=0; i<MAX_NUMBER_OF_MUTEXES; i++)
+ {
+  if ((thread_index == mutex_table[i].owner) &&
+      (highest_waiter_priority(i) > priority))
+  {
+   priority = highest_waiter_priority(i);
+  }
+ }
+ change_priority(thread_index, priority);
+ ticket_lock_release(&mutex_table_lock);
+ return ALL_OK;
+}
+
+void
+mutex_release_all(const int thread_index)
+{
+ register int i;
+
+ ticket_lock_acquire(&mutex_table_lock);
+ for(i=0; i<MAX_NUMBER_OF_MUTEXES; i++)
+ {
+  if (thread_index == mutex_table[i].owner)
+  {
+   hand_over(i);
+  }
+ }
+ ticket_lock_release(&mutex_table_lock);
+}
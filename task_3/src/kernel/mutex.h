@@ -0,0 +1,68 @@
+/*! \file mutex.h
+ * This file defines the priority inheritance mutexes user programs lock and
+ * unlock with system calls. A thread that blocks on a mutex lends its
+ * priority to the owner. If the owner is itself blocked on a mutex the
+ * priority is lent on to that owner and so on along the chain. A low
+ * priority owner is thus not kept off the CPU by threads of medium priority
+ * while a high priority thread waits for it.
+ *
+ * The priority in thread_scheduling_table is the highest of the base
+ * priority of the thread, kept in union thread, and the priorities of the
+ * threads waiting for the mutexes it owns.
+ */
+
+#ifndef _MUTEX_H_
+#define _MUTEX_H_
+
+#include "kernel.h"
+#include "threadqueue.h"
+
+/*! Defines a mutex. */
+struct mutex
+{
+ int                 owner;     /*!< Index, into thread_table, of the
+                                     thread that owns the mutex. -1 if it is
+                                     free. */
+ struct thread_queue waiters;   /*!< The threads blocked on the mutex. They
+                                     get it in priority order. */
+};
+
+/* Variable declarations */
+
+extern struct mutex
+mutex_table[MAX_NUMBER_OF_MUTEXES];
+/*!< Array holding all mutexes. */
+
+/* Function declarations */
+
+/*! Initializes the mutexes and their lock. Called from initialize. */
+extern void
+initialize_mutexes(void);
+
+/*! Implements the mutexlock system call. A thread that has to wait is
+    blocked and left in state THREAD_STATE_BLOCKED, and the caller has to
+    call the scheduler.
+    \return ALL_OK or ERROR if there is no such mutex or waiting would
+            deadlock. */
+extern long
+mutex_lock(const int  thread_index
+           /*!< The index, into thread_table, of the running thread. */,
+           const long mutex
+           /*!< Index, into mutex_table, of the mutex. */);
+
+/*! Implements the mutexunlock system call. The priority the thread was lent
+    through the mutex is taken back.
+    \return ALL_OK or ERROR if the thread does not own the mutex. */
+extern long
+mutex_unlock(const int  thread_index
+             /*!< The index, into thread_table, of the running thread. */,
+             const long mutex
+             /*!< Index, into mutex_table, of the mutex. */);
+
+/*! Unlocks the mutexes a terminating thread owns. Called from
+    release_thread. */
+extern void
+mutex_release_all(const int thread_index
+                  /*!< The index, into thread_table, of the thread. */);
+
+#endif
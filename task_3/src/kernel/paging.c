@@ -0,0 +1,1264 @@
+/*! \file paging.c
+ * This file implements the page tables of processes.
+ */
+
+#include "paging.h"
+#include "memory.h"
+#include "lock.h"
+#include "ipi.h"
+#include "idle.h"
+#include "trace.h"
+
+/* Note: Look in paging.h for documentation of global variables and
+   functions. */
+
+/* Variables */
+
+unsigned long
+kernel_page_table_root;
+
+int
+pcid_enabled = 0;
+
+unsigned long
+zero_page;
+
+/*! For each CPU and PCID, the page table root last loaded with that PCID. The
+    TLB of the CPU may hold entries tagged with the PCID that were created
+    from this page table and no other. 0 means that the TLB may hold stale
+    entries. */
+static unsigned long
+pcid_page_table_roots[MAX_NUMBER_OF_CPUS][4096];
+
+/*! The page table root loaded on each CPU. Read by other CPUs to decide
+    whether the CPU needs a TLB shootdown. */
+static volatile unsigned long
+cpu_page_table_roots[MAX_NUMBER_OF_CPUS];
+
+/*! Bit i is set if a TLB shootdown skipped CPU i while it was idle with the
+    address space loaded. The CPU reloads its page table before it returns
+    to user mode. */
+static volatile unsigned long
+stale_tlb_cpus = 0;
+
+/*! The template of each executable. It is a page directory mapping the
+    executable as it looks before it runs, with relocated pages and with the
+    writable pages mapped read-only. New processes copy its entries, so they
+    share its page tables and pages until they write. 0 until the executable
+    is first started. */
+static unsigned long
+executable_templates[MAX_NUMBER_OF_EXECUTABLES];
+
+/*! Protects executable_templates. Templates are built without the lock, as
+    building passes preemption points, and installed with it. */
+static struct ticket_lock
+executable_template_lock;
+
+/* Function definitions */
+
+/*! Records the page table loaded on the calling CPU. The store is ordered
+    before the loads that follow it, so a CPU changing the page table either
+    sees the new root or has its changes seen by this CPU. */
+static void
+set_loaded_page_table(const unsigned long page_table_root
+                      /*!< Physical address of the PML4. */)
+{
+ cpu_private_data.page_table_root = page_table_root;
+ cpu_page_table_roots[cpu_private_data.cpu_index] = page_table_root;
+ __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/*! Allocates and clears one page that can hold a level of a page table.
+    \return The physical address of the page or 0 if memory is exhausted. */
+static unsigned long
+allocate_page_table_page(void)
+{
+ unsigned long* const page = (unsigned long*) allocate_page_frames(1, 1);
+ register int         i;
+
+ if (0 == page)
+ {
+  return 0;
+ }
+
+ for(i=0; i<PAGE_SIZE/8; i++)
+ {
+  page[i]=0;
+ }
+
+ return (unsigned long) page;
+}
+
+/*! Allocates a page of the kernel page table. The kernel can not run
+    without it, so running out of memory is a panic.
+    \return The physical address of the cleared page. */
+static unsigned long*
+allocate_kernel_page_table_page(void)
+{
+ unsigned long* const page = (unsigned long*) allocate_page_table_page();
+
+ if (0 == page)
+ {
+  while (1)
+  {
+   kprints("Kernel panic! Can not allocate the kernel page table.\n");
+  }
+ }
+ return page;
+}
+
+/*! Builds the kernel page table. All memory is mapped one-to-one, using
+    pages of KERNEL_PAGE_KIB Kbytes, or 2 Mbyte pages if the CPU does not
+    support 1 Gbyte pages. The kernel image is part of this direct map.
+    \return The physical address of the PML4. */
+static unsigned long
+build_kernel_page_table(void)
+{
+ /* The direct map covers memory in whole gigabytes, at least one. */
+ const unsigned long direct_map_size = (memory_size + HUGE_PAGE_SIZE - 1) &
+                                       ~(HUGE_PAGE_SIZE - 1);
+ /* Check if the CPU supports 1 Gbyte pages. The flag is bit 26 of edx in
+    leaf 0x80000001. */
+ const unsigned long page_kib =
+  ((HUGE_PAGE_SIZE/1024 == KERNEL_PAGE_KIB) &&
+   (0 == (cpuid_edx(0x80000001) & (1<<26)))) ?
+  LARGE_PAGE_SIZE/1024 : KERNEL_PAGE_KIB;
+ unsigned long* const pml4 = allocate_kernel_page_table_page();
+ unsigned long* const pdpt = allocate_kernel_page_table_page();
+ unsigned long        address;
+
+ /* The user bit is not set so the kernel can only be accessed from
+    supervisor mode. */
+ pml4[0] = ((unsigned long) pdpt) | PTE_PRESENT | PTE_WRITABLE;
+
+ for(address=0; address<direct_map_size; address+=HUGE_PAGE_SIZE)
+ {
+  unsigned long* pd;
+  register int   i;
+
+  if (HUGE_PAGE_SIZE/1024 == page_kib)
+  {
+   pdpt[address/HUGE_PAGE_SIZE] = address | PTE_PRESENT | PTE_WRITABLE |
+                                  PTE_LARGE;
+   continue;
+  }
+
+  pd = allocate_kernel_page_table_page();
+  for(i=0; i<512; i++)
+  {
+   const unsigned long pd_address = address + i*LARGE_PAGE_SIZE;
+
+   if (LARGE_PAGE_SIZE/1024 == page_kib)
+   {
+    pd[i] = pd_address | PTE_PRESENT | PTE_WRITABLE | PTE_LARGE;
+   }
+   else
+   {
+    unsigned long* const pt = allocate_kernel_page_table_page();
+    register int         j;
+
+    for(j=0; j<512; j++)
+    {
+     pt[j] = (pd_address + j*PAGE_SIZE) | PTE_PRESENT | PTE_WRITABLE;
+    }
+    pd[i] = ((unsigned long) pt) | PTE_PRESENT | PTE_WRITABLE;
+   }
+  }
+  pdpt[address/HUGE_PAGE_SIZE] = ((unsigned long) pd) | PTE_PRESENT |
+                                 PTE_WRITABLE;
+ }
+
+ return (unsigned long) pml4;
+}
+
+void
+initialize_paging(void)
+{
+ ticket_lock_init(&executable_template_lock, "executable_templates");
+
+ /* Replace the boot page table. The new table maps the same memory, and
+    more, so the switch is invisible to the running code. */
+ kernel_page_table_root = build_kernel_page_table();
+ write_cr3(kernel_page_table_root);
+ set_loaded_page_table(kernel_page_table_root);
+
+ /* The zero page backs all untouched zero filled process memory. */
+ zero_page = allocate_page_table_page();
+ if (0 == zero_page)
+ {
+  while (1)
+  {
+   kprints("Kernel panic! Can not allocate the zero page.\n");
+  }
+ }
+
+ /* Check if the CPU supports PCIDs. The flag is bit 17 of ecx in leaf 1.
+    CR4.PCIDE may only be set when the low 12 bits of cr3 are zero which is
+    the case for the kernel page table. */
+ if (cpuid_ecx(1) & (1<<17))
+ {
+  write_cr4(read_cr4() | CR4_PCIDE);
+  pcid_enabled = 1;
+ }
+}
+
+void
+map_device_memory(const unsigned long physical_address,
+                  const unsigned long size)
+{
+ unsigned long* const pdpt = (unsigned long*)
+  (((unsigned long*) kernel_page_table_root)[0] & PTE_ADDRESS_MASK);
+ unsigned long        address;
+
+ /* The registers are mapped with 2 Mbyte pages. Entries that were not
+    present can not be in the TLB so nothing has to be flushed. */
+ for(address=physical_address & ~(LARGE_PAGE_SIZE - 1);
+     address<physical_address + size;
+     address+=LARGE_PAGE_SIZE)
+ {
+  unsigned long* const pdpt_entry = &pdpt[address/HUGE_PAGE_SIZE];
+  unsigned long*       pd;
+
+  if (0 == (*pdpt_entry & PTE_PRESENT))
+  {
+   const unsigned long new_pd = allocate_page_table_page();
+
+   if (0 == new_pd)
+   {
+    while (1)
+    {
+     kprints("Kernel panic! Can not map device memory.\n");
+    }
+   }
+   *pdpt_entry = new_pd | PTE_PRESENT | PTE_WRITABLE;
+  }
+  else if (0 != (*pdpt_entry & PTE_LARGE))
+  {
+   /* Part of the direct map. */
+   continue;
+  }
+
+  pd = (unsigned long*) (*pdpt_entry & PTE_ADDRESS_MASK);
+  if (0 == (pd[(address/LARGE_PAGE_SIZE)%512] & PTE_PRESENT))
+  {
+   pd[(address/LARGE_PAGE_SIZE)%512] = address | PTE_PRESENT | PTE_WRITABLE |
+                                        PTE_LARGE | PTE_WRITE_THROUGH |
+                                        PTE_CACHE_DISABLE | PTE_NO_EXECUTE;
+  }
+ }
+}
+
+unsigned long
+build_process_page_table(void)
+{
+ unsigned long* pml4;
+ unsigned long* pdpt;
+ unsigned long* pd;
+
+ pml4 = (unsigned long*) allocate_page_table_page();
+ if (0 == pml4)
+ {
+  return 0;
+ }
+
+ /* Share the kernel portion of the address space. The kernel PML4 entry is
+    supervisor only so the process can not touch kernel memory. */
+ pml4[0] = ((unsigned long*) kernel_page_table_root)[0];
+
+ /* Link in the levels as they are allocated so that a partially built page
+    table can be released. */
+ pdpt = (unsigned long*) allocate_page_table_page();
+ if (0 == pdpt)
+ {
+  release_process_page_table((unsigned long) pml4);
+  return 0;
+ }
+ pml4[USER_SPACE_START >> 39] = ((unsigned long) pdpt) |
+                                PTE_PRESENT | PTE_WRITABLE | PTE_USER;
+
+ pd = (unsigned long*) allocate_page_table_page();
+ if (0 == pd)
+ {
+  release_process_page_table((unsigned long) pml4);
+  return 0;
+ }
+ pdpt[0] = ((unsigned long) pd) | PTE_PRESENT | PTE_WRITABLE | PTE_USER;
+
+ /* The image itself is mapped by page_fault_handler as it is touched. */
+ return (unsigned long) pml4;
+}
+
+/*! \return A pointer to the page directory mapping the user space of the
+    page table. */
+static unsigned long*
+user_page_directory(const unsigned long page_table_root)
+{
+ const unsigned long* const pml4 = (const unsigned long*) page_table_root;
+ const unsigned long* const pdpt = (const unsigned long*)
+  (pml4[USER_SPACE_START >> 39] & PTE_ADDRESS_MASK);
+
+ return (unsigned long*) (pdpt[0] & PTE_ADDRESS_MASK);
+}
+
+/*! Releases a page directory mapping user space and the memory mapped by
+    it. Page tables and pages shared with a template, and the zero page, are
+    not released. */
+static void
+release_user_page_directory(unsigned long* const pd
+                            /*!< The page directory. */)
+{
+ register int i;
+
+ for(i=0; i<512; i++)
+ {
+  if ((0 == pd[i]) || (pd[i] & PTE_TEMPLATE))
+  {
+   continue;
+  }
+
+  if (pd[i] & PTE_LARGE)
+  {
+   /* Large pages map a 2 Mbyte frame directly. */
+   release_page_frames(pd[i] & PTE_ADDRESS_MASK,
+                       LARGE_PAGE_SIZE/PAGE_SIZE);
+  }
+  else
+  {
+   unsigned long* const pt = (unsigned long*) (pd[i] & PTE_ADDRESS_MASK);
+   register int         j;
+
+   for(j=0; j<512; j++)
+   {
+    /* The zero page is shared by all processes. */
+    if ((pt[j] & PTE_PRESENT) && (0 == (pt[j] & PTE_TEMPLATE)) &&
+        ((pt[j] & PTE_ADDRESS_MASK) != zero_page))
+    {
+     release_page_frames(pt[j] & PTE_ADDRESS_MASK, 1);
+    }
+   }
+   release_page_frames((unsigned long) pt, 1);
+  }
+ }
+ release_page_frames((unsigned long) pd, 1);
+}
+
+/*! Loads the kernel page table if a page table is loaded on the calling
+    CPU. */
+static void
+unload_page_table(void* const argument
+                  /*!< The physical address of the PML4. */)
+{
+ if ((unsigned long) argument == cpu_private_data.page_table_root)
+ {
+  write_cr3(kernel_page_table_root | (pcid_enabled ? CR3_NO_FLUSH : 0));
+  set_loaded_page_table(kernel_page_table_root);
+ }
+}
+
+void
+release_process_page_table(const unsigned long page_table_root)
+{
+ unsigned long* const pml4 = (unsigned long*) page_table_root;
+ unsigned long*       pdpt;
+ unsigned long        cpus = 0;
+ register int         i;
+
+ /* Do not keep a page table loaded that is about to be released. The
+    threads of the process have terminated but idle CPUs may still have it
+    loaded. */
+ unload_page_table((void*) page_table_root);
+ for(i=0; i<MAX_NUMBER_OF_CPUS; i++)
+ {
+  if (page_table_root == cpu_page_table_roots[i])
+  {
+   cpus |= 1UL << i;
+  }
+ }
+ ipi_call(IPI_CALL_FUNCTION, cpus, unload_page_table, (void*) page_table_root);
+
+ if (0 != pml4[USER_SPACE_START >> 39])
+ {
+  pdpt = (unsigned long*) (pml4[USER_SPACE_START >> 39] & PTE_ADDRESS_MASK);
+  if (0 != pdpt[0])
+  {
+   release_user_page_directory((unsigned long*)
+                               (pdpt[0] & PTE_ADDRESS_MASK));
+  }
+  release_page_frames((unsigned long) pdpt, 1);
+ }
+ release_page_frames(page_table_root, 1);
+}
+
+/*! \return The index of the first relocation of the executable whose
+    word ends after an offset in the image. */
+static unsigned long
+first_relocation_after(const struct executable* const executable
+                       /*!< The executable. */,
+                       const unsigned long            offset
+                       /*!< The offset, from the load address. */)
+{
+ const struct Elf64_Rela* const relocation = (const struct Elf64_Rela*)
+  (((const char*) executable->elf_image) + executable->relocations);
+ unsigned long                  low = 0;
+ unsigned long                  high = executable->number_of_relocations;
+
+ while (low < high)
+ {
+  const unsigned long middle = (low + high)/2;
+
+  if (relocation[middle].r_offset + 8 <= offset)
+  {
+   low = middle + 1;
+  }
+  else
+  {
+   high = middle;
+  }
+ }
+
+ return low;
+}
+
+/*! Finds the segments overlapping a region of the user space of a process.
+    \return The union of the PF_ flags of the segments, 0 if no segment
+    overlaps the region. */
+static unsigned long
+region_flags(const struct process* const process
+             /*!< The process. */,
+             const unsigned long         offset
+             /*!< The offset, from USER_SPACE_START, of the region. */,
+             const unsigned long         size
+             /*!< The size, in bytes, of the region. */,
+             int* const                  uniform
+             /*!< Set to 1 iff every byte of the region is in a segment and
+                  all those segments have the same flags. */)
+{
+ const struct executable* const executable =
+  &executable_table[process->executable];
+ unsigned long                  flags = 0;
+ unsigned long                  covered = 0;
+ register int                   i;
+
+ *uniform = 1;
+ for(i=0; i<executable->number_of_segments; i++)
+ {
+  const struct executable_segment* const segment = &executable->segments[i];
+  unsigned long start = process->load_offset + segment->address;
+  unsigned long end = start + segment->memory_size;
+
+  if (start < offset)
+  {
+   start = offset;
+  }
+  if (end > offset + size)
+  {
+   end = offset + size;
+  }
+
+  if (start < end)
+  {
+   if ((0 != covered) && (flags != segment->flags))
+   {
+    *uniform = 0;
+   }
+   flags |= segment->flags;
+   covered += end - start;
+  }
+ }
+
+ /* The stack is readable and writable. */
+ {
+  unsigned long start = USER_SPACE_SIZE - USER_STACK_SIZE;
+  unsigned long end = USER_SPACE_SIZE;
+
+  if (start < offset)
+  {
+   start = offset;
+  }
+  if (end > offset + size)
+  {
+   end = offset + size;
+  }
+
+  if (start < end)
+  {
+   if ((0 != covered) && (flags != (PF_R | PF_W)))
+   {
+    *uniform = 0;
+   }
+   flags |= PF_R | PF_W;
+   covered += end - start;
+  }
+ }
+
+ if (covered != size)
+ {
+  *uniform = 0;
+ }
+ return flags;
+}
+
+/*! \return The page table entry bits giving the access allowed by PF_
+    flags. */
+static unsigned long
+protection_bits(const unsigned long flags)
+{
+ return PTE_PRESENT | PTE_USER | ((flags & PF_W) ? PTE_WRITABLE : 0) |
+        ((flags & PF_X) ? 0 : PTE_NO_EXECUTE);
+}
+
+/*! \return 1 iff some byte in the region is backed by bytes in the ELF image
+    of the process or is relocated. Other bytes belong to the zero filled
+    part of a segment. */
+static int
+region_is_file_backed(const struct process* const process
+                      /*!< The process. */,
+                      const unsigned long         offset
+                      /*!< The offset, from USER_SPACE_START, of the
+                           region. */,
+                      const unsigned long         size
+                      /*!< The size, in bytes, of the region. */)
+{
+ const struct executable* const executable =
+  &executable_table[process->executable];
+ register int                   i;
+
+ for(i=0; i<executable->number_of_segments; i++)
+ {
+  const unsigned long start = process->load_offset +
+                              executable->segments[i].address;
+
+  if ((start < offset + size) &&
+      (start + executable->segments[i].file_size > offset))
+  {
+   return 1;
+  }
+ }
+
+ if (0 != executable->number_of_relocations)
+ {
+  const struct Elf64_Rela* const relocation = (const struct Elf64_Rela*)
+   (((const char*) executable->elf_image) + executable->relocations);
+  const unsigned long            index = first_relocation_after(
+   executable,
+   (offset > process->load_offset) ? offset - process->load_offset : 0);
+
+  if ((index < executable->number_of_relocations) &&
+      (process->load_offset + relocation[index].r_offset < offset + size))
+  {
+   return 1;
+  }
+ }
+
+ return 0;
+}
+
+/*! Fills a region of a process image. Bytes backed by the ELF image are
+    copied from it and all other bytes are set to zero. Then the relocations
+    of the region are applied. */
+static void
+fill_image_region(const struct process* const process
+                  /*!< The process. */,
+                  const unsigned long         destination
+                  /*!< Physical address of the memory to fill. */,
+                  const unsigned long         offset
+                  /*!< The offset, from USER_SPACE_START, of the region. */,
+                  const unsigned long         size
+                  /*!< The size, in bytes, of the region. Must be a multiple
+                       of 8. */)
+{
+ const struct executable* const executable =
+  &executable_table[process->executable];
+ register int                   i;
+
+ {
+  unsigned long* dst = (unsigned long*) destination;
+  unsigned long  count = size/8;
+
+  for(; count>0; count--)
+  {
+   *dst++=0;
+  }
+ }
+
+ for(i=0; i<executable->number_of_segments; i++)
+ {
+  /* Copy the part of the segment file bytes that overlaps the region. */
+  const struct executable_segment* const segment = &executable->segments[i];
+  const unsigned long segment_start = process->load_offset +
+                                      segment->address;
+  unsigned long       start = segment_start;
+  unsigned long       end = segment_start + segment->file_size;
+
+  if (start < offset)
+  {
+   start = offset;
+  }
+  if (end > offset + size)
+  {
+   end = offset + size;
+  }
+
+  if (start < end)
+  {
+   const char* src = ((const char*) process->elf_image) +
+                     segment->offset + (start - segment_start);
+   char*       dst = ((char*) destination) + (start - offset);
+
+   for(; start<end; start++)
+   {
+    *dst++=*src++;
+   }
+  }
+ }
+
+ if (0 != executable->number_of_relocations)
+ {
+  /* Relative relocations set a word to the load address plus an addend.
+     The words are sorted so only the ones in the region are visited. */
+  const struct Elf64_Rela* relocation = (const struct Elf64_Rela*)
+   (((const char*) executable->elf_image) + executable->relocations);
+  const unsigned long      load_address = USER_SPACE_START +
+                                          process->load_offset;
+  unsigned long            index = first_relocation_after(
+   executable,
+   (offset > process->load_offset) ? offset - process->load_offset : 0);
+
+  for(relocation += index;
+      (index < executable->number_of_relocations) &&
+      (process->load_offset + relocation->r_offset < offset + size);
+      index++, relocation++)
+  {
+   const unsigned long value = load_address + relocation->r_addend;
+   const unsigned long word = process->load_offset + relocation->r_offset;
+
+   if (R_X86_64_RELATIVE != ELF64_R_TYPE(relocation->r_info))
+   {
+    continue;
+   }
+
+   if ((word >= offset) && (word + 8 <= offset + size))
+   {
+    *((unsigned long*) (destination + (word - offset))) = value;
+   }
+   else
+   {
+    /* The word straddles the edge of the region. The rest of it is written
+       when the neighbouring region is filled. */
+    register int byte;
+
+    for(byte=0; byte<8; byte++)
+    {
+     if ((word + byte >= offset) && (word + byte < offset + size))
+     {
+      ((char*) destination)[word + byte - offset] = (char) (value >> 8*byte);
+     }
+    }
+   }
+  }
+ }
+}
+
+/*! Builds the template of the executable a process runs. All pages of the
+    image are filled, except zero filled pages which map the zero page.
+    Read-only regions of 2 Mbyte are mapped with large pages.
+    \return The physical address of the template page directory or 0 if
+    memory is exhausted. */
+static unsigned long
+build_executable_template(const struct process* const process
+                          /*!< A process that runs the executable. */)
+{
+ unsigned long* const pd = (unsigned long*) allocate_page_table_page();
+ unsigned long        region;
+ unsigned long        flags;
+ int                  uniform;
+
+ if (0 == pd)
+ {
+  return 0;
+ }
+
+ for(region = process->load_offset & -LARGE_PAGE_SIZE;
+     region < process->load_offset + process->memory_footprint_size;
+     region += LARGE_PAGE_SIZE)
+ {
+  unsigned long* pt;
+  unsigned long  offset;
+  unsigned long  frame;
+
+  flags = region_flags(process, region, LARGE_PAGE_SIZE, &uniform);
+  if (0 == flags)
+  {
+   continue;
+  }
+
+  /* Writable regions use small pages so that writes copy small pages. */
+  if (uniform && (0 == (flags & PF_W)))
+  {
+   frame = allocate_page_frames(LARGE_PAGE_SIZE/PAGE_SIZE,
+                                LARGE_PAGE_SIZE/PAGE_SIZE);
+   if (0 != frame)
+   {
+    /* Fill a page at a time so interrupts are taken in between. */
+    for(offset = 0; offset < LARGE_PAGE_SIZE; offset += PAGE_SIZE)
+    {
+     fill_image_region(process, frame + offset, region + offset, PAGE_SIZE);
+     kernel_preemption_point();
+    }
+    pd[region/LARGE_PAGE_SIZE] = frame | protection_bits(flags) | PTE_LARGE;
+    continue;
+   }
+  }
+
+  pt = (unsigned long*) allocate_page_table_page();
+  if (0 == pt)
+  {
+   release_user_page_directory(pd);
+   return 0;
+  }
+  pd[region/LARGE_PAGE_SIZE] = ((unsigned long) pt) | PTE_PRESENT |
+                               PTE_WRITABLE | PTE_USER;
+
+  for(offset = region; offset < region + LARGE_PAGE_SIZE; offset += PAGE_SIZE)
+  {
+   flags = region_flags(process, offset, PAGE_SIZE, &uniform);
+   if (0 == flags)
+   {
+    continue;
+   }
+
+   if (!region_is_file_backed(process, offset, PAGE_SIZE))
+   {
+    frame = zero_page;
+   }
+   else
+   {
+    frame = allocate_page_frames(1, 1);
+    if (0 == frame)
+    {
+     release_user_page_directory(pd);
+     return 0;
+    }
+    fill_image_region(process, frame, offset, PAGE_SIZE);
+    kernel_preemption_point();
+   }
+   pt[(offset/PAGE_SIZE) & 511] = frame | protection_bits(flags & ~PF_W);
+  }
+ }
+
+ return (unsigned long) pd;
+}
+
+int
+map_executable_template(const struct process* const process)
+{
+ unsigned long* const pd = user_page_directory(process->page_table_root);
+ const unsigned long* template_pd;
+ unsigned long        new_template;
+ register int         i;
+
+ /* Templates are relocated for the image at the start of the user space. */
+ if (0 != process->load_offset)
+ {
+  return 0;
+ }
+
+ ticket_lock_acquire(&executable_template_lock);
+ template_pd = (const unsigned long*) executable_templates[process->executable];
+ ticket_lock_release(&executable_template_lock);
+
+ if (0 == template_pd)
+ {
+  /* Interrupts are taken while the template is built, so the lock must not
+     be held. If another CPU installs a template meanwhile, that one is used
+     and the new one is released. */
+  new_template = build_executable_template(process);
+  if (0 == new_template)
+  {
+   return 0;
+  }
+
+  ticket_lock_acquire(&executable_template_lock);
+  if (0 == executable_templates[process->executable])
+  {
+   executable_templates[process->executable] = new_template;
+   new_template = 0;
+  }
+  template_pd =
+   (const unsigned long*) executable_templates[process->executable];
+  ticket_lock_release(&executable_template_lock);
+
+  if (0 != new_template)
+  {
+   release_user_page_directory((unsigned long*) new_template);
+  }
+ }
+
+ if (0 == template_pd)
+ {
+  return 0;
+ }
+
+ /* The process shares the page tables and large pages of the template.
+    The page fault handler gives the process a copy of a page table when it
+    has to change it. */
+ for(i=0; i<512; i++)
+ {
+  pd[i] = template_pd[i] ? template_pd[i] | PTE_TEMPLATE : 0;
+ }
+
+ return 1;
+}
+
+/*! Resolves a page fault in the user space of a process. The page table of
+    the process does not have to be loaded. \return 1 if the fault was
+    resolved, 0 otherwise. */
+static int
+resolve_fault(struct process* const process
+              /*!< The process. */,
+              const unsigned long    fault_address
+              /*!< The address that caused the fault. */,
+              const unsigned long    error_code
+              /*!< The error code of the fault. */)
+{
+ unsigned long*  pd;
+ unsigned long*  pt;
+ unsigned long*  pte;
+ unsigned long   offset;
+ unsigned long   frame;
+ unsigned long   flags;
+ int             uniform;
+
+ /* Only faults on the image or the stack can be resolved. */
+ if ((fault_address < USER_SPACE_START) ||
+     (fault_address >= USER_SPACE_START + USER_SPACE_SIZE) ||
+     (((fault_address < USER_SPACE_START + process->load_offset) ||
+       (fault_address - (USER_SPACE_START + process->load_offset) >=
+        process->memory_footprint_size)) &&
+      (fault_address < USER_SPACE_START + USER_SPACE_SIZE - USER_STACK_SIZE)))
+ {
+  return 0;
+ }
+
+ offset = (fault_address - USER_SPACE_START) & -PAGE_SIZE;
+
+ /* Pages between the segments are not part of the image and the segment
+    flags decide what may be done with the page. */
+ flags = region_flags(process, offset, PAGE_SIZE, &uniform);
+ if ((0 == flags) ||
+     ((error_code & PAGE_FAULT_WRITE) && (0 == (flags & PF_W))))
+ {
+  return 0;
+ }
+
+ pd = user_page_directory(process->page_table_root);
+
+ if (0 == pd[offset/LARGE_PAGE_SIZE])
+ {
+  /* Nothing is mapped in the 2 Mbyte region. If the region is entirely
+     inside segments with the same flags, map it with a large page. */
+  const unsigned long region = offset & -LARGE_PAGE_SIZE;
+  const unsigned long large_flags = region_flags(process, region,
+                                                 LARGE_PAGE_SIZE, &uniform);
+
+  if (uniform)
+  {
+   frame = allocate_page_frames(LARGE_PAGE_SIZE/PAGE_SIZE,
+                                LARGE_PAGE_SIZE/PAGE_SIZE);
+   if (0 != frame)
+   {
+    fill_image_region(process, frame, region, LARGE_PAGE_SIZE);
+    pd[offset/LARGE_PAGE_SIZE] = frame | protection_bits(large_flags) |
+                                 PTE_LARGE;
+    process->resident_pages += LARGE_PAGE_SIZE/PAGE_SIZE;
+    return 1;
+   }
+  }
+
+  pt = (unsigned long*) allocate_page_table_page();
+  if (0 == pt)
+  {
+   return 0;
+  }
+  pd[offset/LARGE_PAGE_SIZE] = ((unsigned long) pt) | PTE_PRESENT |
+                               PTE_WRITABLE | PTE_USER;
+ }
+ else if (pd[offset/LARGE_PAGE_SIZE] & PTE_LARGE)
+ {
+  /* Large pages are always fully mapped. */
+  return 0;
+ }
+ else
+ {
+  pt = (unsigned long*) (pd[offset/LARGE_PAGE_SIZE] & PTE_ADDRESS_MASK);
+
+  if (pd[offset/LARGE_PAGE_SIZE] & PTE_TEMPLATE)
+  {
+   /* The page table is shared with the template. Make a private copy
+      before changing it. The pages stay shared. */
+   unsigned long* const private_pt =
+    (unsigned long*) allocate_page_table_page();
+   register int         i;
+
+   if (0 == private_pt)
+   {
+    return 0;
+   }
+   for(i=0; i<512; i++)
+   {
+    private_pt[i] = pt[i] ? pt[i] | PTE_TEMPLATE : 0;
+   }
+   pt = private_pt;
+   pd[offset/LARGE_PAGE_SIZE] = ((unsigned long) pt) | PTE_PRESENT |
+                                PTE_WRITABLE | PTE_USER;
+  }
+ }
+
+ pte = &pt[(offset/PAGE_SIZE) & 511];
+
+ if (*pte & PTE_PRESENT)
+ {
+  /* The only fault on a present page that can be resolved is a write to the
+     shared zero page or to a page shared with the template. The writer gets
+     a private copy. */
+  if ((0 == (error_code & PAGE_FAULT_WRITE)) ||
+      (((*pte & PTE_ADDRESS_MASK) != zero_page) &&
+       (0 == (*pte & PTE_TEMPLATE))))
+  {
+   return 0;
+  }
+
+  frame = allocate_page_frames(1, 1);
+  if (0 == frame)
+  {
+   return 0;
+  }
+  {
+   const unsigned long* src = (const unsigned long*) (*pte & PTE_ADDRESS_MASK);
+   unsigned long*       dst = (unsigned long*) frame;
+   register int         i;
+
+   for(i=0; i<PAGE_SIZE/8; i++)
+   {
+    *dst++=*src++;
+   }
+  }
+  *pte = frame | protection_bits(flags);
+  process->resident_pages++;
+
+  /* Other threads of the process may have the shared page in their TLB. */
+  {
+   struct tlb_batch batch;
+
+   tlb_batch_init(&batch, process);
+   tlb_batch_add(&batch, fault_address);
+   tlb_batch_flush(&batch);
+  }
+  return 1;
+ }
+
+ /* Reads from pages that are not backed by the ELF image map the shared
+    zero page. It is mapped read-only so that a write gives a fault. */
+ if ((0 == (error_code & PAGE_FAULT_WRITE)) &&
+     !region_is_file_backed(process, offset, PAGE_SIZE))
+ {
+  *pte = zero_page | protection_bits(flags & ~PF_W);
+  return 1;
+ }
+
+ frame = allocate_page_frames(1, 1);
+ if (0 == frame)
+ {
+  return 0;
+ }
+ fill_image_region(process, frame, offset, PAGE_SIZE);
+ *pte = frame | protection_bits(flags);
+ process->resident_pages++;
+ return 1;
+}
+
+int
+page_fault_handler(const unsigned long fault_address,
+                   const unsigned long error_code)
+{
+ const int thread_index = cpu_private_data.thread_index;
+
+ /* Only faults on the running process can be resolved. */
+ if (thread_index < 0)
+ {
+  return 0;
+ }
+
+ return resolve_fault(
+  process_table[thread_scheduling_table[thread_index].owner],
+  fault_address, error_code);
+}
+
+/*! \return The page table entry, or the large page directory entry, that
+    maps an address of a process. 0 if nothing maps it. */
+static unsigned long
+process_mapping(const struct process* const process
+                /*!< The process. */,
+                const unsigned long         address
+                /*!< The virtual address in the process. */)
+{
+ const unsigned long* const pd =
+  user_page_directory(process->page_table_root);
+ const unsigned long        offset = address - USER_SPACE_START;
+ const unsigned long        pde = pd[offset/LARGE_PAGE_SIZE];
+
+ if ((0 == pde) || (pde & PTE_LARGE))
+ {
+  return pde;
+ }
+ return ((const unsigned long*) (pde & PTE_ADDRESS_MASK))
+  [(offset/PAGE_SIZE) & 511];
+}
+
+unsigned long
+process_page_address(struct process* const process,
+                     const unsigned long    address)
+{
+ unsigned long mapping;
+
+ if ((address < USER_SPACE_START) ||
+     (address >= USER_SPACE_START + USER_SPACE_SIZE))
+ {
+  return 0;
+ }
+
+ mapping = process_mapping(process, address);
+ if (!(mapping & PTE_PRESENT) || !(mapping & PTE_WRITABLE))
+ {
+  if (!resolve_fault(process, address, PAGE_FAULT_WRITE))
+  {
+   return 0;
+  }
+  mapping = process_mapping(process, address);
+ }
+
+ if (mapping & PTE_LARGE)
+ {
+  return (mapping & PTE_ADDRESS_MASK) + (address & (LARGE_PAGE_SIZE - 1));
+ }
+ return (mapping & PTE_ADDRESS_MASK) + (address & (PAGE_SIZE - 1));
+}
+
+int
+user_range_accessible(const void* const   address,
+                      const unsigned long size,
+                      const unsigned long access)
+{
+ const int              thread_index = cpu_private_data.thread_index;
+ const struct process*  process;
+ unsigned long          offset = (unsigned long) address - USER_SPACE_START;
+ const unsigned long    end = offset + size;
+
+ if ((thread_index < 0) || !is_user_range(address, size))
+ {
+  return 0;
+ }
+ process = process_table[thread_scheduling_table[thread_index].owner];
+
+ /* Check a page at a time since the flags may change between pages. */
+ while (offset < end)
+ {
+  const unsigned long page_end = (offset & -PAGE_SIZE) + PAGE_SIZE;
+  const unsigned long part_size = ((page_end < end) ? page_end : end) - offset;
+  int                 uniform;
+  const unsigned long flags = region_flags(process, offset, part_size,
+                                           &uniform);
+
+  if (!uniform || (access != (flags & access)))
+  {
+   return 0;
+  }
+  offset += part_size;
+ }
+ return 1;
+}
+
+/*! Invalidates the pages of a TLB batch in the TLB of the calling CPU. */
+static void
+invalidate_tlb_batch(void* const argument
+                     /*!< Points to the batch. */)
+{
+ const struct tlb_batch* const batch = (const struct tlb_batch*) argument;
+ register int                  i;
+
+ if (batch->page_table_root != cpu_private_data.page_table_root)
+ {
+  /* The TLB may hold entries tagged with the PCID from when the address
+     space was last loaded. The next load flushes them. */
+  if (pcid_enabled)
+  {
+   pcid_page_table_roots[cpu_private_data.cpu_index][batch->pcid] = 0;
+  }
+  return;
+ }
+
+ if (batch->pages > TLB_BATCH_SIZE)
+ {
+  /* Loading cr3 without CR3_NO_FLUSH flushes the entries of the PCID. */
+  write_cr3(batch->page_table_root | (pcid_enabled ? batch->pcid : 0));
+  return;
+ }
+
+ for(i=0; i<batch->pages; i++)
+ {
+  invlpg(batch->addresses[i]);
+ }
+}
+
+void
+tlb_batch_init(struct tlb_batch* const      batch,
+               const struct process* const process)
+{
+ batch->page_table_root = process->page_table_root;
+ batch->pcid = process->pcid;
+ batch->pages = 0;
+}
+
+void
+tlb_batch_add(struct tlb_batch* const batch,
+              const unsigned long     address)
+{
+ if (batch->pages < TLB_BATCH_SIZE)
+ {
+  batch->addresses[batch->pages] = address;
+ }
+ if (batch->pages <= TLB_BATCH_SIZE)
+ {
+  batch->pages++;
+ }
+}
+
+/*! \return 1 if a CPU runs a thread in an address space, 0 otherwise. */
+static int
+runs_address_space(const int           cpu
+                   /*!< The index of the CPU. */,
+                   const unsigned long page_table_root
+                   /*!< Physical address of the PML4. */)
+{
+ return (page_table_root == cpu_page_table_roots[cpu]) &&
+        (0 == (__atomic_load_n(&idle_cpus, __ATOMIC_SEQ_CST) &
+               (1UL << cpu)));
+}
+
+void
+tlb_batch_flush(struct tlb_batch* const batch)
+{
+ unsigned long targets = 0;
+ register int  i;
+
+ if (0 == batch->pages)
+ {
+  return;
+ }
+
+ invalidate_tlb_batch(batch);
+
+ for(i=0; i<MAX_NUMBER_OF_CPUS; i++)
+ {
+  if ((i == cpu_private_data.cpu_index) ||
+      (0 == (online_cpus & (1UL << i))))
+  {
+   continue;
+  }
+
+  if (!runs_address_space(i, batch->page_table_root))
+  {
+   /* Make the next load of the address space on the CPU flush the TLB.
+      An idle CPU that still has it loaded reloads it. */
+   if (pcid_enabled)
+   {
+    pcid_page_table_roots[i][batch->pcid] = 0;
+   }
+   if (batch->page_table_root == cpu_page_table_roots[i])
+   {
+    __atomic_fetch_or(&stale_tlb_cpus, 1UL << i, __ATOMIC_SEQ_CST);
+   }
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+   /* The CPU may have started to run the address space before it could
+      see the marks. */
+   if (!runs_address_space(i, batch->page_table_root))
+   {
+    continue;
+   }
+  }
+  targets |= 1UL << i;
+ }
+
+ ipi_call(IPI_TLB_SHOOTDOWN, targets, invalidate_tlb_batch, batch);
+}
+
+void
+forget_pcid(const int pcid)
+{
+ register int i;
+
+ for(i=0; i<MAX_NUMBER_OF_CPUS; i++)
+ {
+  pcid_page_table_roots[i][pcid] = 0;
+ }
+}
+
+void
+switch_page_table(void)
+{
+ const int             process_index =
+  thread_scheduling_table[cpu_private_data.thread_index].owner;
+ struct process* const process = process_table[process_index];
+ const unsigned long   cpu = 1UL << cpu_private_data.cpu_index;
+ int                   stale = 0;
+
+ /* A TLB shootdown skipped the CPU while it was idle. The idle loop has
+    cleared the idle bit so later shootdowns interrupt the CPU. */
+ if (0 != (__atomic_load_n(&stale_tlb_cpus, __ATOMIC_SEQ_CST) & cpu))
+ {
+  __atomic_fetch_and(&stale_tlb_cpus, ~cpu, __ATOMIC_SEQ_CST);
+  stale = 1;
+ }
+
+ if ((process->page_table_root == cpu_private_data.page_table_root) &&
+     !stale)
+ {
+  /* The thread runs in the address space that is already loaded. */
+  cpu_private_data.page_table_switches_skipped++;
+  return;
+ }
+
+ set_loaded_page_table(process->page_table_root);
+
+ if (pcid_enabled)
+ {
+  /* PCID 0 is used by the kernel page table. TLB entries tagged with the
+     PCID survive the switch unless they may belong to another page table. */
+  unsigned long* const pcid_root =
+   &pcid_page_table_roots[cpu_private_data.cpu_index][process->pcid];
+  unsigned long        cr3 = process->page_table_root | process->pcid;
+
+  if ((*pcid_root == process->page_table_root) && !stale)
+  {
+   cr3 |= CR3_NO_FLUSH;
+  }
+  else
+  {
+   *pcid_root = process->page_table_root;
+  }
+  write_cr3(cr3);
+ }
+ else
+ {
+  write_cr3(process->page_table_root);
+ }
+
+ if (0 == process->first_instruction_cycles)
+ {
+  /* This is the first time the process runs. */
+  process->first_instruction_cycles = rdtsc() - process->creation_time_stamp;
+  trace_event(TRACE_EVENT_PROCESS_START, process_index,
+              process->first_instruction_cycles);
+ }
+}
@@ -0,0 +1,232 @@
+/*! \file paging.h
+ * This file defines the page table management of the kernel.
+ */
+
+#ifndef _PAGING_H_
+#define _PAGING_H_
+
+#include "kernel.h"
+
+/* Bits in page table entries. See AMD64 Programmers Manual Vol. 2. */
+#define PTE_PRESENT     (1UL<<0)  /*!< The entry maps something. */
+#define PTE_WRITABLE    (1UL<<1)  /*!< The mapped memory can be written. */
+#define PTE_USER        (1UL<<2)  /*!< The mapped memory can be accessed from
+                                       user mode. */
+#define PTE_WRITE_THROUGH (1UL<<3)
+                                  /*!< Writes to the mapped memory go straight
+                                       to memory. */
+#define PTE_CACHE_DISABLE (1UL<<4)
+                                  /*!< The mapped memory is not cached. Set,
+                                       together with PTE_WRITE_THROUGH, for
+                                       device registers. */
+#define PTE_LARGE       (1UL<<7)  /*!< Set in a page directory entry or a
+                                       page directory pointer entry to map a
+                                       2 Mbyte or 1 Gbyte page directly. */
+#define PTE_TEMPLATE    (1UL<<9)  /*!< Ignored by the CPU. Set in entries of
+                                       a process page table that point to a
+                                       page table or a page owned by an
+                                       executable template. Those are shared
+                                       and are not released with the process.
+                                       */
+#define PTE_NO_EXECUTE  (1UL<<63) /*!< Instructions can not be fetched from
+                                       the mapped memory. Needs EFER.NXE,
+                                       which boot32.s sets. */
+#define PTE_ADDRESS_MASK (0x000ffffffffff000UL)
+                                  /*!< Masks out the physical address held in
+                                       a page table entry. */
+
+/* Bits in the error code of page faults. */
+#define PAGE_FAULT_WRITE (1UL<<1) /*!< The fault was caused by a write. */
+
+/* Bits in control register 4. */
+#define CR4_PCIDE       (1UL<<17) /*!< Enables process-context identifiers. */
+
+/* Bits in control register 3. */
+#define CR3_NO_FLUSH    (1UL<<63) /*!< When PCIDs are enabled and this bit is
+                                       set, loading cr3 does not invalidate
+                                       the TLB entries of the new PCID. */
+
+#define PAGE_SIZE       (4096)
+/*!< Size, in bytes, of the smallest page. */
+
+#define LARGE_PAGE_SIZE (0x200000UL)
+/*!< Size, in bytes, of a page mapped by a page directory entry. */
+
+#define HUGE_PAGE_SIZE  (0x40000000UL)
+/*!< Size, in bytes, of a page mapped by a page directory pointer entry. Only
+     some CPUs support these. */
+
+#define USER_SPACE_START (0x0000008000000000UL)
+/*!< The virtual address at which process images are mapped. It is the first
+     address mapped by the second entry in the PML4. The first entry maps the
+     kernel and is shared by all page tables. */
+
+#define USER_SPACE_SIZE  (0x0000000040000000UL)
+/*!< The largest process image that can be mapped. The user space is mapped
+     through one page directory which covers 1 Gbyte. */
+
+#define USER_STACK_SIZE  (0x0000000000100000UL)
+/*!< The size of the stack at the top of the user space. Its pages are zero
+     filled and mapped when they are touched. spawn puts the arguments of a
+     process at the top of it. */
+
+#define TLB_BATCH_SIZE   (16)
+/*!< The number of pages a TLB batch invalidates one by one. If more pages
+     are added the TLB entries of the whole address space are flushed. */
+
+/*! Collects the pages of an address space whose mappings have changed so
+    that the TLBs of all CPUs are invalidated with one round of TLB
+    shootdown interrupts. */
+struct tlb_batch
+{
+ unsigned long page_table_root; /*!< The address space. */
+ int           pcid;            /*!< The PCID of the address space. */
+ int           pages;           /*!< The number of pages added, at most
+                                     TLB_BATCH_SIZE + 1. */
+ unsigned long addresses[TLB_BATCH_SIZE];
+                                /*!< The virtual addresses of the pages. */
+};
+
+/* Variable declarations */
+
+extern unsigned long
+kernel_page_table_root;
+/*!< Physical address of the kernel PML4. Its first entry maps all memory
+     one-to-one and is shared by the page tables of all processes. */
+
+extern int
+pcid_enabled;
+/*!< Set to 1 if the CPU supports process-context identifiers and they have
+     been enabled. Set to 0 otherwise. */
+
+extern unsigned long
+zero_page;
+/*!< Physical address of a page filled with zeros. It is mapped read-only
+     into processes where they read zero filled memory they have not
+     written. */
+
+/* Function declarations */
+
+/*! Replaces the boot page table with a kernel page table that maps all
+    memory with 1 Gbyte pages, or 2 Mbyte pages if the CPU lacks support for
+    the former. Enables process-context identifiers if the CPU supports
+    them. Called from initialize. */
+extern void
+initialize_paging(void);
+
+/*! Maps the device registers in a range of physical addresses one-to-one
+    and uncached into the kernel portion of the address space, which all
+    processes share. Registers that lie in memory already covered by the
+    direct map are left as they are; the memory type range registers make
+    them uncached. The range has to be in the first 512 Gbyte of physical
+    memory. */
+extern void
+map_device_memory(const unsigned long physical_address
+                  /*!< The first byte of the registers. */,
+                  const unsigned long size
+                  /*!< The size of the registers in bytes. */);
+
+/*! Builds a page table for a process. The kernel portion of the address
+    space is shared with the kernel page table. The user portion starts out
+    empty and is filled in by page_fault_handler.
+    \return The physical address of the PML4 or 0 if there is not enough
+            memory to hold the page table. */
+extern unsigned long
+build_process_page_table(void);
+
+/*! Releases a process page table and all memory mapped by it, except the
+    zero page. If the page table is loaded the kernel page table is loaded
+    instead. */
+extern void
+release_process_page_table(const unsigned long page_table_root
+                           /*!< Physical address of the PML4. */);
+
+/*! Maps the template of the executable a process runs into its page table
+    and builds the template if this is the first process that runs the
+    executable. The template holds all pages of the image, so it takes time
+    proportional to the image size to build it but copying it takes the same
+    time for all images. The page table of the process has to be newly built.
+    \return 1 if the template was mapped, 0 if it could not be built. The
+            image is then loaded by page_fault_handler as it is touched. */
+extern int
+map_executable_template(const struct process* const process
+                        /*!< The process. Its executable, image and load
+                             offset are set. */);
+
+/*! Installs the page that a thread faulted on. Pages backed by the ELF
+    image are copied from it on first touch. Zero filled pages map the zero
+    page on reads and get a private page on writes. Writes to pages shared
+    with a template get a private copy. Regions of 2 Mbyte that lie entirely
+    within segments with the same flags are mapped with large pages. Called
+    from the page fault interrupt handler in enter.s.
+    \return 1 if the fault was resolved, 0 otherwise. */
+extern int
+page_fault_handler(const unsigned long fault_address
+                   /*!< The address that caused the fault, i.e., cr2. */,
+                   const unsigned long error_code
+                   /*!< The error code pushed by the CPU. */);
+
+/*! Makes the page holding an address of a process present, private and
+    writable, as if the process had written to it. The page table of the
+    process does not have to be loaded.
+    \return The physical address of the byte at the address or 0 if the
+            address is not in a writable part of the process or memory is
+            exhausted. */
+extern unsigned long
+process_page_address(struct process* const process
+                     /*!< The process. */,
+                     const unsigned long    address
+                     /*!< The virtual address in the process. */);
+
+/*! Checks that a range of addresses of the running process lies in its
+    image or stack with the given access, so that a system call can touch
+    it without a fault that can not be resolved. The range is first checked
+    with is_user_range.
+    \return 1 iff every byte of the range allows the access. */
+extern int
+user_range_accessible(const void* const   address
+                      /*!< The first address. */,
+                      const unsigned long size
+                      /*!< The size, in bytes, of the range. */,
+                      const unsigned long access
+                      /*!< The PF_ flags that are needed, PF_R to read or
+                           PF_W to write. */);
+
+/*! Starts an empty TLB batch for the address space of a process. */
+extern void
+tlb_batch_init(struct tlb_batch* const      batch
+               /*!< The batch. */,
+               const struct process* const process
+               /*!< The process. */);
+
+/*! Adds a page whose mapping has changed to a TLB batch. */
+extern void
+tlb_batch_add(struct tlb_batch* const batch
+              /*!< The batch. */,
+              const unsigned long     address
+              /*!< A virtual address in the page. */);
+
+/*! Invalidates the pages of a TLB batch on all CPUs. The CPUs that run the
+    address space get a TLB shootdown interrupt and the call waits until
+    they have served it. Idle CPUs and CPUs that run another address space
+    are skipped; their next load of the address space flushes its entries
+    instead. No spin lock may be held. */
+extern void
+tlb_batch_flush(struct tlb_batch* const batch
+                /*!< The batch. */);
+
+/*! Marks the TLB entries tagged with a PCID as stale on all CPUs. Called
+    when the PCID is given to a new process. The next load of a page table
+    with the PCID then flushes the entries. */
+extern void
+forget_pcid(const int pcid
+            /*!< The PCID. */);
+
+/*! Loads the page table of the process that owns the thread about to run on
+    the CPU. The load is skipped if the thread shares address space with the
+    previous thread. The first time a process runs, the time from its
+    creation is reported. Called from return_to_user_mode in enter.s. */
+extern void
+switch_page_table(void);
+
+#endif
@@ -0,0 +1,250 @@
+/*! \file pmu.c
+ * This file implements the support for the performance monitoring unit.
+ */
+
+#include "pmu.h"
+
+/* Note: Look in pmu.h for documentation of global variables and
+   functions. */
+
+/* Variables */
+
+int
+pmu_counters = 0;
+
+/*! The MSR of the first counter. Full width writes are used if the CPU
+    supports them. Otherwise only the low 32 bits of a counter are restored
+    when a thread is switched in. */
+static unsigned int
+pmu_counter_msr = IA32_PMC0;
+
+/*! Bit i is set iff event i, i.e., PERF_EVENT_ value i, can be counted. */
+static unsigned int
+pmu_available_events = 0;
+
+/*! The event number and unit mask of each event, indexed by the
+    PERF_EVENT_ values, and the privilege levels it is counted at. */
+static const struct
+{
+ unsigned char event;
+ unsigned char unit_mask;
+ unsigned long privilege;
+} pmu_events[] =
+{
+ {0x3c, 0x00, PERFEVTSEL_USR}, /* PERF_EVENT_CYCLES */
+ {0xc0, 0x00, PERFEVTSEL_USR}, /* PERF_EVENT_INSTRUCTIONS */
+ {0x3c, 0x01, PERFEVTSEL_USR}, /* PERF_EVENT_REFERENCE_CYCLES */
+ {0x2e, 0x4f, PERFEVTSEL_USR}, /* PERF_EVENT_LLC_REFERENCES */
+ {0x2e, 0x41, PERFEVTSEL_USR}, /* PERF_EVENT_LLC_MISSES */
+ {0xc4, 0x00, PERFEVTSEL_USR}, /* PERF_EVENT_BRANCHES */
+ {0xc5, 0x00, PERFEVTSEL_USR}, /* PERF_EVENT_BRANCH_MISSES */
+ /* PERF_EVENT_DTLB_LOAD_MISSES, DTLB_LOAD_MISSES.WALK_COMPLETED. Kernel
+    pages are only used in kernel mode so it is counted there too. */
+ {0x08, 0x0e, PERFEVTSEL_USR | PERFEVTSEL_OS}
+};
+
+/* Function definitions */
+
+/*! \return 1 iff the CPU counts completed page walks of data TLB load
+    misses with event 0x08 and unit mask 0x0e. Intel cores from Haswell to
+    Tiger Lake do. Other cores use other event numbers. */
+static int
+dtlb_load_miss_event_supported(void)
+{
+ static const unsigned char models[] =
+ {
+  0x3c, 0x3f, 0x45, 0x46,                   /* Haswell */
+  0x3d, 0x47, 0x4f, 0x56,                   /* Broadwell */
+  0x4e, 0x5e, 0x55, 0x8e, 0x9e, 0xa5, 0xa6, /* Skylake and its successors */
+  0x66, 0x6a, 0x6c, 0x7d, 0x7e, 0x8c, 0x8d  /* Cannon, Ice and Tiger Lake */
+ };
+ const unsigned int signature = cpuid_eax(1);
+ const unsigned int model = ((signature>>4)&15) | ((signature>>12)&0xf0);
+ register int       i;
+
+ /* The vendor string starts with "Genu" in ebx. */
+ if ((0x756e6547 != cpuid_ebx(0)) || (6 != ((signature>>8)&15)))
+ {
+  return 0;
+ }
+
+ for(i=0; i<sizeof(models)/sizeof(models[0]); i++)
+ {
+  if (model == models[i])
+  {
+   return 1;
+  }
+ }
+ return 0;
+}
+
+void
+initialize_pmu(void)
+{
+ const unsigned int eax = cpuid_eax(0x0a);
+ const unsigned int version = eax&255;
+ register int       i;
+
+ if ((cpuid_eax(0) < 0x0a) || (0 == version))
+ {
+  kprints("No architectural performance counters.\n");
+  return;
+ }
+
+ pmu_counters = (eax>>8)&255;
+ if (pmu_counters > PMU_MAX_COUNTERS)
+ {
+  pmu_counters = PMU_MAX_COUNTERS;
+ }
+
+ /* A set bit in ebx means that the event is not available. Only the first
+    eax[31:24] bits are valid. */
+ pmu_available_events = ~cpuid_ebx(0x0a) &
+                        ((1UL<<(eax>>24))-1) &
+                        ((1U<<PMU_ARCHITECTURAL_EVENTS)-1);
+ if (dtlb_load_miss_event_supported())
+ {
+  pmu_available_events |= 1U<<PERF_EVENT_DTLB_LOAD_MISSES;
+ }
+
+ /* Use full width counter writes if they are supported. */
+ if ((cpuid_ecx(1) & (1<<15)) && (rdmsr(IA32_PERF_CAPABILITIES) & (1<<13)))
+ {
+  pmu_counter_msr = IA32_A_PMC0;
+ }
+
+ /* Stop all counters. From version 2 the counters also have to be enabled
+    globally. The event select registers then decide what counts. */
+ for(i=0; i<pmu_counters; i++)
+ {
+  wrmsr(IA32_PERFEVTSEL0+i, 0);
+ }
+ if (version >= 2)
+ {
+  wrmsr(IA32_PERF_GLOBAL_CTRL, (1UL<<pmu_counters)-1);
+ }
+
+ /* Let user mode read the counters with rdpmc. */
+ write_cr4(read_cr4() | CR4_PCE);
+
+ kprints("Found 0x");
+ kprinthex(pmu_counters);
+ kprints(" performance counters.\n");
+}
+
+long
+pmu_perfcount(const int           thread_index,
+              const unsigned long event,
+              const unsigned long enable)
+{
+ struct pmu_context* const pmu = &thread_table[thread_index]->data.pmu;
+ register int              i;
+ unsigned long             event_select;
+
+ if ((event >= sizeof(pmu_events)/sizeof(pmu_events[0])) ||
+     !(pmu_available_events & (1U<<event)))
+ {
+  return ERROR;
+ }
+
+ event_select = pmu_events[event].event |
+                (((unsigned long) pmu_events[event].unit_mask)<<8) |
+                pmu_events[event].privilege | PERFEVTSEL_EN;
+
+ /* Look for a counter already counting the event. */
+ for(i=0; i<pmu_counters; i++)
+ {
+  if ((pmu->counters_in_use & (1U<<i)) &&
+      (pmu->event_select[i] == event_select))
+  {
+   break;
+  }
+ }
+
+ if (!enable)
+ {
+  if (i == pmu_counters)
+  {
+   return ERROR;
+  }
+  wrmsr(IA32_PERFEVTSEL0+i, 0);
+  pmu->event_select[i] = 0;
+  pmu->counters_in_use &= ~(1U<<i);
+  return ALL_OK;
+ }
+
+ if (i < pmu_counters)
+ {
+  return i + 1;
+ }
+
+ /* Take a free counter. The thread is running so its counters are the ones
+    loaded into the PMU. */
+ for(i=0; i<pmu_counters; i++)
+ {
+  if (!(pmu->counters_in_use & (1U<<i)))
+  {
+   pmu->event_select[i] = event_select;
+   pmu->counter[i] = 0;
+   pmu->counters_in_use |= 1U<<i;
+   wrmsr(pmu_counter_msr+i, 0);
+   wrmsr(IA32_PERFEVTSEL0+i, event_select);
+   return i + 1;
+  }
+ }
+
+ return ERROR;
+}
+
+void
+pmu_switch_thread(const int previous_thread_index,
+                  const int next_thread_index)
+{
+ register int i;
+
+ if (0 == pmu_counters)
+ {
+  return;
+ }
+
+ if (-1 != previous_thread_index)
+ {
+  if (0 != thread_table[previous_thread_index])
+  {
+   struct pmu_context* const pmu =
+    &thread_table[previous_thread_index]->data.pmu;
+
+   for(i=0; i<pmu_counters; i++)
+   {
+    if (pmu->counters_in_use & (1U<<i))
+    {
+     wrmsr(IA32_PERFEVTSEL0+i, 0);
+     pmu->counter[i] = rdmsr(IA32_PMC0+i);
+    }
+   }
+  }
+  else
+  {
+   /* The thread has terminated. Stop whatever it was counting. */
+   for(i=0; i<pmu_counters; i++)
+   {
+    wrmsr(IA32_PERFEVTSEL0+i, 0);
+   }
+  }
+ }
+
+ if (-1 != next_thread_index)
+ {
+  const struct pmu_context* const pmu =
+   &thread_table[next_thread_index]->data.pmu;
+
+  for(i=0; i<pmu_counters; i++)
+  {
+   if (pmu->counters_in_use & (1U<<i))
+   {
+    wrmsr(pmu_counter_msr+i, pmu->counter[i]);
+    wrmsr(IA32_PERFEVTSEL0+i, pmu->event_select[i]);
+   }
+  }
+ }
+}
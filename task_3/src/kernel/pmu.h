@@ -0,0 +1,74 @@
+/*! \file pmu.h
+ * This file defines the support for the architectural performance monitoring
+ * unit. Threads enable general purpose counters with the perfcount system
+ * call. The counters of a thread count in user mode, data TLB misses also in
+ * kernel mode, and are saved and restored when the thread is switched out
+ * and in. User mode can read the counters directly with rdpmc.
+ */
+
+#ifndef _PMU_H_
+#define _PMU_H_
+
+#include "kernel.h"
+
+#define IA32_PMC0              (0x0c1)
+/*!< The first general purpose counter. */
+#define IA32_A_PMC0            (0x4c1)
+/*!< The first general purpose counter, with full width writes. */
+#define IA32_PERFEVTSEL0       (0x186)
+/*!< The event select register of the first general purpose counter. */
+#define IA32_PERF_CAPABILITIES (0x345)
+/*!< Lists optional performance monitoring features. */
+#define IA32_PERF_GLOBAL_CTRL  (0x38f)
+/*!< Enables the counters. Present from PMU version 2. */
+
+#define PERFEVTSEL_USR         (1UL<<16)
+/*!< Count while the CPU runs at privilege level 3. */
+#define PERFEVTSEL_OS          (1UL<<17)
+/*!< Count while the CPU runs at privilege level 0. */
+#define PERFEVTSEL_EN          (1UL<<22)
+/*!< Enables the counter. */
+
+#define CR4_PCE                (1UL<<8)
+/*!< Allows rdpmc in user mode. */
+
+#define PMU_ARCHITECTURAL_EVENTS (7)
+/*!< The number of PERF_EVENT_ values that are architectural events. The
+     others are model specific. */
+
+/* Variable declarations */
+
+extern int
+pmu_counters;
+/*!< The number of general purpose counters that can be used. 0 if the CPU
+     has no architectural performance monitoring unit. */
+
+/* Function declarations */
+
+/*! Detects the performance monitoring unit, stops all counters and allows
+    user mode to read them. Called from initialize. */
+extern void
+initialize_pmu(void);
+
+/*! Enables or disables the counting of an event for the running thread.
+    \return The index of the counter plus one when enabling. ALL_OK when
+            disabling. ERROR if there is no counter for the event. */
+extern long
+pmu_perfcount(const int           thread_index
+              /*!< Index, into thread_table, of the running thread. */,
+              const unsigned long event
+              /*!< One of the PERF_EVENT_ values. */,
+              const unsigned long enable
+              /*!< 1 to enable, 0 to disable. */);
+
+/*! Saves the counters of the thread switched out and loads the counters of
+    the thread switched in. Called each time the CPU switches thread. */
+extern void
+pmu_switch_thread(const int previous_thread_index
+                  /*!< Index of the thread switched out. -1 if the CPU was
+                       idle. The thread may have been released. */,
+                  const int next_thread_index
+                  /*!< Index of the thread switched in. -1 if the CPU goes
+                       idle. */);
+
+#endif
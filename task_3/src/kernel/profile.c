@@ -0,0 +1,115 @@
+/*! \file profile.c
+ * This file implements the sampling profiler.
+ */
+
+#include "profile.h"
+#include "memory.h"
+#include "paging.h"
+
+/* Note: Look in profile.h for documentation of global variables and
+   functions. */
+
+/* Variables */
+
+struct profile_buffer
+profile_buffers[MAX_NUMBER_OF_CPUS];
+
+int
+profile_running = 0;
+
+/* Function definitions */
+
+long
+profile_start(const unsigned long timer_interrupts_per_tick)
+{
+ struct profile_buffer* const buffer =
+  &profile_buffers[cpu_private_data.cpu_index];
+ register int                 i;
+
+ /* The PIT can only generate an exact multiple of the clock tick rate if
+    the multiple divides the divisor. */
+ if ((0 == timer_interrupts_per_tick) ||
+     (timer_interrupts_per_tick > PIT_TICK_DIVISOR) ||
+     (0 != PIT_TICK_DIVISOR % timer_interrupts_per_tick))
+ {
+  return ERROR;
+ }
+
+ if (0 == buffer->samples)
+ {
+  buffer->samples = (struct profile_sample*)
+   allocate_page_frames((PROFILE_BUFFER_SAMPLES*
+                         sizeof(struct profile_sample))/PAGE_SIZE, 1);
+  if (0 == buffer->samples)
+  {
+   return ERROR;
+  }
+ }
+
+ for(i=0; i<MAX_NUMBER_OF_CPUS; i++)
+ {
+  profile_buffers[i].samples_taken = 0;
+  profile_buffers[i].samples_dropped = 0;
+ }
+
+ set_timer_interrupts_per_tick(timer_interrupts_per_tick);
+ profile_running = 1;
+ return ALL_OK;
+}
+
+void
+profile_stop(void)
+{
+ profile_running = 0;
+ set_timer_interrupts_per_tick(1);
+}
+
+void
+profile_dump(void)
+{
+ register int i;
+
+ kprints("PROFILE RATE ");
+ kprinthex(200*timer_interrupts_per_tick);
+ kprints("\n");
+
+ for(i=0; i<MAX_NUMBER_OF_CPUS; i++)
+ {
+  struct profile_buffer* const buffer = &profile_buffers[i];
+  unsigned long                sample_index;
+
+  if (0 == buffer->samples)
+  {
+   continue;
+  }
+
+  kprints("PROFILE DROPPED ");
+  kprinthex(i);
+  kprints(" ");
+  kprinthex(buffer->samples_dropped);
+  kprints("\n");
+
+  for(sample_index=0; sample_index<buffer->samples_taken; sample_index++)
+  {
+   const struct profile_sample* const sample =
+    &buffer->samples[sample_index];
+
+   kprints("PROFILE ");
+   kprinthex(i);
+   kprints(" ");
+   kprinthex(sample->process);
+   kprints(" ");
+   kprinthex(sample->executable);
+   kprints(" ");
+   kprinthex(sample->rip);
+   kprints("\n");
+
+   /* Samples taken by the timer interrupt meanwhile are dumped as well,
+      as the loop reads samples_taken again. */
+   kernel_preemption_point();
+  }
+
+  buffer->samples_taken = 0;
+  buffer->samples_dropped = 0;
+ }
+}
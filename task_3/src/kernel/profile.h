@@ -0,0 +1,113 @@
+/*! \file profile.h
+ * This file defines the sampling profiler. When the profiler runs, every
+ * timer interrupt records the process and the instruction pointer of the
+ * code it interrupted in a buffer private to the CPU. The timer can be made
+ * to interrupt more often than once per clock tick while profiling. The
+ * samples are dumped to the debug port on demand and mapped to symbols on
+ * the host by src/tools/profile2symbols.py.
+ */
+
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#include "kernel.h"
+
+#define PROFILE_BUFFER_SAMPLES (8192)
+/*!< The number of samples in the buffer of each CPU. Samples taken when the
+     buffer is full are dropped. */
+
+/*! Defines a sample. */
+struct profile_sample
+{
+ int           process;     /*!< Index, into process_table, of the process
+                                 that was interrupted. -1 if the kernel was
+                                 interrupted. */
+ int           executable;  /*!< Index, into executable_table, of the program
+                                 the process runs. -1 if the kernel was
+                                 interrupted. */
+ unsigned long rip;         /*!< The interrupted instruction. */
+};
+
+/*! Defines the sample buffer of a CPU. */
+struct profile_buffer
+{
+ struct profile_sample* samples;
+                              /*!< Points to PROFILE_BUFFER_SAMPLES samples.
+                                   0 until the profiler has been started. */
+ unsigned long          samples_taken;
+                              /*!< The number of samples in the buffer. */
+ unsigned long          samples_dropped;
+                              /*!< The number of samples dropped because the
+                                   buffer was full. */
+};
+
+/* Variable declarations */
+
+extern struct profile_buffer
+profile_buffers[MAX_NUMBER_OF_CPUS];
+/*!< The sample buffer of each CPU. */
+
+extern int
+profile_running;
+/*!< Set to 1 while the profiler takes samples. */
+
+/* Function declarations */
+
+/*! Starts the profiler. The samples taken earlier are discarded.
+    \return ALL_OK or ERROR if the rate can not be used or there is not
+            enough memory for the sample buffer. */
+extern long
+profile_start(const unsigned long timer_interrupts_per_tick
+              /*!< The number of samples per clock tick. It must divide
+                   PIT_TICK_DIVISOR. */);
+
+/*! Stops the profiler. The samples are kept until the profiler is started
+    again. */
+extern void
+profile_stop(void);
+
+/*! Writes the samples of each CPU to the debug port and empties the buffers.
+    Samples are written as text lines that start with "PROFILE". A
+    preemption point is passed after each sample. */
+extern void
+profile_dump(void);
+
+/*! Records a sample of the code interrupted by the timer. Called from
+    timer_interrupt_handler. */
+inline static void
+profile_sample(const int thread_index
+               /*!< Index, into thread_table, of the interrupted thread or -1
+                    if the kernel was interrupted. */)
+{
+ struct profile_buffer* const buffer =
+  &profile_buffers[cpu_private_data.cpu_index];
+ struct profile_sample*       sample;
+
+ if (!profile_running || (0 == buffer->samples))
+ {
+  return;
+ }
+
+ if (PROFILE_BUFFER_SAMPLES == buffer->samples_taken)
+ {
+  buffer->samples_dropped++;
+  return;
+ }
+
+ sample = &buffer->samples[buffer->samples_taken++];
+ if (-1 == thread_index)
+ {
+  sample->process = -1;
+  sample->executable = -1;
+  sample->rip = cpu_private_data.interrupted_kernel_rip;
+ }
+ else
+ {
+  sample->process = thread_scheduling_table[thread_index].owner;
+  sample->executable = process_table[sample->process]->executable;
+  sample->rip =
+   thread_table[thread_index]->data.registers.integer_registers.rip;
+ }
+}
+
+#endif
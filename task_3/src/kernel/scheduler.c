@@ -5,6 +5,7 @@
  */
 
 #include "kernel.h"
+#include "threadqueue.h"
 int last_switch = 0;
 
 void
@@ -15,7 +16,9 @@ scheduler_called_from_system_call_handler(const register int schedule)
 	if (schedule){
 		/*This case, we reschedule*/
 		last_switch = system_time;
-		thread_to_run = thread_queue_dequeue(&ready_queue);
+		thread_to_run = thread_queue_dequeue(&ready_queue, cpu_private_data.cpu_index);
+		if (thread_to_run >= 0)
+			set_thread_state(thread_to_run, THREAD_STATE_RUNNING);
 		cpu_private_data.thread_index = thread_to_run;
 		return;
 
@@ -25,8 +28,13 @@ scheduler_called_from_system_call_handler(const register int schedule)
 		if (system_time - last_switch){
 			last_switch = system_time;
 			thread_running = cpu_private_data.thread_index;
+			set_thread_state(thread_running, THREAD_STATE_READY);
 			thread_queue_enqueue(&ready_queue,thread_running);
-			thread_to_run = thread_queue_dequeue(&ready_queue);
+			thread_to_run = thread_queue_dequeue(&ready_queue, cpu_private_data.cpu_index);
+			/* No thread may run on this CPU, e.g., the running thread's
+			   affinity changed. The CPU idles. */
+			if (thread_to_run >= 0)
+				set_thread_state(thread_to_run, THREAD_STATE_RUNNING);
 			cpu_private_data.thread_index = thread_to_run;
 			return;
 		}
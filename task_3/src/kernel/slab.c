@@ -0,0 +1,124 @@
+/*! \file slab.c
+ * This file implements object caches.
+ */
+
+#include "slab.h"
+#include "memory.h"
+#include "paging.h"
+
+/* Note: Look in slab.h for documentation of global variables and
+   functions. */
+
+/* Variables */
+
+struct object_cache
+thread_cache;
+
+struct object_cache
+process_cache;
+
+/* Function definitions */
+
+void
+object_cache_init(struct object_cache* const cache,
+                  const unsigned long        object_size,
+                  const unsigned long        slab_pages,
+                  const char* const          name)
+{
+ register int i;
+
+ cache->object_size = (object_size + 15) & -16;
+ cache->slab_pages = slab_pages;
+ cache->depot = 0;
+ cache->slabs = 0;
+ ticket_lock_init(&cache->depot_lock, name);
+
+ for(i=0; i<MAX_NUMBER_OF_CPUS; i++)
+ {
+  cache->magazines[i].rounds = 0;
+ }
+}
+
+/*! Allocates a new slab and puts all of its objects in the depot.
+    \return 1 on success, 0 if memory is exhausted. */
+static int
+object_cache_grow(struct object_cache* const cache)
+{
+ const unsigned long slab = allocate_page_frames(cache->slab_pages, 1);
+ unsigned long       object;
+
+ if (0 == slab)
+ {
+  return 0;
+ }
+
+ /* Carve the slab into objects. The objects are pushed in reverse so that
+    they are handed out in address order. */
+ for(object = slab +
+              ((cache->slab_pages*PAGE_SIZE)/cache->object_size - 1)*
+              cache->object_size;
+     object >= slab;
+     object -= cache->object_size)
+ {
+  *((void**) object) = cache->depot;
+  cache->depot = (void*) object;
+ }
+
+ cache->slabs++;
+ return 1;
+}
+
+void*
+object_cache_allocate(struct object_cache* const cache)
+{
+ struct magazine* const magazine =
+  &cache->magazines[cpu_private_data.cpu_index];
+
+ if (0 == magazine->rounds)
+ {
+  /* The magazine is empty. Load half a magazine from the depot, growing the
+     cache if the depot is empty. */
+  ticket_lock_acquire(&cache->depot_lock);
+  while (magazine->rounds < MAGAZINE_SIZE/2)
+  {
+   if ((0 == cache->depot) && !object_cache_grow(cache))
+   {
+    break;
+   }
+   magazine->objects[magazine->rounds++] = cache->depot;
+   cache->depot = *((void**) cache->depot);
+  }
+  ticket_lock_release(&cache->depot_lock);
+
+  if (0 == magazine->rounds)
+  {
+   return 0;
+  }
+ }
+
+ return magazine->objects[--magazine->rounds];
+}
+
+void
+object_cache_free(struct object_cache* const cache,
+                  void* const                object)
+{
+ struct magazine* const magazine =
+  &cache->magazines[cpu_private_data.cpu_index];
+
+ if (MAGAZINE_SIZE == magazine->rounds)
+ {
+  /* The magazine is full. Return half of it to the depot. */
+  ticket_lock_acquire(&cache->depot_lock);
+  while (magazine->rounds > MAGAZINE_SIZE/2)
+  {
+   void* const depot_object = magazine->objects[--magazine->rounds];
+
+   *((void**) depot_object) = cache->depot;
+   cache->depot = depot_object;
+  }
+  ticket_lock_release(&cache->depot_lock);
+ }
+
+ magazine->objects[magazine->rounds++] = object;
+}
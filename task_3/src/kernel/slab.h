@@ -0,0 +1,81 @@
+/*! \file slab.h
+ * This file defines object caches. An object cache hands out fixed size
+ * kernel objects, e.g., threads and processes. Objects are carved out of
+ * slabs, runs of page frames taken from the page frame allocator, and the
+ * cache grows by one slab whenever it runs dry. Freed objects are kept by
+ * the cache for reuse. Each CPU has a magazine of free objects so that most
+ * allocations and frees never touch the shared part of the cache.
+ */
+
+#ifndef _SLAB_H_
+#define _SLAB_H_
+
+#include "kernel.h"
+#include "lock.h"
+
+#define MAGAZINE_SIZE (16)
+/*!< The number of free objects a CPU can hold in its magazine. */
+
+/*! Defines a per-CPU magazine, i.e., a stack of free objects. */
+struct magazine
+{
+ int   rounds;                  /*!< The number of objects in the magazine. */
+ void* objects[MAGAZINE_SIZE];  /*!< The free objects. */
+};
+
+/*! Defines an object cache. */
+struct object_cache
+{
+ unsigned long   object_size;       /*!< Size, in bytes, of an object. A
+                                         multiple of 16 so that objects are
+                                         16 byte aligned. */
+ unsigned long   slab_pages;        /*!< The number of page frames in a
+                                         slab. */
+ void*           depot;             /*!< Linked list of free objects shared
+                                         by all CPUs. The first 8 bytes of a
+                                         free object point to the next. */
+ unsigned long   slabs;             /*!< The number of slabs allocated. */
+ struct ticket_lock
+                 depot_lock;        /*!< Protects depot and slabs. */
+ struct magazine magazines[MAX_NUMBER_OF_CPUS];
+                                    /*!< The magazine of each CPU. */
+};
+
+/* Variable declarations */
+
+extern struct object_cache
+thread_cache;
+/*!< The object cache holding union thread objects. */
+
+extern struct object_cache
+process_cache;
+/*!< The object cache holding struct process objects. */
+
+/* Function declarations */
+
+/*! Initializes an empty object cache. No memory is allocated until the
+    first object is. */
+extern void
+object_cache_init(struct object_cache* const cache
+                  /*!< Points to the cache to initialize. */,
+                  const unsigned long        object_size
+                  /*!< Size, in bytes, of the objects. */,
+                  const unsigned long        slab_pages
+                  /*!< The number of page frames in each slab. */,
+                  const char* const          name
+                  /*!< The name of the cache, used for its lock. */);
+
+/*! Allocates an object from a cache. The object is not initialized.
+    \return A pointer to the object or 0 if memory is exhausted. */
+extern void*
+object_cache_allocate(struct object_cache* const cache
+                      /*!< Points to the cache. */);
+
+/*! Returns an object to the cache it was allocated from. */
+extern void
+object_cache_free(struct object_cache* const cache
+                  /*!< Points to the cache. */,
+                  void* const                object
+                  /*!< Points to the object. */);
+
+#endif
@@ -5,6 +5,53 @@
  */
 
 #include "kernel.h"
+#include "threadqueue.h"
+#include "trace.h"
+#include "profile.h"
+#include "pmu.h"
+#include "paging.h"
+#include "cpuset.h"
+#include "lock.h"
+#include "apic.h"
+#include "idle.h"
+#include "mutex.h"
+
+/*! Puts the calling thread in the ready queue if it may no longer run on
+    the CPU, so that a CPU it may run on picks it up.
+    \return 1 if the scheduler has to pick another thread, 0 otherwise. */
+static int
+leave_cpu_if_not_allowed(void)
+{
+ const int thread_index = cpu_private_data.thread_index;
+
+ if (0 != (thread_scheduling_table[thread_index].allowed_cpus &
+           (1UL << cpu_private_data.cpu_index)))
+ {
+  return 0;
+ }
+ yield_thread(thread_index);
+ return 1;
+}
+
+/*! Puts the calling thread in the ready queue if a thread of higher
+    priority is ready, e.g., after the thread has given back a priority it
+    was lent. \return 1 if the scheduler has to pick another thread, 0
+    otherwise. */
+static int
+yield_to_higher_priority(void)
+{
+ const int          thread_index = cpu_private_data.thread_index;
+ const unsigned int priorities = ready_queue.priorities;
+
+ if ((0 == priorities) ||
+     (31 - __builtin_clz(priorities) <=
+      thread_scheduling_table[thread_index].priority))
+ {
+  return 0;
+ }
+ yield_thread(thread_index);
+ return 1;
+}
 
 int
 system_call_implementation(void)
@@ -16,8 +63,7 @@ system_call_implementation(void)
  {
   case SYSCALL_PRINTS:
   {
-   kprints((char*) (SYSCALL_ARGUMENTS.rdi));
-   SYSCALL_ARGUMENTS.rax = ALL_OK;
+   SYSCALL_ARGUMENTS.rax = kprints_user((char*) (SYSCALL_ARGUMENTS.rdi));
 
    break;
   }
@@ -45,71 +91,262 @@ system_call_implementation(void)
 	}
 
 	case SYSCALL_CREATEPROCESS: {
+		/* A process created without arguments. */
+		SYSCALL_ARGUMENTS.rax = spawn_process(SYSCALL_ARGUMENTS.rdi, 0, SPAWN_INHERIT, 0);
+		break;
+	}
+	case SYSCALL_TERMINATE:
+	{
+		int owner_process = thread_scheduling_table[cpu_private_data.thread_index].owner;
 
-		int process_number, thread_number;
-		long int executable_number = SYSCALL_ARGUMENTS.rdi;
-		struct prepare_process_return_value prepare_process_ret_val;
+		release_thread(cpu_private_data.thread_index); /* Terminate Thread */
 
+		process_table[owner_process]->threads -= 1; /* Decrement Thread count */
 
-		for (process_number = 0; process_number < MAX_NUMBER_OF_PROCESSES && process_table[process_number].threads > 0; process_number++) {
+		if(process_table[owner_process]->threads < 1) {
+			cleanup_process(owner_process);
 		}
-		prepare_process_ret_val = prepare_process(
-				executable_table[executable_number].elf_image,
-				process_number,
-				executable_table[executable_number].memory_footprint_size);
 
-		if(0 == prepare_process_ret_val.first_instruction_address) {
-			kprints("Error starting image\n");
-		}
+		schedule = 1;
 
-		process_table[process_number].parent = thread_table[cpu_private_data.thread_index].data.owner;
+		break;
 
-		thread_number = allocate_thread();
+	}
 
-		thread_table[thread_number].data.owner = process_number;
-		thread_table[thread_number].data.registers.integer_registers.rflags = 0x200;
-		thread_table[thread_number].data.registers.integer_registers.rip = prepare_process_ret_val.first_instruction_address;
 
-		process_table[process_number].threads += 1;
+  /* Do not touch any lines above or including this line. */
 
-		SYSCALL_ARGUMENTS.rax = ALL_OK;
+  /* Add the implementation of more system calls here. */
 
-		thread_queue_enqueue(&ready_queue,thread_number);
-		/*cpu_private_data.thread_index = thread_number;*/
+  case SYSCALL_TRACEDUMP:
+  {
+   trace_dump();
+   SYSCALL_ARGUMENTS.rax = ALL_OK;
+   break;
+  }
 
+  case SYSCALL_PROFILE:
+  {
+   switch(SYSCALL_ARGUMENTS.rdi)
+   {
+    case PROFILE_START:
+    {
+     SYSCALL_ARGUMENTS.rax = profile_start(SYSCALL_ARGUMENTS.rsi);
+     break;
+    }
+
+    case PROFILE_STOP:
+    {
+     profile_stop();
+     SYSCALL_ARGUMENTS.rax = ALL_OK;
+     break;
+    }
+
+    case PROFILE_DUMP:
+    {
+     profile_dump();
+     SYSCALL_ARGUMENTS.rax = ALL_OK;
+     break;
+    }
+
+    default:
+    {
+     SYSCALL_ARGUMENTS.rax = ERROR;
+    }
+   }
+   break;
+  }
 
-		break;
-	}
-	case SYSCALL_TERMINATE:
-	{
-		int i;
-		int owner_process = thread_table[cpu_private_data.thread_index].data.owner;
-		int parent_process = process_table[owner_process].parent;
+  case SYSCALL_YIELD:
+  {
+   yield_thread(cpu_private_data.thread_index);
+   SYSCALL_ARGUMENTS.rax = ALL_OK;
+   schedule = 1;
+   break;
+  }
 
-		thread_table[cpu_private_data.thread_index].data.owner = -1; /* Terminate Thread */
+  case SYSCALL_SHUTDOWN:
+  {
+   const char* command = "Shutdown";
 
-		process_table[owner_process].threads -= 1; /* Decrement Thread count */
+   outb(DEBUG_EXIT_PORT, SYSCALL_ARGUMENTS.rdi);
 
-		if(process_table[owner_process].threads < 1) {
-			cleanup_process(owner_process);
-		}
+   while (*command)
+   {
+    outb(BOCHS_SHUTDOWN_PORT, *command++);
+   }
 
-		for(i=0; i < MAX_NUMBER_OF_THREADS && thread_table[i].data.owner != parent_process; i++) {
-		}
+   /* The machine could not be powered off. Stop this CPU. */
+   while(1)
+   {
+    __asm volatile("cli\n\thlt");
+   }
+  }
 
-		/*cpu_private_data.thread_index = i;*/
-		/*thread_queue_dequeue(&ready_queue);*/
-		schedule = 1;
+  case SYSCALL_THREADSTATS:
+  {
+   const int thread_index = (-1 == (long) SYSCALL_ARGUMENTS.rdi) ?
+                            cpu_private_data.thread_index :
+                            (int) SYSCALL_ARGUMENTS.rdi;
+   struct thread_statistics* const buffer =
+    (struct thread_statistics*) SYSCALL_ARGUMENTS.rsi;
+
+   /* Only the threads of the calling process can be read. The buffer has
+      to be in a writable part of the calling process. */
+   if ((thread_index < 0) || (thread_index >= thread_table_size) ||
+       (0 == thread_table[thread_index]) ||
+       (thread_scheduling_table[thread_index].owner !=
+        thread_scheduling_table[cpu_private_data.thread_index].owner) ||
+       !user_range_accessible(buffer, sizeof(struct thread_statistics), PF_W))
+   {
+    SYSCALL_ARGUMENTS.rax = ERROR;
+    break;
+   }
+
+   *buffer = thread_table[thread_index]->data.statistics;
+
+   /* Include the time spent in the current state. */
+   {
+    const unsigned long elapsed = rdtsc() -
+     thread_scheduling_table[thread_index].state_timestamp;
+
+    if (THREAD_STATE_RUNNING == thread_scheduling_table[thread_index].state)
+    {
+     buffer->on_cpu_cycles += elapsed;
+    }
+    else if (THREAD_STATE_READY ==
+             thread_scheduling_table[thread_index].state)
+    {
+     buffer->runnable_wait_cycles += elapsed;
+    }
+    else if (THREAD_STATE_BLOCKED ==
+             thread_scheduling_table[thread_index].state)
+    {
+     buffer->mutex_wait_cycles += elapsed;
+    }
+   }
 
-		break;
+   SYSCALL_ARGUMENTS.rax = ALL_OK;
+   break;
+  }
 
-	}
+  case SYSCALL_SPAWN:
+  {
+   SYSCALL_ARGUMENTS.rax = spawn_process(SYSCALL_ARGUMENTS.rdi,
+                                         (const char* const*)
+                                         SYSCALL_ARGUMENTS.rsi,
+                                         SYSCALL_ARGUMENTS.rdx,
+                                         SYSCALL_ARGUMENTS.r10);
+   break;
+  }
 
+  case SYSCALL_SETAFFINITY:
+  case SYSCALL_GETAFFINITY:
+  {
+   const int thread_index = (-1 == (long) SYSCALL_ARGUMENTS.rdi) ?
+                            cpu_private_data.thread_index :
+                            (int) SYSCALL_ARGUMENTS.rdi;
+
+   if ((thread_index < 0) || (thread_index >= thread_table_size) ||
+       (0 == thread_table[thread_index]))
+   {
+    SYSCALL_ARGUMENTS.rax = ERROR;
+   }
+   else if (SYSCALL_GETAFFINITY == SYSCALL_ARGUMENTS.rax)
+   {
+    SYSCALL_ARGUMENTS.rax =
+     thread_scheduling_table[thread_index].allowed_cpus;
+   }
+   else
+   {
+    SYSCALL_ARGUMENTS.rax = set_thread_affinity(thread_index,
+                                                SYSCALL_ARGUMENTS.rsi);
+    schedule = leave_cpu_if_not_allowed();
+   }
+   break;
+  }
 
-  /* Do not touch any lines above or including this line. */
+  case SYSCALL_CPUSET:
+  {
+   SYSCALL_ARGUMENTS.rax = cpuset_command(SYSCALL_ARGUMENTS.rdi,
+                                          (const char*) SYSCALL_ARGUMENTS.rsi,
+                                          SYSCALL_ARGUMENTS.rdx);
+   schedule = leave_cpu_if_not_allowed();
+   break;
+  }
 
-  /* Add the implementation of more system calls here. */
+  case SYSCALL_LOCKSTATS:
+  {
+   lock_dump();
+   SYSCALL_ARGUMENTS.rax = ALL_OK;
+   break;
+  }
 
+  case SYSCALL_INTSTATS:
+  {
+   struct interrupt_statistics* const buffer =
+    (struct interrupt_statistics*) SYSCALL_ARGUMENTS.rdi;
+
+   if (!user_range_accessible(buffer, sizeof(struct interrupt_statistics),
+                              PF_W))
+   {
+    SYSCALL_ARGUMENTS.rax = ERROR;
+    break;
+   }
+
+   *buffer = interrupt_statistics[cpu_private_data.cpu_index];
+   /* The longest time with interrupts disabled is measured per interval
+      between reads. */
+   interrupt_statistics[cpu_private_data.cpu_index].
+    max_interrupts_disabled_cycles = 0;
+   SYSCALL_ARGUMENTS.rax = ALL_OK;
+   break;
+  }
+
+  case SYSCALL_IDLESTATS:
+  {
+   const long                    cpu = SYSCALL_ARGUMENTS.rdi;
+   struct idle_statistics* const buffer =
+    (struct idle_statistics*) SYSCALL_ARGUMENTS.rsi;
+
+   if ((cpu < 0) || (cpu >= MAX_NUMBER_OF_CPUS) ||
+       !user_range_accessible(buffer, sizeof(struct idle_statistics), PF_W))
+   {
+    SYSCALL_ARGUMENTS.rax = ERROR;
+    break;
+   }
+
+   *buffer = idle_statistics[cpu];
+   SYSCALL_ARGUMENTS.rax = ALL_OK;
+   break;
+  }
+
+  case SYSCALL_PERFCOUNT:
+  {
+   SYSCALL_ARGUMENTS.rax = pmu_perfcount(cpu_private_data.thread_index,
+                                         SYSCALL_ARGUMENTS.rdi,
+                                         SYSCALL_ARGUMENTS.rsi);
+   break;
+  }
+
+  case SYSCALL_MUTEXLOCK:
+  {
+   const int thread_index = cpu_private_data.thread_index;
+
+   /* A thread that blocks owns the mutex when it runs again. */
+   SYSCALL_ARGUMENTS.rax = mutex_lock(thread_index, SYSCALL_ARGUMENTS.rdi);
+   schedule = (THREAD_STATE_BLOCKED ==
+               thread_scheduling_table[thread_index].state);
+   break;
+  }
+
+  case SYSCALL_MUTEXUNLOCK:
+  {
+   SYSCALL_ARGUMENTS.rax = mutex_unlock(cpu_private_data.thread_index,
+                                        SYSCALL_ARGUMENTS.rdi);
+   schedule = yield_to_higher_priority();
+   break;
+  }
 
   /* Do not touch any lines below or including this line. */
   default:
@@ -4,66 +4,243 @@
 
 #include "threadqueue.h"
 
+/*! \return The highest priority with a thread in the queue. The queue may
+    not be empty. */
+static inline int
+highest_priority(const struct thread_queue* const queue_ptr)
+{
+ return 31-__builtin_clz(queue_ptr->priorities);
+}
+
+/*! Unlinks a thread from the list of its priority. */
+static inline void
+unlink_thread(struct thread_queue* const queue_ptr,
+              const int priority
+              /*!< The priority the thread was enqueued with. */,
+              const int previous
+              /*!< The thread before it in the list or -1 if it is the
+                   head. */,
+              const int thread_index)
+{
+ const register int next=thread_scheduling_table[thread_index].next;
+
+ if (-1 == previous)
+ {
+  queue_ptr->head[priority]=next;
+ }
+ else
+ {
+  thread_scheduling_table[previous].next=next;
+ }
+ if (thread_index == queue_ptr->tail[priority])
+ {
+  queue_ptr->tail[priority]=previous;
+ }
+ if (-1 == queue_ptr->head[priority])
+ {
+  /* Clear the bit of the priority if its queue becomes empty. */
+  queue_ptr->priorities&=~(1U<<priority);
+ }
+}
+
 void
 thread_queue_init(struct thread_queue* const queue_ptr)
 {
- queue_ptr->head=-1;
- queue_ptr->tail=-1;
+ register int priority;
+
+ for(priority=0; priority<THREAD_PRIORITIES; priority++)
+ {
+  queue_ptr->head[priority]=-1;
+  queue_ptr->tail[priority]=-1;
+ }
+ queue_ptr->priorities=0;
 }
 
 void
 thread_queue_enqueue(struct thread_queue* const queue_ptr,
                     const int thread_index)
 {
- /* Insert the thread as tail. */
+ const register int priority=thread_scheduling_table[thread_index].priority;
+
+ /* Insert the thread as tail of its priority. */
 
  /* There is no next thread since the thread will be the new tail. */
- thread_table[thread_index].data.next=-1;
+ thread_scheduling_table[thread_index].next=-1;
 
- if (thread_queue_is_empty(queue_ptr))
+ if (-1 == queue_ptr->head[priority])
  {
   /* Set both head and tail if the queue is empty. */
-  queue_ptr->head=thread_index;
-  queue_ptr->tail=thread_index;
+  queue_ptr->head[priority]=thread_index;
+  queue_ptr->tail[priority]=thread_index;
+  queue_ptr->priorities|=1U<<priority;
  }
  else
  {
   /* Replace the tail with the thread. */
-  thread_table[queue_ptr->tail].data.next=thread_index;
-  queue_ptr->tail=thread_index;
+  thread_scheduling_table[queue_ptr->tail[priority]].next=thread_index;
+  queue_ptr->tail[priority]=thread_index;
  }
 }
 
 int
-thread_queue_dequeue(struct thread_queue* const queue_ptr)
+thread_queue_dequeue(struct thread_queue* const queue_ptr,
+                     const int cpu)
 {
- if (!thread_queue_is_empty(queue_ptr))
+ register unsigned int priorities=queue_ptr->priorities;
+
+ /* Look at the priorities from the highest down. Usually the head of the
+    highest priority may run on the CPU. */
+ while (0 != priorities)
  {
-  const register int thread_index=queue_ptr->head;
+  const register int priority=31-__builtin_clz(priorities);
+  register int       previous=-1;
+  register int       thread_index=queue_ptr->head[priority];
 
-  /* The queue is not empty so we can remove one thread. */
-  queue_ptr->head=thread_table[thread_index].data.next;
-  if (thread_queue_is_empty(queue_ptr))
+  while (-1 != thread_index)
   {
-   /* Make sure the tail is reset if the queue becomes empty. */
-   queue_ptr->tail=-1;
+   if (0 != (thread_scheduling_table[thread_index].allowed_cpus &
+             (1UL<<cpu)))
+   {
+    unlink_thread(queue_ptr, priority, previous, thread_index);
+    return thread_index;
+   }
+   previous=thread_index;
+   thread_index=thread_scheduling_table[thread_index].next;
   }
-
-  return thread_index;
+  priorities&=~(1U<<priority);
  }
 
- /* Return -1 if the queue was empty. */
+ /* Return -1 if no thread in the queue may run on the CPU. */
  return -1;
 }
 
+void
+thread_queue_remove(struct thread_queue* const queue_ptr,
+                    const int thread_index)
+{
+ const register int priority=thread_scheduling_table[thread_index].priority;
+ register int       previous=-1;
+ register int       current=queue_ptr->head[priority];
+
+ while (thread_index != current)
+ {
+  previous=current;
+  current=thread_scheduling_table[current].next;
+ }
+ unlink_thread(queue_ptr, priority, previous, thread_index);
+}
+
 int
 thread_queue_is_empty(const struct thread_queue* const queue_ptr)
 {
- return -1 == queue_ptr->head;
+ return 0 == queue_ptr->priorities;
 }
 
 int
 thread_queue_head(const struct thread_queue* const queue_ptr)
 {
- return queue_ptr->head;
+ if (thread_queue_is_empty(queue_ptr))
+ {
+  return -1;
+ }
+ return queue_ptr->head[highest_priority(queue_ptr)];
+}
+
+void
+timer_queue_insert(const int     thread_index,
+                   unsigned long timer_ticks)
+{
+ /* The timer queue is a linked list of threads. The head (first entry)
+    (thread) in the list has a list_data field that holds the number of
+    ticks to wait before the thread is made ready. The next entries (threads)
+    has a list_data field that holds the number of ticks to wait after the
+    previous thread is made ready. This is called to use a delta-time and
+    makes the code to test if threads should be made ready very quick. It
+    also, unfortunately, makes the code that insert code into the queue
+    rather complex. */
+
+ /* If the queue is empty put the thread as only entry. */
+ if (-1 == timer_queue_head)
+ {
+  thread_scheduling_table[thread_index].next=-1;
+  thread_scheduling_table[thread_index].list_data=timer_ticks;
+  timer_queue_head=thread_index;
+ }
+ else
+ {
+  /* Check if the thread should be made ready before the head of the
+     previous timer queue. */
+  register int curr_timer_queue_entry=timer_queue_head;
+
+  if (thread_scheduling_table[curr_timer_queue_entry].list_data>timer_ticks)
+  {
+   /* If so set it up as the head in the new timer queue. */
+
+   thread_scheduling_table[curr_timer_queue_entry].list_data-=timer_ticks;
+   thread_scheduling_table[thread_index].next=curr_timer_queue_entry;
+   thread_scheduling_table[thread_index].list_data=timer_ticks;
+   timer_queue_head=thread_index;
+  }
+  else
+  {
+   register int prev_timer_queue_entry = curr_timer_queue_entry;
+
+   /* Search until the end of the queue or until we found the right spot. */
+   while((-1 != thread_scheduling_table[curr_timer_queue_entry].next) &&
+         (timer_ticks>=
+          thread_scheduling_table[curr_timer_queue_entry].list_data))
+   {
+    timer_ticks-=thread_scheduling_table[curr_timer_queue_entry].list_data;
+    prev_timer_queue_entry=curr_timer_queue_entry;
+    curr_timer_queue_entry=thread_scheduling_table[curr_timer_queue_entry].next;
+   }
+
+
+   if (timer_ticks>=thread_scheduling_table[curr_timer_queue_entry].list_data)
+   {
+    /* Insert the thread into the queue after the existing entry. */
+    thread_scheduling_table[thread_index].next=
+     thread_scheduling_table[curr_timer_queue_entry].next;
+    thread_scheduling_table[curr_timer_queue_entry].next=thread_index;
+    thread_scheduling_table[thread_index].list_data=timer_ticks-
+     thread_scheduling_table[curr_timer_queue_entry].list_data;
+   }
+   else
+   {
+    /* Insert the thread into the queue before the existing entry. */
+    thread_scheduling_table[thread_index].next=
+     curr_timer_queue_entry;
+    thread_scheduling_table[prev_timer_queue_entry].next=thread_index;
+    thread_scheduling_table[thread_index].list_data=timer_ticks;
+    thread_scheduling_table[curr_timer_queue_entry].list_data-=timer_ticks;
+   }
+  }
+ }
+}
+
+void
+timer_queue_tick(void)
+{
+ /* Decrement the list_data in the head. */
+ thread_scheduling_table[timer_queue_head].list_data-=1;
+}
+
+int
+timer_queue_remove_expired(void)
+{
+ /* Remove the head if its list_data is equal to zero. We remove all entries
+    less than or equal to 0. Equality should be enough but checking with less
+    than or equal may hide the symptoms of some bugs and make the system more
+    stable. */
+ if ((-1 != timer_queue_head) &&
+     (thread_scheduling_table[timer_queue_head].list_data<=0))
+ {
+  const register int thread_index=timer_queue_head;
+
+  timer_queue_head=thread_scheduling_table[thread_index].next;
+  return thread_index;
+ }
+
+ /* Return -1 if no thread should be woken up. */
+ return -1;
 }
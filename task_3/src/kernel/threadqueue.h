@@ -9,12 +9,20 @@
 
 struct thread_queue
 {
- int head;  /*!< The index to the head of the thread queue.
-                 Is -1 if queue is empty. */
- int tail;  /*!< The index to the tail of the thread queue.
-                 Is -1 if queue is empty. */
+ int          head[THREAD_PRIORITIES];
+                   /*!< The index to the head of the queue of each priority.
+                        Is -1 if that queue is empty. */
+ int          tail[THREAD_PRIORITIES];
+                   /*!< The index to the tail of the queue of each priority.
+                        Is -1 if that queue is empty. */
+ unsigned int priorities;
+                   /*!< Bit i is set iff the queue of priority i is not
+                        empty. */
 };
-/*!< Describes a queue of threads. */
+/*!< Describes a queue of threads. Threads are queued by the priority they
+     have when they are enqueued, which may not change until they are
+     dequeued. Threads of higher priority leave the queue first and threads
+     of the same priority leave in the order they were enqueued. */
 
 /*! Initialize a thread queue. */
 extern void
@@ -22,7 +30,7 @@ thread_queue_init(struct thread_queue* const queue_ptr
                   /*!< Points to the thread queue to be initialized. */);
 
 /*! Enqueue one thread into the thread queue. The thread will be placed at
-    the end of the queue. */
+    the end of the threads with its priority. */
 extern void
 thread_queue_enqueue(struct thread_queue* const queue_ptr
                     /*!< Points to the thread queue. */,
@@ -30,11 +38,26 @@ thread_queue_enqueue(struct thread_queue* const queue_ptr
                     /*!< Index, into thread_table, of the thread to be
                          inserted into the thread queue. */);
 
-/*! Remove the  head of the queue. \returns the index, into thread_table, of
-    the thread removed from the thread queue.*/
+/*! Remove the first thread of the highest priority that may run on a CPU.
+    Threads that may not run on the CPU keep their place in the queue.
+    \returns the index, into thread_table, of the thread removed from the
+    thread queue or -1 if no thread in the queue may run on the CPU. */
 extern int
 thread_queue_dequeue(struct thread_queue* const queue_ptr
-                    /*!< Points to the thread queue. */);
+                    /*!< Points to the thread queue. */,
+                     const int cpu
+                     /*!< The index of the CPU. A thread may run on it if
+                          bit cpu of its allowed_cpus is set. */);
+
+/*! Remove a thread from the thread queue. The thread has to be in the queue
+    and have the priority it was enqueued with. Used to change the priority
+    of a queued thread. */
+extern void
+thread_queue_remove(struct thread_queue* const queue_ptr
+                    /*!< Points to the thread queue. */,
+                    const int thread_index
+                    /*!< Index, into thread_table, of the thread to be
+                         removed from the thread queue. */);
 
 /*! Checks if the queue is empty. \returns 1 if the queue is empty.
     Returns 0 otherwise. */
@@ -48,4 +71,25 @@ thread_queue_is_empty(const struct thread_queue* const queue_ptr
 extern int
 thread_queue_head(const struct thread_queue* const queue_ptr
                   /*!< Points to the thread queue. */);
+
+/*! Inserts a thread into the timer queue. The timer queue is a linked list
+    of threads sorted on the time they should be woken up. The time is stored
+    as a delta to the previous thread in the list. */
+extern void
+timer_queue_insert(const int     thread_index
+                   /*!< Index, into thread_table, of the thread to be
+                        inserted into the timer queue. */,
+                   unsigned long timer_ticks
+                   /*!< The number of ticks to wait. Must be at least 1. */);
+
+/*! Advances the timer queue one clock tick. The queue must not be empty. */
+extern void
+timer_queue_tick(void);
+
+/*! Removes the head of the timer queue if it should be woken up. Call
+    repeatedly after timer_queue_tick until it returns -1.
+    \returns the index, into thread_table, of the thread removed from the
+    timer queue or -1 if no thread should be woken up. */
+extern int
+timer_queue_remove_expired(void);
 #endif
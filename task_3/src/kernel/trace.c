@@ -0,0 +1,100 @@
+/*! \file trace.c
+ * This file implements the kernel event trace.
+ */
+
+#include "trace.h"
+#include "memory.h"
+#include "paging.h"
+
+/* Note: Look in trace.h for documentation of global variables and
+   functions. */
+
+/* Variables */
+
+struct trace_buffer
+trace_buffers[MAX_NUMBER_OF_CPUS];
+
+/*! The time stamp counter when tracing started, i.e., at system time 0. Used
+    by the host side decoder to find the frequency of the time stamp
+    counter. */
+static unsigned long
+trace_start_timestamp;
+
+/* Function definitions */
+
+void
+initialize_trace(void)
+{
+ struct trace_buffer* const buffer =
+  &trace_buffers[cpu_private_data.cpu_index];
+
+ buffer->records = (struct trace_record*)
+  allocate_page_frames((TRACE_BUFFER_RECORDS*sizeof(struct trace_record))/
+                       PAGE_SIZE, 1);
+ buffer->next = 0;
+
+ if (0 == cpu_private_data.cpu_index)
+ {
+  trace_start_timestamp = rdtsc();
+ }
+}
+
+void
+trace_dump(void)
+{
+ register int i;
+
+ /* The clock line relates the time stamp counter to the system time. */
+ kprints("TRACE CLOCK ");
+ kprinthex(system_time);
+ kprints(" ");
+ kprinthex(rdtsc() - trace_start_timestamp);
+ kprints(" ");
+ kprinthex(trace_start_timestamp);
+ kprints("\n");
+
+ for(i=0; i<MAX_NUMBER_OF_CPUS; i++)
+ {
+  struct trace_buffer* const buffer = &trace_buffers[i];
+  unsigned long              record_index;
+
+  if (0 == buffer->records)
+  {
+   continue;
+  }
+
+  /* Only the last TRACE_BUFFER_RECORDS records are left in the buffer. */
+  record_index = (buffer->next > TRACE_BUFFER_RECORDS) ?
+                 buffer->next - TRACE_BUFFER_RECORDS : 0;
+
+  kprints("TRACE LOST ");
+  kprinthex(i);
+  kprints(" ");
+  kprinthex(record_index);
+  kprints("\n");
+
+  for(; record_index<buffer->next; record_index++)
+  {
+   const struct trace_record* const record =
+    &buffer->records[record_index & (TRACE_BUFFER_RECORDS-1)];
+
+   kprints("TRACE ");
+   kprinthex(record->timestamp);
+   kprints(" ");
+   kprinthex(record->cpu);
+   kprints(" ");
+   kprinthex(record->event);
+   kprints(" ");
+   kprinthex(record->arg0);
+   kprints(" ");
+   kprinthex(record->arg1);
+   kprints("\n");
+
+   /* Records written by interrupt handlers meanwhile are dumped as well,
+      as the loop reads next again. */
+   kernel_preemption_point();
+  }
+
+  buffer->next = 0;
+ }
+}
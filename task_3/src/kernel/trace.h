@@ -0,0 +1,114 @@
+/*! \file trace.h
+ * This file defines the kernel event trace. Events are written as fixed size
+ * binary records to a ring buffer private to each CPU. Writing a record only
+ * costs a few stores and a rdtsc, so events can be traced from the interrupt
+ * handlers and the scheduler. The buffer is dumped to the debug port on
+ * demand and decoded on the host by src/tools/trace2json.py.
+ */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include "kernel.h"
+
+#define TRACE_BUFFER_RECORDS (4096)
+/*!< The number of records in the ring buffer of each CPU. Must be a power of
+     two. When the buffer is full the oldest records are overwritten. */
+
+#define TRACE_EVENT_CONTEXT_SWITCH (1)
+/*!< The CPU switches thread. arg0 is the index of the previous thread and
+     arg1 the index of the next thread. -1 is the idle thread. */
+#define TRACE_EVENT_SYSCALL_ENTER  (2)
+/*!< A thread makes a system call. arg0 is the system call number and arg1
+     the thread index. */
+#define TRACE_EVENT_SYSCALL_EXIT   (3)
+/*!< A system call returns. arg0 is the return value and arg1 the thread
+     index. */
+#define TRACE_EVENT_WAKEUP         (4)
+/*!< A thread is woken up from the timer queue. arg0 is the thread index and
+     arg1 is 1 if the thread runs at once, 0 if it is made ready. */
+#define TRACE_EVENT_TIMER_EXPIRY   (5)
+/*!< The head of the timer queue expires. arg0 is the system time and arg1
+     the number of threads woken up. */
+#define TRACE_EVENT_PROCESS_CREATE (6)
+/*!< A process is created. arg0 is the process index and arg1 the number of
+     cycles it took to prepare the process. */
+#define TRACE_EVENT_PROCESS_EXIT   (7)
+/*!< A process terminates. arg0 is the process index and arg1 the number of
+     resident pages. */
+#define TRACE_EVENT_PROCESS_START  (8)
+/*!< A process runs for the first time. arg0 is the process index and arg1
+     the number of cycles from its creation. */
+
+/*! Defines a trace record. */
+struct trace_record
+{
+ unsigned long  timestamp;  /*!< The time stamp counter when the event
+                                 happened. */
+ unsigned short cpu;        /*!< Index of the CPU the event happened on. */
+ unsigned short event;      /*!< One of the TRACE_EVENT_ values. */
+ unsigned int   reserved;   /*!< Pads the record to 32 bytes. */
+ unsigned long  arg0;       /*!< Event specific argument. */
+ unsigned long  arg1;       /*!< Event specific argument. */
+};
+
+/*! Defines the trace ring buffer of a CPU. */
+struct trace_buffer
+{
+ struct trace_record* records;
+                            /*!< Points to TRACE_BUFFER_RECORDS records. 0
+                                 until initialize_trace has been called on
+                                 the CPU. */
+ unsigned long        next; /*!< The number of records ever written. The next
+                                 record is written at next modulo
+                                 TRACE_BUFFER_RECORDS. */
+};
+
+/* Variable declarations */
+
+extern struct trace_buffer
+trace_buffers[MAX_NUMBER_OF_CPUS];
+/*!< The trace buffer of each CPU. */
+
+/* Function declarations */
+
+/*! Allocates the trace buffer of the calling CPU and starts tracing. Called
+    from initialize after the page frame allocator is set up. */
+extern void
+initialize_trace(void);
+
+/*! Writes the trace buffer of each CPU to the debug port and empties the
+    buffers. Records are written as text lines that start with "TRACE". A
+    preemption point is passed after each record. */
+extern void
+trace_dump(void);
+
+/*! Records an event in the trace buffer of the calling CPU. Does nothing if
+    the buffer has not been allocated. */
+inline static void
+trace_event(const unsigned int  event
+            /*!< One of the TRACE_EVENT_ values. */,
+            const unsigned long arg0
+            /*!< Event specific argument. */,
+            const unsigned long arg1
+            /*!< Event specific argument. */)
+{
+ struct trace_buffer* const buffer =
+  &trace_buffers[cpu_private_data.cpu_index];
+ struct trace_record*       record;
+
+ if (0 == buffer->records)
+ {
+  return;
+ }
+
+ record = &buffer->records[buffer->next & (TRACE_BUFFER_RECORDS-1)];
+ record->timestamp = rdtsc();
+ record->cpu = cpu_private_data.cpu_index;
+ record->event = event;
+ record->arg0 = arg0;
+ record->arg1 = arg1;
+ buffer->next++;
+}
+
+#endif
@@ -8,15 +8,9 @@
  .text
  .global _start
 _start:
- # Set up the stack pointer
- lea    stack(%rip),%rsp
- # Set up the environment for the main function
- lea    name(%rip),%rax
- mov    %rax,argv(%rip)
- # Get the address of the argv array
- lea    argv(%rip),%rsi
- # Call the main function
- mov    $1,%rdi
+ # The kernel has set up the stack below the arguments of the process and
+ # passes argc in rdi and argv in rsi. They are passed on to main as they
+ # are.
  call   main
  # Perform a terminate system call
  mov    $4,%rax
@@ -25,13 +19,3 @@ _start:
  # To catch faulty implementations we use a hlt. Hlt is illegal in user mode
  # and should fail.
  hlt 
- .section .rodata
-name:
- .asciz "dummy"
-
- .bss
- .align 8
-argv:
- .skip  16
- .skip  8*1024
-stack:
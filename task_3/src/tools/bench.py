@@ -0,0 +1,188 @@
+#!/usr/bin/env python3
+"""Runs the benchmark programs under QEMU and checks them against a baseline.
+
+The kernel has to be built with a benchmark selected, which make bench does.
+This script boots it headless, reads the debug port (0xe9) from standard
+output and waits for the benchmark program to shut the machine down through
+the isa-debug-exit device. The BENCH lines are written as JSON and compared
+with a baseline. A metric that is more than the threshold slower than in the
+baseline is a regression. Run from the task directory,
+
+    bench.py --output objects/bench.json --baseline baseline.json
+
+Use --update-baseline to store the results as the new baseline. The exit
+status is 0 on success, 1 if a regression was found and 2 if the run failed.
+"""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+
+# Must match DEBUG_EXIT_PORT in src/kernel/kernel.h.
+DEBUG_EXIT_PORT = 0xf4
+
+# The status QEMU exits with when the benchmark program calls shutdown(0).
+QEMU_SUCCESS = (0 << 1) | 1
+
+# Values that tell apart lines of the same benchmark.
+PARAMETERS = ("ticks", "kernel_page_kib", "preemption_points_built",
+              "mwait", "controller")
+
+# Values that are compared with the baseline. Lower is better for all.
+METRICS = ("cycles_per_op", "cycles_per_byte", "dtlb_load_misses_per_page",
+           "max_interrupts_disabled_cycles", "cycles_per_wakeup",
+           "entry_to_eoi_cycles", "eoi_cycles")
+
+
+def qemu_command(args):
+    command = [args.qemu, "-kernel", args.kernel, "-m", "128",
+               "-display", "none", "-serial", "none", "-monitor", "none",
+               "-no-reboot", "-debugcon", "stdio",
+               "-device", "isa-debug-exit,iobase=0x%x,iosize=0x04"
+               % DEBUG_EXIT_PORT]
+    if args.initrd:
+        command += ["-initrd", args.initrd]
+    if args.kvm and os.access("/dev/kvm", os.R_OK | os.W_OK):
+        command += ["-enable-kvm", "-cpu", "host"]
+    else:
+        command += ["-cpu", "max"]
+    return command
+
+
+def run(args):
+    """Boots the kernel and returns the debug port output."""
+    command = qemu_command(args)
+    print(" ".join(command), file=sys.stderr)
+    try:
+        result = subprocess.run(command, stdout=subprocess.PIPE,
+                                stdin=subprocess.DEVNULL,
+                                timeout=args.timeout)
+    except subprocess.TimeoutExpired as expired:
+        sys.stderr.buffer.write(expired.stdout or b"")
+        print("QEMU did not stop within %d seconds." % args.timeout,
+              file=sys.stderr)
+        sys.exit(2)
+    output = result.stdout.decode("ascii", "replace")
+    if result.returncode != QEMU_SUCCESS:
+        sys.stderr.write(output)
+        print("QEMU exited with status %d." % result.returncode,
+              file=sys.stderr)
+        sys.exit(2)
+    return output
+
+
+def parse(lines):
+    """Returns the results found in the BENCH lines, keyed on the benchmark
+    name and its parameters."""
+    results = {}
+    done = False
+    for line in lines:
+        fields = line.split()
+        if not fields or fields[0] != "BENCH":
+            continue
+        if fields[1:] == ["done"]:
+            done = True
+            continue
+        values = {}
+        for field in fields[2:]:
+            key, separator, value = field.partition("=")
+            if not separator:
+                sys.exit("Bad benchmark line: " + line.strip())
+            values[key] = int(value)
+        name = " ".join([fields[1]] + ["%s=%d" % (key, values[key])
+                                       for key in PARAMETERS
+                                       if key in values])
+        results[name] = values
+    if not done:
+        print("The benchmark program did not finish.", file=sys.stderr)
+        sys.exit(2)
+    return results
+
+
+def compare(results, baseline, threshold):
+    """Prints the results next to the baseline and returns the number of
+    regressions."""
+    regressions = 0
+    print("%-28s %-16s %14s %14s %8s" % ("benchmark", "metric", "baseline",
+                                         "result", "change"))
+    for name in sorted(results):
+        for metric in METRICS:
+            if metric not in results[name]:
+                continue
+            value = results[name][metric]
+            old = baseline.get(name, {}).get(metric)
+            if not old:
+                print("%-28s %-16s %14s %14d" % (name, metric, "-", value))
+                continue
+            change = (value - old) / old
+            flag = ""
+            if change > threshold:
+                flag = "  REGRESSION"
+                regressions += 1
+            print("%-28s %-16s %14d %14d %+7.1f%%%s"
+                  % (name, metric, old, value, 100 * change, flag))
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--qemu", default="qemu-system-x86_64",
+                        help="the QEMU program")
+    parser.add_argument("--kernel", default="objects/kernel/kernel.stripped",
+                        help="the multiboot kernel image")
+    parser.add_argument("--initrd",
+                        help="a cpio archive of executables passed to the "
+                             "kernel as a boot module")
+    parser.add_argument("--no-kvm", dest="kvm", action="store_false",
+                        help="do not use KVM even when it is available")
+    parser.add_argument("--timeout", type=int, default=600,
+                        help="seconds to wait for the benchmarks")
+    parser.add_argument("--log", type=argparse.FileType("r"),
+                        help="parse this debug port log instead of "
+                             "running QEMU")
+    parser.add_argument("--output", help="where to write the JSON results")
+    parser.add_argument("--baseline", help="the JSON results to compare with")
+    parser.add_argument("--threshold", type=float, default=0.10,
+                        help="the relative slowdown that is a regression")
+    parser.add_argument("--update-baseline", action="store_true",
+                        help="store the results as the baseline")
+    args = parser.parse_args()
+
+    if args.log:
+        output = args.log.read()
+    else:
+        output = run(args)
+    results = parse(output.splitlines())
+
+    if args.output:
+        with open(args.output, "w") as output_file:
+            json.dump(results, output_file, indent=1, sort_keys=True)
+            output_file.write("\n")
+
+    if not args.baseline:
+        compare(results, {}, args.threshold)
+        return
+    if args.update_baseline:
+        with open(args.baseline, "w") as baseline_file:
+            json.dump(results, baseline_file, indent=1, sort_keys=True)
+            baseline_file.write("\n")
+        print("Stored the results in " + args.baseline)
+        return
+    if not os.path.exists(args.baseline):
+        compare(results, {}, args.threshold)
+        print("There is no baseline. Store one with "
+              "make bench BENCH_FLAGS=--update-baseline.")
+        return
+    with open(args.baseline) as baseline_file:
+        baseline = json.load(baseline_file)
+    regressions = compare(results, baseline, args.threshold)
+    if regressions:
+        print("%d regressions beyond %.0f%%."
+              % (regressions, 100 * args.threshold))
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
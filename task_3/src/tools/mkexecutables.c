@@ -0,0 +1,168 @@
+/*!
+ * \file mkexecutables.c
+ * \brief
+ *  Builds the executable table of the kernel. The program runs on the build
+ *  host and validates the program images with the elf.c used by the kernel.
+ *  It writes a C file that embeds the images in the kernel image and
+ *  defines executable_table with the description of each image, so that the
+ *  kernel does not have to look at the ELF headers when it boots. The
+ *  images get the indices they have on the command line.
+ *
+ *  usage: mkexecutables output.c [image...]
+ *
+ *  With no images the kernel has to get its programs from boot modules.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "kernel.h"
+#include "elf.h"
+
+/*! Reads a file into memory. \return The contents or 0 on failure. */
+static void*
+read_file(const char* const path, unsigned long* const size)
+{
+ FILE* file=fopen(path, "rb");
+ long  length;
+ void* contents;
+
+ if (0 == file)
+ {
+  return 0;
+ }
+
+ if ((0 != fseek(file, 0, SEEK_END)) || (0 > (length=ftell(file))) ||
+     (0 != fseek(file, 0, SEEK_SET)))
+ {
+  fclose(file);
+  return 0;
+ }
+
+ /* The ELF headers are read in place, so align the buffer. */
+ contents=aligned_alloc(8, (length+8)&~7L);
+ if ((0 != contents) && (1 != fread(contents, length, 1, file)) &&
+     (0 != length))
+ {
+  free(contents);
+  contents=0;
+ }
+ fclose(file);
+
+ *size=length;
+ return contents;
+}
+
+int
+main(int argc, char* argv[])
+{
+ static struct executable executables[MAX_NUMBER_OF_EXECUTABLES];
+ const int                number_of_executables=argc-2;
+ unsigned long            checksum=ELF_CHECKSUM_START;
+ FILE*                    output;
+ int                      i;
+ int                      j;
+
+ if (argc < 2)
+ {
+  fprintf(stderr, "usage: %s output.c [image...]\n", argv[0]);
+  return 2;
+ }
+
+ if (number_of_executables > MAX_NUMBER_OF_EXECUTABLES)
+ {
+  fprintf(stderr, "Too many executable images, at most %d are allowed.\n",
+          MAX_NUMBER_OF_EXECUTABLES);
+  return 1;
+ }
+
+ for(i=0; i<number_of_executables; i++)
+ {
+  const char* const path=argv[i+2];
+  unsigned long     size;
+  void* const       image=read_file(path, &size);
+  const char*       error;
+
+  if (0 == image)
+  {
+   perror(path);
+   return 1;
+  }
+
+  error=elf_describe_executable(image, size, &executables[i]);
+  if (0 != error)
+  {
+   fprintf(stderr, "%s: %s\n", path, error);
+   return 1;
+  }
+
+  checksum=elf_checksum(checksum, &executables[i]);
+  free(image);
+ }
+
+ output=fopen(argv[1], "w");
+ if (0 == output)
+ {
+  perror(argv[1]);
+  return 1;
+ }
+
+ fprintf(output,
+         "/* Generated by mkexecutables. Do not edit. */\n\n"
+         "#include \"kernel.h\"\n\n"
+         "/* The program images. ELF headers are read in place, so the\n"
+         "   images are 8 byte aligned. */\n"
+         "__asm(\" .section .rodata.executables,\\\"a\\\"\\n\"\n");
+ for(i=0; i<number_of_executables; i++)
+ {
+  fprintf(output,
+          "      \" .balign 8\\n\"\n"
+          "      \"executable_image_%d:\\n\"\n"
+          "      \" .incbin \\\"%s\\\"\\n\"\n", i, argv[i+2]);
+ }
+ fprintf(output, "      \" .previous\\n\");\n\n");
+
+ for(i=0; i<number_of_executables; i++)
+ {
+  fprintf(output, "extern const struct Elf64_Ehdr executable_image_%d;\n",
+          i);
+ }
+
+ fprintf(output, "\nstruct executable\n"
+                 "executable_table[MAX_NUMBER_OF_EXECUTABLES] =\n{\n%s",
+         (0 == number_of_executables) ? " {0}\n" : "");
+ for(i=0; i<number_of_executables; i++)
+ {
+  fprintf(output, " /* %s */\n"
+                  " {&executable_image_%d, 0x%lx, 0x%lx, 0x%lx, %lu, %d, %d,\n"
+                  "  {",
+          argv[i+2], i, executables[i].memory_footprint_size,
+          executables[i].entry_point, executables[i].relocations,
+          executables[i].number_of_relocations,
+          executables[i].position_independent,
+          executables[i].number_of_segments);
+  for(j=0; j<executables[i].number_of_segments; j++)
+  {
+   const struct executable_segment* const segment=
+    &executables[i].segments[j];
+
+   fprintf(output, "%s{0x%lx, 0x%lx, 0x%lx, 0x%lx, 0x%lx}",
+           (0 == j) ? "" : ",\n   ", segment->offset, segment->address,
+           segment->file_size, segment->memory_size, segment->flags);
+  }
+  fprintf(output, "}}%s\n", (i+1 < number_of_executables) ? "," : "");
+ }
+ fprintf(output, "};\n\n"
+                 "int\n"
+                 "executable_table_size = %d;\n\n"
+                 "const unsigned long\n"
+                 "executable_table_checksum = 0x%lxUL;\n",
+         number_of_executables, checksum);
+
+ if (0 != fclose(output))
+ {
+  perror(argv[1]);
+  return 1;
+ }
+ return 0;
+}
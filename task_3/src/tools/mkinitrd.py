@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+"""Packs executable images into a cpio archive the kernel loads at boot.
+
+The archive uses the "newc" cpio format. Pass it to the kernel as a
+multiboot module, for example with
+
+    qemu-system-x86_64 -kernel objects/kernel/kernel.stripped \\
+        -initrd objects/initrd.cpio
+
+The executables get the indices following the executables embedded in the
+kernel image, in the order they are given on the command line.
+"""
+
+import argparse
+import os
+import sys
+
+# Must match CPIO_MODE_REGULAR in src/kernel/initrd.h.
+CPIO_MODE_REGULAR = 0o100000
+
+
+def pad(data):
+    """Pads data to a multiple of 4 bytes as the newc format requires."""
+    return data + b"\0" * (-len(data) % 4)
+
+
+def entry(index, name, data, mode):
+    name = name.encode("ascii") + b"\0"
+    fields = (index, mode, 0, 0, 1, 0, len(data), 0, 0, 0, 0, len(name), 0)
+    header = b"070701" + b"".join(b"%08x" % field for field in fields)
+    return pad(header + name) + pad(data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("output", help="the archive to write")
+    parser.add_argument("images", nargs="+", help="the executable images")
+    args = parser.parse_args()
+
+    archive = b""
+    for index, path in enumerate(args.images):
+        with open(path, "rb") as image:
+            data = image.read()
+        if data[:4] != b"\x7fELF":
+            sys.exit("%s is not an ELF image." % path)
+        archive += entry(index + 1, "%02d_%s" % (index, os.path.basename(
+            os.path.dirname(path)) or os.path.basename(path)), data,
+            CPIO_MODE_REGULAR | 0o644)
+    archive += entry(0, "TRAILER!!!", b"", 0)
+
+    with open(args.output, "wb") as output:
+        output.write(archive)
+
+
+if __name__ == "__main__":
+    main()
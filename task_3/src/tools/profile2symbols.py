@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+"""Maps profiler samples to symbols and prints the hot spots.
+
+The kernel writes the samples to the debug port when a program calls
+profile(PROFILE_DUMP, 0). Capture the debug port output to a file and run,
+from the task directory,
+
+    profile2symbols.py debug.log
+
+Samples in user programs are mapped with objects/program_N/executable and
+samples in the kernel with objects/kernel/kernel64. Both have to be the
+unstripped files from the build that produced the samples.
+"""
+
+import argparse
+import bisect
+import collections
+import os
+import subprocess
+import sys
+
+# The address user programs are mapped at. Must match USER_SPACE_START in
+# src/kernel/paging.h.
+USER_SPACE_START = 0x8000000000
+
+
+def signed(value):
+    """Interprets a 64 bit value printed by kprinthex as signed."""
+    return value - (1 << 64) if value >= (1 << 63) else value
+
+
+class SymbolTable:
+    """The function symbols of an ELF file sorted on address."""
+
+    def __init__(self, path, nm):
+        self.addresses = []
+        self.names = []
+        output = subprocess.run([nm, "-n", "--defined-only", path],
+                                check=True, capture_output=True,
+                                text=True).stdout
+        for line in output.splitlines():
+            fields = line.split()
+            if len(fields) == 3 and fields[1] in "tTwW":
+                self.addresses.append(int(fields[0], 16))
+                self.names.append(fields[2])
+
+    def lookup(self, address):
+        index = bisect.bisect_right(self.addresses, address) - 1
+        if index < 0:
+            return "0x%x" % address
+        return self.names[index]
+
+
+def parse(lines):
+    """Returns the sample rate and the samples found in the debug port log."""
+    rate = None
+    samples = []
+    for line in lines:
+        fields = line.split()
+        if not fields or fields[0] != "PROFILE":
+            continue
+        if fields[1] == "RATE":
+            rate = int(fields[2], 16)
+        elif fields[1] == "DROPPED":
+            cpu, dropped = (int(field, 16) for field in fields[2:4])
+            if dropped:
+                print("cpu %d: %d samples were dropped" % (cpu, dropped),
+                      file=sys.stderr)
+        else:
+            cpu, process, executable, rip = (int(field, 16)
+                                             for field in fields[1:5])
+            samples.append((cpu, signed(process), signed(executable), rip))
+    return rate, samples
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("log", nargs="?", type=argparse.FileType("r"),
+                        default=sys.stdin,
+                        help="debug port output holding a profile dump")
+    parser.add_argument("--objects", default="objects",
+                        help="the directory holding the build output")
+    parser.add_argument("--nm", default="x86_64-unknown-elf-nm",
+                        help="the nm program used to read the symbols")
+    parser.add_argument("--top", type=int, default=30,
+                        help="the number of functions to print")
+    args = parser.parse_args()
+
+    rate, samples = parse(args.log)
+    if not samples:
+        sys.exit("No profile samples found.")
+
+    tables = {}
+
+    def symbols(executable):
+        if executable not in tables:
+            if executable < 0:
+                path = os.path.join(args.objects, "kernel", "kernel64")
+            else:
+                path = os.path.join(args.objects, "program_%d" % executable,
+                                    "executable")
+            tables[executable] = SymbolTable(path, args.nm)
+        return tables[executable]
+
+    counts = collections.Counter()
+    for cpu, process, executable, rip in samples:
+        if executable < 0:
+            image = "kernel"
+            name = symbols(executable).lookup(rip)
+        else:
+            image = "program_%d" % executable
+            name = symbols(executable).lookup(rip - USER_SPACE_START)
+        counts[(image, name)] += 1
+
+    if rate:
+        print("%d samples at %d samples per second" % (len(samples), rate))
+    else:
+        print("%d samples" % len(samples))
+    print("%8s %6s  %-10s %s" % ("samples", "%", "image", "function"))
+    for (image, name), count in counts.most_common(args.top):
+        print("%8d %6.2f  %-10s %s" % (count, 100.0 * count / len(samples),
+                                       image, name))
+
+
+if __name__ == "__main__":
+    main()
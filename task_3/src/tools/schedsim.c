@@ -0,0 +1,396 @@
+/*!
+ * \file schedsim.c
+ * \brief
+ *  A deterministic simulator of the scheduler and the timer queue. The
+ *  program runs on the build host and is linked with the scheduler.c and
+ *  threadqueue.c used by the kernel. It replaces the hardware with a
+ *  simulated clock and plays the role of the system call and timer interrupt
+ *  handlers in kernel.c. The threads run a synthetic workload: CPU bursts of
+ *  random length, each followed by a pause, a yield or another system call.
+ *
+ *  The same seed always gives the same result, so scheduling policies can be
+ *  compared by changing scheduler.c and running the simulator again.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "kernel.h"
+#include "threadqueue.h"
+
+#define NANOSECONDS_PER_TICK (5000000UL)
+/*!< The length of a clock tick. There are 200 clock ticks per second. */
+#define SYSCALL_NANOSECONDS  (200UL)
+/*!< The simulated cost of a system call including the scheduler. */
+
+/* The kernel variables used by scheduler.c and threadqueue.c. */
+
+struct thread_scheduling_data*
+thread_scheduling_table;
+
+int
+timer_queue_head=-1;
+
+struct thread_queue
+ready_queue;
+
+long
+system_time;
+
+struct CPU_private
+cpu_private_data;
+
+/*! The workload. Set from the command line. */
+static struct
+{
+ int           threads;         /*!< The number of threads. */
+ long          ticks;           /*!< The number of clock ticks to run. */
+ unsigned long burst_ns;        /*!< The mean length of a CPU burst. */
+ int           pause_percent;   /*!< Bursts followed by a pause. */
+ int           yield_percent;   /*!< Bursts followed by a yield. */
+ int           max_pause_ticks; /*!< Pauses last 1 to this many ticks. */
+ unsigned long seed;            /*!< Seeds the random number generator. */
+} workload = {1000, 2000, 500000, 30, 10, 20, 1};
+
+/*! The simulator's view of a thread. */
+struct simulated_thread
+{
+ unsigned long burst_left;      /*!< The time left of the current burst. */
+ unsigned long state_since;     /*!< When the thread entered its state. */
+ unsigned long woken_at;        /*!< When the thread left the timer queue,
+                                     0 if it has run since. */
+ unsigned long cpu_ns;          /*!< The time spent running. */
+};
+
+static struct simulated_thread* threads;
+
+/*! The simulated time in nanoseconds. */
+static unsigned long now;
+
+/*! A growable array of latencies. */
+struct samples
+{
+ unsigned long* values;
+ unsigned long  count;
+ unsigned long  size;
+};
+
+static struct samples dispatch_latencies;
+/*!< The time from entering the ready queue to running. */
+static struct samples wakeup_latencies;
+/*!< The time from leaving the timer queue to running. */
+
+static unsigned long bursts;
+/*!< The number of CPU bursts completed. */
+static unsigned long context_switches;
+/*!< The number of times the CPU changed thread. */
+static unsigned long idle_ns;
+/*!< The time the CPU had no thread to run. */
+
+/*! \return A pseudo random number. */
+static unsigned long
+random_number(void)
+{
+ workload.seed=workload.seed*6364136223846793005UL+1442695040888963407UL;
+ return workload.seed>>33;
+}
+
+/*! \return An exponentially distributed burst length. */
+static unsigned long
+random_burst(void)
+{
+ const double uniform=(random_number()+1.0)/(double) (1UL<<31);
+
+ return 1+(unsigned long) (-log(uniform)*workload.burst_ns);
+}
+
+static void
+add_sample(struct samples* const samples, const unsigned long value)
+{
+ if (samples->count == samples->size)
+ {
+  samples->size=samples->size ? 2*samples->size : 4096;
+  samples->values=realloc(samples->values,
+                          samples->size*sizeof(unsigned long));
+  if (0 == samples->values)
+  {
+   fprintf(stderr, "Out of memory\n");
+   exit(1);
+  }
+ }
+ samples->values[samples->count++]=value;
+}
+
+/*! Replaces set_thread_state in kernel.c. Keeps time with the simulated
+    clock instead of the time stamp counter. */
+void
+set_thread_state(const int thread_index,
+                 const int state)
+{
+ struct simulated_thread* const thread=&threads[thread_index];
+ const int                      old_state=
+  thread_scheduling_table[thread_index].state;
+
+ if (THREAD_STATE_RUNNING == old_state)
+ {
+  thread->cpu_ns+=now-thread->state_since;
+ }
+ else if (THREAD_STATE_SLEEPING == old_state)
+ {
+  thread->woken_at=now;
+ }
+
+ if (THREAD_STATE_RUNNING == state)
+ {
+  if (THREAD_STATE_READY == old_state)
+  {
+   add_sample(&dispatch_latencies, now-thread->state_since);
+  }
+  if (0 != thread->woken_at)
+  {
+   add_sample(&wakeup_latencies, now-thread->woken_at);
+   thread->woken_at=0;
+  }
+ }
+
+ thread_scheduling_table[thread_index].state=state;
+ thread->state_since=now;
+}
+
+/*! Counts a context switch if the running thread changed. */
+static void
+check_switch(const int previous_thread_index)
+{
+ if (previous_thread_index != cpu_private_data.thread_index)
+ {
+  context_switches++;
+ }
+}
+
+/*! Does what system_call_handler in kernel.c does when the running thread
+    ends a burst with a system call. */
+static void
+simulate_system_call(void)
+{
+ const int     thread_index=cpu_private_data.thread_index;
+ const int     action=random_number()%100;
+ register int  schedule=0;
+
+ now+=SYSCALL_NANOSECONDS;
+ threads[thread_index].burst_left=random_burst();
+
+ if (action < workload.pause_percent)
+ {
+  set_thread_state(thread_index, THREAD_STATE_SLEEPING);
+  timer_queue_insert(thread_index,
+                     1+random_number()%workload.max_pause_ticks);
+  schedule=1;
+ }
+ else if (action < workload.pause_percent+workload.yield_percent)
+ {
+  set_thread_state(thread_index, THREAD_STATE_READY);
+  thread_queue_enqueue(&ready_queue, thread_index);
+  schedule=1;
+ }
+
+ scheduler_called_from_system_call_handler(schedule);
+ check_switch(thread_index);
+}
+
+/*! Does what timer_interrupt_handler in kernel.c does on a clock tick. */
+static void
+simulate_timer_interrupt(void)
+{
+ register int thread_changed=0;
+ const int    interrupted_thread_index=cpu_private_data.thread_index;
+
+ system_time++;
+
+ if (-1 != timer_queue_head)
+ {
+  register int thread_index;
+
+  timer_queue_tick();
+
+  while(-1 != (thread_index=timer_queue_remove_expired()))
+  {
+   if (-1 == cpu_private_data.thread_index)
+   {
+    cpu_private_data.thread_index=thread_index;
+    set_thread_state(thread_index, THREAD_STATE_RUNNING);
+    thread_changed=1;
+   }
+   else
+   {
+    set_thread_state(thread_index, THREAD_STATE_READY);
+    thread_queue_enqueue(&ready_queue, thread_index);
+   }
+  }
+ }
+
+ scheduler_called_from_timer_interrupt_handler(thread_changed);
+ check_switch(interrupted_thread_index);
+}
+
+static int
+compare_samples(const void* a, const void* b)
+{
+ const unsigned long x=*(const unsigned long*) a;
+ const unsigned long y=*(const unsigned long*) b;
+
+ return (x > y) - (x < y);
+}
+
+/*! Prints the percentiles of a set of latencies in microseconds. */
+static void
+print_percentiles(const char* const name, struct samples* const samples)
+{
+ static const int permilles[]={500, 900, 990, 999};
+ unsigned int     i;
+
+ printf("BENCH %s samples=%lu", name, samples->count);
+ if (0 == samples->count)
+ {
+  printf("\n");
+  return;
+ }
+
+ qsort(samples->values, samples->count, sizeof(unsigned long),
+       compare_samples);
+ for(i=0; i<sizeof(permilles)/sizeof(permilles[0]); i++)
+ {
+  printf(" p%g_us=%lu", permilles[i]/10.0,
+         samples->values[(samples->count-1)*permilles[i]/1000]/1000);
+ }
+ printf(" max_us=%lu\n", samples->values[samples->count-1]/1000);
+}
+
+static void
+usage(const char* const program)
+{
+ fprintf(stderr,
+         "usage: %s [-t threads] [-d ticks] [-b mean burst us]\n"
+         "       [-p pause percent] [-y yield percent] [-m max pause ticks]\n"
+         "       [-s seed]\n", program);
+ exit(2);
+}
+
+int
+main(int argc, char* argv[])
+{
+ double  cpu_sum=0;
+ double  cpu_square_sum=0;
+ clock_t host_start;
+ int     option;
+ int     thread_index;
+
+ while (-1 != (option=getopt(argc, argv, "t:d:b:p:y:m:s:")))
+ {
+  switch(option)
+  {
+   case 't': workload.threads=atoi(optarg); break;
+   case 'd': workload.ticks=atol(optarg); break;
+   case 'b': workload.burst_ns=1000*strtoul(optarg, 0, 10); break;
+   case 'p': workload.pause_percent=atoi(optarg); break;
+   case 'y': workload.yield_percent=atoi(optarg); break;
+   case 'm': workload.max_pause_ticks=atoi(optarg); break;
+   case 's': workload.seed=strtoul(optarg, 0, 10); break;
+   default: usage(argv[0]);
+  }
+ }
+ if ((workload.threads < 1) || (workload.ticks < 1) ||
+     (0 == workload.burst_ns) || (workload.max_pause_ticks < 1) ||
+     (workload.pause_percent < 0) || (workload.yield_percent < 0) ||
+     (workload.pause_percent+workload.yield_percent > 100))
+ {
+  usage(argv[0]);
+ }
+
+ thread_scheduling_table=aligned_alloc(64,
+                                       workload.threads*
+                                       sizeof(struct thread_scheduling_data));
+ threads=calloc(workload.threads, sizeof(struct simulated_thread));
+ if ((0 == thread_scheduling_table) || (0 == threads))
+ {
+  fprintf(stderr, "Out of memory\n");
+  return 1;
+ }
+
+ host_start=clock();
+
+ /* Start with all threads in the ready queue and let the scheduler pick
+    one as if the boot code made a system call. */
+ thread_queue_init(&ready_queue);
+ cpu_private_data.thread_index=-1;
+ for(thread_index=0; thread_index<workload.threads; thread_index++)
+ {
+  thread_scheduling_table[thread_index].state=THREAD_STATE_NEW;
+  thread_scheduling_table[thread_index].priority=THREAD_PRIORITY_DEFAULT;
+  thread_scheduling_table[thread_index].allowed_cpus=1;
+  threads[thread_index].burst_left=random_burst();
+  set_thread_state(thread_index, THREAD_STATE_READY);
+  thread_queue_enqueue(&ready_queue, thread_index);
+ }
+ scheduler_called_from_system_call_handler(1);
+
+ while (system_time < workload.ticks)
+ {
+  const unsigned long next_tick=(system_time+1)*NANOSECONDS_PER_TICK;
+  const int           running=cpu_private_data.thread_index;
+
+  if (-1 == running)
+  {
+   idle_ns+=next_tick-now;
+   now=next_tick;
+   simulate_timer_interrupt();
+  }
+  else if (now+threads[running].burst_left <= next_tick)
+  {
+   now+=threads[running].burst_left;
+   bursts++;
+   simulate_system_call();
+  }
+  else
+  {
+   threads[running].burst_left-=next_tick-now;
+   now=next_tick;
+   simulate_timer_interrupt();
+  }
+ }
+
+ /* Account for the time of the thread running at the end. */
+ if (-1 != cpu_private_data.thread_index)
+ {
+  set_thread_state(cpu_private_data.thread_index, THREAD_STATE_READY);
+ }
+
+ for(thread_index=0; thread_index<workload.threads; thread_index++)
+ {
+  cpu_sum+=threads[thread_index].cpu_ns;
+  cpu_square_sum+=(double) threads[thread_index].cpu_ns*
+                  threads[thread_index].cpu_ns;
+ }
+
+ printf("BENCH schedsim threads=%d ticks=%ld bursts_per_second=%lu "
+        "context_switches_per_second=%lu utilization_permille=%lu "
+        "fairness_permille=%lu host_ms=%lu\n",
+        workload.threads, workload.ticks,
+        (unsigned long) (bursts*1e9/now),
+        (unsigned long) (context_switches*1e9/now),
+        1000-idle_ns*1000/now,
+        (unsigned long) (cpu_square_sum ?
+                         1000*cpu_sum*cpu_sum/
+                         (workload.threads*cpu_square_sum) : 0),
+        (unsigned long) ((clock()-host_start)*1000/CLOCKS_PER_SEC));
+ print_percentiles("schedsim_dispatch_latency", &dispatch_latencies);
+ print_percentiles("schedsim_wakeup_latency", &wakeup_latencies);
+
+ free(dispatch_latencies.values);
+ free(wakeup_latencies.values);
+ free(threads);
+ free(thread_scheduling_table);
+ return 0;
+}
@@ -0,0 +1,92 @@
+/*!
+ * \file timerqueue_bench.c
+ * \brief
+ *  Measures the cost of the timer queue operations. The program runs on the
+ *  build host and is linked with the threadqueue.c used by the kernel. Each
+ *  round puts a number of sleeping threads into the timer queue and then
+ *  ticks the queue until all of them are woken up.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "kernel.h"
+#include "threadqueue.h"
+
+#define NUMBER_OF_SLEEPERS (256)
+/*!< The number of threads in the timer queue. */
+#define NUMBER_OF_ROUNDS   (1000)
+/*!< The number of times the queue is filled and drained. */
+#define MAX_SLEEP_TICKS    (1000)
+/*!< Sleepers wait between 1 and this many ticks. */
+
+/* The kernel variables used by threadqueue.c. */
+
+struct thread_scheduling_data*
+thread_scheduling_table;
+
+int
+timer_queue_head=-1;
+
+int
+main(void)
+{
+ unsigned long insert_cycles=0;
+ unsigned long tick_cycles=0;
+ unsigned long ticks=0;
+ unsigned long seed=1;
+ int           round;
+
+ thread_scheduling_table=aligned_alloc(64,
+                                       NUMBER_OF_SLEEPERS*
+                                       sizeof(struct thread_scheduling_data));
+ if (0 == thread_scheduling_table)
+ {
+  return 1;
+ }
+
+ for(round=0; round<NUMBER_OF_ROUNDS; round++)
+ {
+  unsigned long start;
+  int           thread_index;
+  int           woken=0;
+
+  /* Insert the sleepers in a pseudo random order of wake up times. */
+  start=rdtsc();
+  for(thread_index=0; thread_index<NUMBER_OF_SLEEPERS; thread_index++)
+  {
+   seed=seed*6364136223846793005UL+1442695040888963407UL;
+   timer_queue_insert(thread_index, 1+(seed>>33)%MAX_SLEEP_TICKS);
+  }
+  insert_cycles+=rdtsc()-start;
+
+  /* Then tick the queue as the timer interrupt handler does. */
+  start=rdtsc();
+  while (-1 != timer_queue_head)
+  {
+   timer_queue_tick();
+   ticks++;
+   while (-1 != timer_queue_remove_expired())
+   {
+    woken++;
+   }
+  }
+  tick_cycles+=rdtsc()-start;
+
+  if (NUMBER_OF_SLEEPERS != woken)
+  {
+   fprintf(stderr, "Lost sleepers: %d\n", NUMBER_OF_SLEEPERS-woken);
+   return 1;
+  }
+ }
+
+ printf("BENCH timer_queue sleepers=%d entry_bytes=%lu "
+        "cycles_per_insert=%lu cycles_per_tick=%lu\n",
+        NUMBER_OF_SLEEPERS,
+        (unsigned long) sizeof(struct thread_scheduling_data),
+        insert_cycles/(NUMBER_OF_ROUNDS*NUMBER_OF_SLEEPERS),
+        tick_cycles/ticks);
+
+ free(thread_scheduling_table);
+ return 0;
+}
@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+"""Converts a kernel event trace to Chrome trace event JSON.
+
+The kernel writes its trace to the debug port when a program calls
+tracedump(). Capture the debug port output to a file and run
+
+    trace2json.py debug.log > trace.json
+
+The result can be loaded into chrome://tracing or ui.perfetto.dev. Each CPU
+becomes a process in the viewer. A track per CPU shows which thread runs and
+a track per thread shows its system calls.
+"""
+
+import argparse
+import json
+import sys
+
+# Must match the TRACE_EVENT_ values in src/kernel/trace.h.
+TRACE_EVENT_CONTEXT_SWITCH = 1
+TRACE_EVENT_SYSCALL_ENTER = 2
+TRACE_EVENT_SYSCALL_EXIT = 3
+TRACE_EVENT_WAKEUP = 4
+TRACE_EVENT_TIMER_EXPIRY = 5
+TRACE_EVENT_PROCESS_CREATE = 6
+TRACE_EVENT_PROCESS_EXIT = 7
+TRACE_EVENT_PROCESS_START = 8
+
+# Must match the SYSCALL_ values in src/include/sysdefines.h.
+SYSCALL_NAMES = {
+    0: "version",
+    1: "prints",
+    2: "printhex",
+    3: "debugger",
+    4: "terminate",
+    5: "createprocess",
+    6: "pause",
+    7: "time",
+    8: "tracedump",
+}
+
+# The number of timer interrupts per second.
+TICKS_PER_SECOND = 200
+
+# Track used for the thread running on a CPU. Thread tracks use the thread
+# index plus one.
+CPU_TRACK = 0
+
+
+def signed(value):
+    """Interprets a 64 bit value printed by kprinthex as signed."""
+    return value - (1 << 64) if value >= (1 << 63) else value
+
+
+def parse(lines):
+    """Returns the clock line and the records found in the debug port log."""
+    clock = None
+    records = []
+    for line in lines:
+        fields = line.split()
+        if not fields or fields[0] != "TRACE":
+            continue
+        if fields[1] == "CLOCK":
+            clock = [int(field, 16) for field in fields[2:5]]
+        elif fields[1] == "LOST":
+            cpu, lost = (int(field, 16) for field in fields[2:4])
+            if lost:
+                print("cpu %d: %d records were overwritten" % (cpu, lost),
+                      file=sys.stderr)
+        else:
+            timestamp, cpu, event, arg0, arg1 = (int(field, 16)
+                                                 for field in fields[1:6])
+            records.append((timestamp, cpu, event, signed(arg0), signed(arg1)))
+    return clock, records
+
+
+def thread_name(thread):
+    return "idle" if thread < 0 else "thread %d" % thread
+
+
+def convert(clock, records, tsc_mhz):
+    """Returns the list of Chrome trace events for the records."""
+    if tsc_mhz is None:
+        if clock is None or clock[0] == 0:
+            sys.exit("No clock information in the trace. Use --tsc-mhz.")
+        tsc_mhz = clock[1] * TICKS_PER_SECOND / clock[0] / 1e6
+    start = clock[2] if clock else min(record[0] for record in records)
+
+    events = []
+    running = {}
+    in_syscall = {}
+
+    def timestamp(cycles):
+        return (cycles - start) / tsc_mhz
+
+    records = sorted(records, key=lambda record: record[0])
+    for cycles, cpu, event, arg0, arg1 in records:
+        ts = timestamp(cycles)
+        if event == TRACE_EVENT_CONTEXT_SWITCH:
+            if cpu in running:
+                events.append({"ph": "E", "pid": cpu, "tid": CPU_TRACK,
+                               "ts": ts})
+            events.append({"ph": "B", "pid": cpu, "tid": CPU_TRACK, "ts": ts,
+                           "name": thread_name(arg1),
+                           "args": {"previous": arg0}})
+            running[cpu] = arg1
+        elif event == TRACE_EVENT_SYSCALL_ENTER:
+            events.append({"ph": "B", "pid": cpu, "tid": arg1 + 1, "ts": ts,
+                           "name": SYSCALL_NAMES.get(arg0,
+                                                     "syscall %d" % arg0)})
+            in_syscall[arg1] = True
+        elif event == TRACE_EVENT_SYSCALL_EXIT:
+            if in_syscall.pop(arg1, False):
+                events.append({"ph": "E", "pid": cpu, "tid": arg1 + 1,
+                               "ts": ts, "args": {"return": arg0}})
+        elif event == TRACE_EVENT_WAKEUP:
+            events.append({"ph": "i", "s": "t", "pid": cpu, "tid": arg0 + 1,
+                           "ts": ts, "name": "wakeup",
+                           "args": {"runs_at_once": arg1}})
+        elif event == TRACE_EVENT_TIMER_EXPIRY:
+            events.append({"ph": "i", "s": "p", "pid": cpu, "tid": CPU_TRACK,
+                           "ts": ts, "name": "timer expiry",
+                           "args": {"system_time": arg0, "woken": arg1}})
+        elif event == TRACE_EVENT_PROCESS_CREATE:
+            events.append({"ph": "i", "s": "g", "pid": cpu, "tid": CPU_TRACK,
+                           "ts": ts, "name": "process %d created" % arg0,
+                           "args": {"launch_cycles": arg1}})
+        elif event == TRACE_EVENT_PROCESS_START:
+            events.append({"ph": "i", "s": "g", "pid": cpu, "tid": CPU_TRACK,
+                           "ts": ts, "name": "process %d started" % arg0,
+                           "args": {"first_instruction_cycles": arg1}})
+        elif event == TRACE_EVENT_PROCESS_EXIT:
+            events.append({"ph": "i", "s": "g", "pid": cpu, "tid": CPU_TRACK,
+                           "ts": ts, "name": "process %d exited" % arg0,
+                           "args": {"resident_pages": arg1}})
+
+    # Name the tracks.
+    for cpu in sorted(set(record[1] for record in records)):
+        events.append({"ph": "M", "pid": cpu, "name": "process_name",
+                       "args": {"name": "cpu %d" % cpu}})
+        events.append({"ph": "M", "pid": cpu, "tid": CPU_TRACK,
+                       "name": "thread_name", "args": {"name": "running"}})
+    for cpu, thread in set((record[1], record[4]) for record in records
+                           if record[2] == TRACE_EVENT_SYSCALL_ENTER):
+        events.append({"ph": "M", "pid": cpu, "tid": thread + 1,
+                       "name": "thread_name",
+                       "args": {"name": thread_name(thread)}})
+    return events
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("log", nargs="?", type=argparse.FileType("r"),
+                        default=sys.stdin,
+                        help="debug port output holding a trace dump")
+    parser.add_argument("--tsc-mhz", type=float,
+                        help="time stamp counter frequency; by default it "
+                             "is derived from the system time in the dump")
+    args = parser.parse_args()
+
+    clock, records = parse(args.log)
+    if not records:
+        sys.exit("No trace records found.")
+    json.dump({"traceEvents": convert(clock, records, args.tsc_mhz),
+               "displayTimeUnit": "ns"}, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()